@@ -0,0 +1,335 @@
+/* affinity.cpp
+ *
+ * Pinning worker threads to CPUs.  See affinity.h.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef BLR_USELINUX
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     // for sched_getaffinity(), pthread_setaffinity_np()
+#endif
+#include <sched.h>
+#include <pthread.h>
+#endif
+#ifdef BLR_USEWIN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "affinity.h"
+
+
+enum
+{
+   MAX_CPUS = 1024
+};
+
+struct cpuInfo
+{
+   int cpu;
+   int package, core, thread;   // thread: which of its core's hardware threads
+   int rank;                    // which of its package's cores
+};
+
+
+#ifdef BLR_USELINUX
+// One number from the CPU's sysfs topology directory, or -1.
+static int
+readTopology( int cpu, const char *what )
+{
+   char path[ 128 ];
+   FILE *fp;
+   int v = -1;
+
+   snprintf( path, sizeof( path ), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, what );
+   if( ( fp = fopen( path, "r" ) ) != NULL )
+   {
+      if( fscanf( fp, "%d", &v ) != 1 )
+      {
+         v = -1;
+      }
+      fclose( fp );
+   }
+   return v;
+}
+#endif
+
+
+// The CPUs this process may run on, and where they are.  Returns how many.
+// Without topology information every CPU is taken to be its own core.
+static int
+discoverCpus( struct cpuInfo *info )
+{
+   int n = 0, i, j;
+
+#ifdef BLR_USELINUX
+   cpu_set_t set;
+
+   if( sched_getaffinity( 0, sizeof( set ), &set ) == 0 )
+   {
+      for( i = 0; i < CPU_SETSIZE && n < MAX_CPUS; i++ )
+      {
+         if( CPU_ISSET( i, &set ) )
+         {
+            info[ n ].cpu     = i;
+            info[ n ].package = readTopology( i, "physical_package_id" );
+            info[ n ].core    = readTopology( i, "core_id" );
+            n++;
+         }
+      }
+   }
+#else
+#ifdef BLR_USEWIN
+   SYSTEM_INFO si;
+
+   GetSystemInfo( &si );
+   for( i = 0; i < (int)si.dwNumberOfProcessors && i < 64; i++ )
+   {
+      info[ n ].cpu = i;
+      info[ n ].package = info[ n ].core = -1;
+      n++;
+   }
+#else
+   long count = sysconf( _SC_NPROCESSORS_ONLN );
+
+   for( i = 0; i < count && i < MAX_CPUS; i++ )
+   {
+      info[ n ].cpu = i;
+      info[ n ].package = info[ n ].core = -1;
+      n++;
+   }
+#endif
+#endif
+
+   for( i = 0; i < n; i++ )
+   {
+      if( info[ i ].package < 0 || info[ i ].core < 0 )
+      {
+         info[ i ].package = 0;
+         info[ i ].core = info[ i ].cpu;
+      }
+   }
+
+   // Number the hardware threads within each core, and the cores within
+   // each package.
+   for( i = 0; i < n; i++ )
+   {
+      info[ i ].thread = 0;
+      info[ i ].rank = 0;
+      for( j = 0; j < n; j++ )
+      {
+         if( info[ j ].package != info[ i ].package )
+         {
+            continue;
+         }
+         if( info[ j ].core == info[ i ].core && j < i )
+         {
+            info[ i ].thread++;
+         }
+      }
+   }
+   for( i = 0; i < n; i++ )
+   {
+      for( j = 0; j < n; j++ )
+      {
+         if( info[ j ].package == info[ i ].package && info[ j ].thread == 0 &&
+             info[ j ].core < info[ i ].core )
+         {
+            info[ i ].rank++;
+         }
+      }
+   }
+   return n;
+}
+
+
+// Package, then core, then hardware thread.
+static int
+compareCompact( const void *a, const void *b )
+{
+   const struct cpuInfo *x = (const struct cpuInfo *)a, *y = (const struct cpuInfo *)b;
+
+   if( x->package != y->package ) return x->package - y->package;
+   if( x->rank    != y->rank    ) return x->rank    - y->rank;
+   return x->thread - y->thread;
+}
+
+
+// Hardware thread, then core, then package: every core of every package
+// gets one worker before any gets two.
+static int
+compareScatter( const void *a, const void *b )
+{
+   const struct cpuInfo *x = (const struct cpuInfo *)a, *y = (const struct cpuInfo *)b;
+
+   if( x->thread  != y->thread  ) return x->thread  - y->thread;
+   if( x->rank    != y->rank    ) return x->rank    - y->rank;
+   return x->package - y->package;
+}
+
+
+// Parse a list like 0,2,4-7 into cpus, checking each is one we may use.
+// Returns how many, or 0 on error.
+static int
+parseCpuList( const char *spec, const struct cpuInfo *info, int nInfo, int *list, int max )
+{
+   const char *p = spec;
+   char *end;
+   long lo, hi, c;
+   int n = 0, i, ok;
+
+   while( *p )
+   {
+      lo = strtol( p, &end, 10 );
+      if( end == p || lo < 0 )
+      {
+         return 0;
+      }
+      hi = lo;
+      p = end;
+      if( *p == '-' )
+      {
+         hi = strtol( p + 1, &end, 10 );
+         if( end == p + 1 || hi < lo )
+         {
+            return 0;
+         }
+         p = end;
+      }
+      for( c = lo; c <= hi; c++ )
+      {
+         for( i = 0, ok = 0; i < nInfo; i++ )
+         {
+            ok |= ( info[ i ].cpu == c );
+         }
+         if( !ok )
+         {
+            fprintf( stderr, "--affinity: cpu %ld is not available.\n", c );
+            return 0;
+         }
+         if( n < max )
+         {
+            list[ n++ ] = (int)c;
+         }
+      }
+      if( *p == ',' )
+      {
+         p++;
+      } else if( *p ) {
+         return 0;
+      }
+   }
+   return n;
+}
+
+
+int
+planAffinity( const char *spec, int n, int *cpus )
+{
+   static struct cpuInfo info[ MAX_CPUS ];
+   int list[ MAX_CPUS ];
+   int nInfo, nList = 0, i;
+
+   for( i = 0; i < n; i++ )
+   {
+      cpus[ i ] = -1;
+   }
+
+   nInfo = discoverCpus( info );
+   if( nInfo == 0 )
+   {
+      fprintf( stderr, "--affinity: cannot tell which CPUs are available.\n" );
+      return 0;
+   }
+
+   if( !strcmp( spec, "compact" ) || !strcmp( spec, "scatter" ) || !strcmp( spec, "physical" ) )
+   {
+      qsort( info, nInfo, sizeof( struct cpuInfo ),
+             strcmp( spec, "scatter" ) ? compareCompact : compareScatter );
+      for( i = 0; i < nInfo; i++ )
+      {
+         if( strcmp( spec, "physical" ) || info[ i ].thread == 0 )
+         {
+            list[ nList++ ] = info[ i ].cpu;
+         }
+      }
+   } else {
+      nList = parseCpuList( spec, info, nInfo, list, MAX_CPUS );
+      if( nList == 0 )
+      {
+         fprintf( stderr, "--affinity takes compact, scatter, physical or a CPU list like 0,2,4-7.\n" );
+         return 0;
+      }
+   }
+
+   for( i = 0; i < n; i++ )
+   {
+      cpus[ i ] = list[ i % nList ];
+   }
+   return 1;
+}
+
+
+int
+pinThread( int cpu )
+{
+#ifdef BLR_USELINUX
+   cpu_set_t set;
+
+   CPU_ZERO( &set );
+   CPU_SET( cpu, &set );
+   return pthread_setaffinity_np( pthread_self(), sizeof( set ), &set ) == 0;
+#else
+#ifdef BLR_USEWIN
+   return cpu < 64 && SetThreadAffinityMask( GetCurrentThread(), (DWORD_PTR)1 << cpu ) != 0;
+#else
+   // Mac OS X only takes affinity hints, and not by CPU number.
+   cpu = cpu;
+   return 0;
+#endif
+#endif
+}
+
+
+void
+describeCpu( int cpu, char *buf, int sz )
+{
+   struct cpuInfo *all;
+   int n, i;
+
+   all = (struct cpuInfo *)malloc( sizeof( struct cpuInfo ) * MAX_CPUS );
+   n = all ? discoverCpus( all ) : 0;
+   snprintf( buf, sz, "cpu %d", cpu );
+   for( i = 0; i < n; i++ )
+   {
+      if( all[ i ].cpu == cpu )
+      {
+         snprintf( buf, sz, "cpu %d (package %d core %d thread %d)",
+                   cpu, all[ i ].package, all[ i ].core, all[ i ].thread );
+      }
+   }
+   free( all );
+}
@@ -0,0 +1,48 @@
+/* affinity.h
+ *
+ * Pinning worker threads to CPUs (--affinity).
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+// Choose a CPU for each of n workers.  spec is one of
+//
+//    compact    fill each core's hardware threads before the next core's
+//    scatter    one worker per core, spread over packages, before any
+//               core gets a second
+//    physical   only the first hardware thread of each core; more
+//               workers than cores wrap around
+//    a list     explicit CPU numbers, e.g. 0,2,4-7; worker i gets the
+//               i'th, wrapping around
+//
+// Only CPUs this process may run on are used.  Fills cpus[ 0 .. n-1 ] and
+// returns 1, or prints why and returns 0 with every cpus[ i ] = -1.
+int planAffinity( const char *spec, int n, int *cpus );
+
+// Pin the calling thread to cpu.  Returns 0 where that is not possible.
+int pinThread( int cpu );
+
+// Where cpu is, for verbose reports: "cpu 5 (package 0 core 2 thread 1)".
+void describeCpu( int cpu, char *buf, int sz );
+
+#endif /* AFFINITY_H */
@@ -0,0 +1,807 @@
+/* analysis.cpp
+ *
+ * Periodic analysis of the running simulation.  See analysis.h.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#ifdef HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "analysis.h"
+#include "options.h"
+#include "sim.h"
+#include "safecalls.h"
+using namespace SafeCalls;
+
+
+//===========================================================================
+// Built-in stages
+//===========================================================================
+
+// Ions of each species on each side, from a snapshot: LHS K, Na, Cl, then
+// RHS K, Na, Cl, as takeCensus() counts them.
+static void
+countSides( const struct snapshot *snap, int *counts )
+{
+   const unsigned char *row;
+   int x, y, side;
+
+   memset( counts, 0, 6 * sizeof( int ) );
+   for( y = 0; y < snap->y; y++ )
+   {
+      row = snap->colors + y * snap->x;
+      for( x = 0; x < snap->x; x++ )
+      {
+         if( x == snap->x / 2 )
+         {
+            continue;
+         }
+         side = ( x < snap->x / 2 ) ? 0 : 3;
+         switch( row[ x ] )
+         {
+            case ATOM_K:
+               counts[ side ]++;
+               break;
+            case ATOM_Na:
+               counts[ side + 1 ]++;
+               break;
+            case ATOM_Cl:
+               counts[ side + 2 ]++;
+               break;
+            default:
+               break;
+         }
+      }
+   }
+}
+
+
+// Ions of each species in each column: counts[ s * x + column ] for s = 0
+// (K), 1 (Na) and 2 (Cl).  The world is read a row at a time, 16 squares
+// at once, into 8-bit counts in acc (3 * x bytes, which stay in L1 even
+// for the widest world); those are widened into counts every 255 rows,
+// before they can overflow.
+static void
+countColumns( const struct snapshot *snap, uint16_t *counts, uint8_t *acc )
+{
+   const unsigned char *row;
+   int X = snap->x, y, r, n, x, i;
+
+   memset( counts, 0, 3 * X * sizeof( uint16_t ) );
+   for( y = 0; y < snap->y; y += n )
+   {
+      n = ( snap->y - y < 255 ) ? snap->y - y : 255;
+      memset( acc, 0, 3 * X );
+      for( r = y; r < y + n; r++ )
+      {
+         row = snap->colors + r * X;
+         x = 0;
+#ifdef HAVE_SSE2
+         const __m128i k  = _mm_set1_epi8( ATOM_K );
+         const __m128i na = _mm_set1_epi8( ATOM_Na );
+         const __m128i cl = _mm_set1_epi8( ATOM_Cl );
+         __m128i c, *a;
+
+         // A match is all ones, -1, so subtracting it counts one.
+         for( ; x + 16 <= X; x += 16 )
+         {
+            c = _mm_loadu_si128( (const __m128i *)( row + x ) );
+            a = (__m128i *)( acc + x );
+            _mm_storeu_si128( a, _mm_sub_epi8( _mm_loadu_si128( a ), _mm_cmpeq_epi8( c, k ) ) );
+            a = (__m128i *)( acc + X + x );
+            _mm_storeu_si128( a, _mm_sub_epi8( _mm_loadu_si128( a ), _mm_cmpeq_epi8( c, na ) ) );
+            a = (__m128i *)( acc + 2 * X + x );
+            _mm_storeu_si128( a, _mm_sub_epi8( _mm_loadu_si128( a ), _mm_cmpeq_epi8( c, cl ) ) );
+         }
+#endif
+         for( ; x < X; x++ )
+         {
+            acc[ x ]         += ( row[ x ] == ATOM_K );
+            acc[ X + x ]     += ( row[ x ] == ATOM_Na );
+            acc[ 2 * X + x ] += ( row[ x ] == ATOM_Cl );
+         }
+      }
+      for( i = 0; i < 3 * X; i++ )
+      {
+         counts[ i ] += acc[ i ];
+      }
+   }
+}
+
+
+static FILE *
+openOutput( const char *file, const char *header )
+{
+   FILE *fp = fopen( file, "w" );
+
+   if( !fp )
+   {
+      perror( file );
+      return NULL;
+   }
+   fprintf( fp, "%s\n", header );
+   return fp;
+}
+
+
+// The same columns as static.out.
+class CensusStage : public AnalysisStage
+{
+   public:
+      CensusStage( FILE *f ) : fp( f ) {}
+      ~CensusStage() { fclose( fp ); }
+
+      void analyze( const struct snapshot *snap )
+      {
+         int c[ 6 ];
+
+         countSides( snap, c );
+         fprintf( fp, "%d %d %d %d %d %d %d %d %f\n", snap->iter,
+                  c[ 0 ], c[ 1 ], c[ 2 ], c[ 3 ], c[ 4 ], c[ 5 ],
+                  snap->LRcharge, snap->LRcharge * snap->mVPerCharge );
+      }
+      void finish() { fflush( fp ); }
+
+   private:
+      FILE *fp;
+};
+
+
+static AnalysisStage *
+makeCensus( struct options *o, const char *file )
+{
+   FILE *fp = openOutput( file, "T LK LNa LCl RK RNa RCl q vm" );
+
+   o = o;
+   return fp ? safeNew( CensusStage( fp ) ) : NULL;
+}
+
+
+// Concentration (mM) of each species in each column, on the same scale
+// as --lK and friends: a column entirely of K would be 3 * MAX_CONC.
+class ProfileStage : public AnalysisStage
+{
+   public:
+      ProfileStage( FILE *f, int x ) : fp( f )
+      {
+         counts = (uint16_t *)malloc( 3 * x * sizeof( uint16_t ) );
+         acc = (uint8_t *)malloc( 3 * x );
+         assert( counts && acc );
+      }
+      ~ProfileStage() { fclose( fp ); free( counts ); free( acc ); }
+
+      void analyze( const struct snapshot *snap )
+      {
+         double scale = 3.0 * MAX_CONC / snap->y;
+         int x, X = snap->x;
+
+         countColumns( snap, counts, acc );
+         for( x = 0; x < X; x++ )
+         {
+            fprintf( fp, "%d %d %f %f %f\n", snap->iter, x, counts[ x ] * scale,
+                     counts[ X + x ] * scale, counts[ 2 * X + x ] * scale );
+         }
+      }
+      void finish() { fflush( fp ); }
+
+   private:
+      FILE *fp;
+      uint16_t *counts;
+      uint8_t *acc;
+};
+
+
+// The raw per-column counts, compactly, for sampling often.  In host
+// byte order:
+//
+//    header    "NCOL", uint32 version (1), uint32 x, uint32 y
+//    record    uint32 iter, int32 LRcharge, then uint16 counts of K in
+//              columns 0 .. x-1, then of Na, then of Cl
+//
+// A 2048-wide world takes 12 kB a record.
+class ColumnsStage : public AnalysisStage
+{
+   public:
+      ColumnsStage( FILE *f, int x, int y ) : fp( f )
+      {
+         uint32_t h[ 3 ] = { 1, (uint32_t)x, (uint32_t)y };
+
+         fwrite( "NCOL", 1, 4, fp );
+         fwrite( h, sizeof( uint32_t ), 3, fp );
+         counts = (uint16_t *)malloc( 3 * x * sizeof( uint16_t ) );
+         acc = (uint8_t *)malloc( 3 * x );
+         assert( counts && acc );
+      }
+      ~ColumnsStage() { fclose( fp ); free( counts ); free( acc ); }
+
+      void analyze( const struct snapshot *snap )
+      {
+         uint32_t iter = snap->iter;
+         int32_t q = snap->LRcharge;
+
+         countColumns( snap, counts, acc );
+         fwrite( &iter, sizeof( iter ), 1, fp );
+         fwrite( &q, sizeof( q ), 1, fp );
+         fwrite( counts, sizeof( uint16_t ), 3 * snap->x, fp );
+      }
+      void finish() { fflush( fp ); }
+
+   private:
+      FILE *fp;
+      uint16_t *counts;
+      uint8_t *acc;
+};
+
+
+static AnalysisStage *
+makeColumns( struct options *o, const char *file )
+{
+   FILE *fp = fopen( file, "wb" );
+
+   if( !fp )
+   {
+      perror( file );
+      return NULL;
+   }
+   return safeNew( ColumnsStage( fp, o->x, o->y ) );
+}
+
+
+static AnalysisStage *
+makeProfile( struct options *o, const char *file )
+{
+   FILE *fp = openOutput( file, "T x K Na Cl" );
+
+   return fp ? safeNew( ProfileStage( fp, o->x ) ) : NULL;
+}
+
+
+// Net ions of each species that crossed the membrane from left to right
+// since the previous snapshot, and the potential now.
+class FluxStage : public AnalysisStage
+{
+   public:
+      FluxStage( FILE *f ) : fp( f ), lastIter( -1 ) {}
+      ~FluxStage() { fclose( fp ); }
+
+      void analyze( const struct snapshot *snap )
+      {
+         int c[ 6 ], i;
+
+         countSides( snap, c );
+         if( lastIter >= 0 )
+         {
+            fprintf( fp, "%d %d %d %d %d %f\n", snap->iter, snap->iter - lastIter,
+                     last[ 0 ] - c[ 0 ], last[ 1 ] - c[ 1 ], last[ 2 ] - c[ 2 ],
+                     snap->LRcharge * snap->mVPerCharge );
+         }
+         for( i = 0; i < 3; i++ )
+         {
+            last[ i ] = c[ i ];
+         }
+         lastIter = snap->iter;
+      }
+      void finish() { fflush( fp ); }
+
+   private:
+      FILE *fp;
+      int lastIter;
+      int last[ 3 ];
+};
+
+
+static AnalysisStage *
+makeFlux( struct options *o, const char *file )
+{
+   FILE *fp = openOutput( file, "T dT K Na Cl vm" );
+
+   o = o;
+   return fp ? safeNew( FluxStage( fp ) ) : NULL;
+}
+
+
+// Crossings through all the pores since the previous snapshot, per
+// iteration, by species and direction (lr is left to right), and the
+// net current left to right in elementary charges per iteration.
+class CurrentStage : public AnalysisStage
+{
+   public:
+      CurrentStage( FILE *f, int y ) : fp( f ), lastIter( -1 )
+      {
+         last = (unsigned int *)calloc( 6 * y, sizeof( unsigned int ) );
+         assert( last );
+      }
+      ~CurrentStage() { fclose( fp ); free( last ); }
+
+      void analyze( const struct snapshot *snap )
+      {
+         unsigned int d[ 6 ];
+         double dt;
+         int i, r;
+
+         if( lastIter >= 0 && snap->iter > lastIter )
+         {
+            memset( d, 0, sizeof( d ) );
+            for( r = 0; r < snap->y; r++ )
+            {
+               for( i = 0; i < 6; i++ )
+               {
+                  d[ i ] += snap->poreFlux[ 6 * r + i ] - last[ 6 * r + i ];
+               }
+            }
+            dt = snap->iter - lastIter;
+            fprintf( fp, "%d %d %f %f %f %f %f %f %f\n", snap->iter, snap->iter - lastIter,
+                     d[ 0 ] / dt, d[ 1 ] / dt, d[ 2 ] / dt, d[ 3 ] / dt, d[ 4 ] / dt, d[ 5 ] / dt,
+                     ( (double)d[ 0 ] - d[ 1 ] + d[ 2 ] - d[ 3 ] - d[ 4 ] + d[ 5 ] ) / dt );
+         }
+         memcpy( last, snap->poreFlux, 6 * sizeof( unsigned int ) * snap->y );
+         lastIter = snap->iter;
+      }
+      void finish() { fflush( fp ); }
+
+   private:
+      FILE *fp;
+      int lastIter;
+      unsigned int *last;
+};
+
+
+static AnalysisStage *
+makeCurrent( struct options *o, const char *file )
+{
+   FILE *fp = openOutput( file, "T dT K_lr K_rl Na_lr Na_rl Cl_lr Cl_rl I" );
+
+   return fp ? safeNew( CurrentStage( fp, o->y ) ) : NULL;
+}
+
+
+// A single-channel style record: the net charge each pore carried left to
+// right since the previous snapshot, one column per pore, named by its
+// row and kind in the first line.
+class ChannelsStage : public AnalysisStage
+{
+   public:
+      ChannelsStage( FILE *f, int y ) : fp( f ), lastIter( -1 )
+      {
+         last = (unsigned int *)calloc( 6 * y, sizeof( unsigned int ) );
+         assert( last );
+      }
+      ~ChannelsStage() { fclose( fp ); free( last ); }
+
+      void analyze( const struct snapshot *snap )
+      {
+         static const char *kinds[] = { "K", "Na", "Cl" };
+         const unsigned int *f;
+         unsigned int pore;
+         int r, i, q[ 6 ];
+
+         if( lastIter < 0 )
+         {
+            fprintf( fp, "T dT" );
+            for( r = 0; r < snap->y; r++ )
+            {
+               pore = snap->colors[ r * snap->x + snap->x / 2 ];
+               if( pore >= PORE_K && pore <= PORE_Cl )
+               {
+                  fprintf( fp, " %s@%d", kinds[ pore - PORE_K ], r );
+               }
+            }
+            fprintf( fp, "\n" );
+         } else if( snap->iter > lastIter ) {
+            fprintf( fp, "%d %d", snap->iter, snap->iter - lastIter );
+            for( r = 0; r < snap->y; r++ )
+            {
+               pore = snap->colors[ r * snap->x + snap->x / 2 ];
+               if( pore >= PORE_K && pore <= PORE_Cl )
+               {
+                  f = snap->poreFlux + 6 * r;
+                  for( i = 0; i < 6; i++ )
+                  {
+                     q[ i ] = (int)( f[ i ] - last[ 6 * r + i ] );
+                  }
+                  fprintf( fp, " %d", q[ 0 ] - q[ 1 ] + q[ 2 ] - q[ 3 ] - q[ 4 ] + q[ 5 ] );
+               }
+            }
+            fprintf( fp, "\n" );
+         }
+         memcpy( last, snap->poreFlux, 6 * sizeof( unsigned int ) * snap->y );
+         lastIter = snap->iter;
+      }
+      void finish() { fflush( fp ); }
+
+   private:
+      FILE *fp;
+      int lastIter;
+      unsigned int *last;
+};
+
+
+static AnalysisStage *
+makeChannels( struct options *o, const char *file )
+{
+   FILE *fp = fopen( file, "w" );
+
+   if( !fp )
+   {
+      perror( file );
+      return NULL;
+   }
+   return safeNew( ChannelsStage( fp, o->y ) );
+}
+
+
+//===========================================================================
+// Registry
+//===========================================================================
+
+enum
+{
+   MAX_STAGE_TYPES = 32
+};
+
+static struct
+{
+   const char *name;
+   analysisFactory make;
+} registry[ MAX_STAGE_TYPES ];
+static int nRegistered = 0;
+
+
+static void
+registerBuiltins()
+{
+   if( nRegistered == 0 )
+   {
+      registry[ 0 ].name = "census";
+      registry[ 0 ].make = makeCensus;
+      registry[ 1 ].name = "profile";
+      registry[ 1 ].make = makeProfile;
+      registry[ 2 ].name = "flux";
+      registry[ 2 ].make = makeFlux;
+      registry[ 3 ].name = "columns";
+      registry[ 3 ].make = makeColumns;
+      registry[ 4 ].name = "current";
+      registry[ 4 ].make = makeCurrent;
+      registry[ 5 ].name = "channels";
+      registry[ 5 ].make = makeChannels;
+      nRegistered = 6;
+   }
+}
+
+
+int
+registerAnalysisStage( const char *name, analysisFactory make )
+{
+   int i;
+
+   registerBuiltins();
+   for( i = 0; i < nRegistered; i++ )
+   {
+      if( !strcmp( registry[ i ].name, name ) )
+      {
+         return 0;
+      }
+   }
+   if( nRegistered == MAX_STAGE_TYPES )
+   {
+      return 0;
+   }
+   registry[ nRegistered ].name = name;
+   registry[ nRegistered ].make = make;
+   nRegistered++;
+   return 1;
+}
+
+
+//===========================================================================
+// AnalysisPipeline
+//===========================================================================
+
+AnalysisPipeline::AnalysisPipeline( struct options *options )
+{
+   int i;
+
+   o = options;
+   nStages = 0;
+   gcd = 0;
+   threads = NULL;
+   nThreads = 0;
+   done = 0;
+   for( i = 0; i < NUM_SNAPSHOTS; i++ )
+   {
+      bufs[ i ].colors = NULL;
+      bufs[ i ].poreFlux = NULL;
+      bufs[ i ].refs = 0;
+   }
+}
+
+
+AnalysisPipeline::~AnalysisPipeline()
+{
+   int i;
+
+   finish();
+   for( i = 0; i < nStages; i++ )
+   {
+      delete stages[ i ].stage;
+   }
+   for( i = 0; i < NUM_SNAPSHOTS; i++ )
+   {
+      free( bufs[ i ].colors );
+      free( bufs[ i ].poreFlux );
+   }
+}
+
+
+void
+AnalysisPipeline::add( AnalysisStage *stage, const char *name, int every )
+{
+   int a, b, t;
+
+   assert( nStages < MAX_STAGES && every > 0 && threads == NULL );
+   stages[ nStages ].stage = stage;
+   snprintf( stages[ nStages ].name, sizeof( stages[ nStages ].name ), "%s", name );
+   stages[ nStages ].every = every;
+   stages[ nStages ].skipped = 0;
+   nStages++;
+
+   for( a = gcd, b = every; b; t = a % b, a = b, b = t );
+   gcd = a;
+}
+
+
+int
+AnalysisPipeline::open()
+{
+   char name[ 32 ], file[ 256 ];
+   const char *p = o->analysis;
+   AnalysisStage *stage;
+   int every, n, i;
+
+   registerBuiltins();
+   while( p && *p )
+   {
+      n = 0;
+      if( sscanf( p, "%31[^:,]:%d%n", name, &every, &n ) != 2 || every < 1 )
+      {
+         fprintf( stderr, "--analysis takes a list of stage:every, such as census:64,flux:16.\n" );
+         return 0;
+      }
+      p += n;
+      p += ( *p == ',' );
+
+      for( i = 0; i < nRegistered && strcmp( registry[ i ].name, name ); i++ );
+      if( i == nRegistered )
+      {
+         fprintf( stderr, "--analysis: no stage called %s; there are", name );
+         for( i = 0; i < nRegistered; i++ )
+         {
+            fprintf( stderr, " %s", registry[ i ].name );
+         }
+         fprintf( stderr, ".\n" );
+         return 0;
+      }
+      if( nStages == MAX_STAGES )
+      {
+         fprintf( stderr, "--analysis: at most %d stages.\n", MAX_STAGES );
+         return 0;
+      }
+      snprintf( file, sizeof( file ), "%s%s.dat", o->analysis_prefix, name );
+      if( ( stage = registry[ i ].make( o, file ) ) == NULL )
+      {
+         return 0;
+      }
+      add( stage, name, every );
+   }
+   if( nStages == 0 )
+   {
+      return 0;
+   }
+
+   for( i = 0; i < NUM_SNAPSHOTS; i++ )
+   {
+      bufs[ i ].colors = (unsigned char *)malloc( o->x * o->y );
+      bufs[ i ].poreFlux = (unsigned int *)malloc( 6 * sizeof( unsigned int ) * o->y );
+      assert( bufs[ i ].colors && bufs[ i ].poreFlux );
+   }
+
+   // Each stage belongs to one thread, so sees its snapshots in order.
+   nThreads = ( o->analysis_threads < nStages ) ? o->analysis_threads : nStages;
+   if( nThreads < 1 )
+   {
+      nThreads = 1;
+   }
+   threads = (AnalysisThread **)calloc( nThreads, sizeof( AnalysisThread * ) );
+   assert( threads );
+   for( i = 0; i < nStages; i++ )
+   {
+      stages[ i ].thread = i % nThreads;
+   }
+   for( i = 0; i < nThreads; i++ )
+   {
+      threads[ i ] = safeNew( AnalysisThread( this, NUM_SNAPSHOTS * ( nStages / nThreads + 1 ) ) );
+      threads[ i ]->start();
+   }
+   return 1;
+}
+
+
+// Simulation thread, between iterations.
+void
+AnalysisPipeline::capture( NernstSim *s, int iter )
+{
+   struct snapshotBuf *b = NULL;
+   int i, n = o->x * o->y, due = 0;
+
+   for( i = 0; i < nStages; i++ )
+   {
+      due += ( iter % stages[ i ].every == 0 );
+   }
+   if( !due || !threads )
+   {
+      return;
+   }
+
+   mutex.lock();
+   for( i = 0; i < NUM_SNAPSHOTS && !b; i++ )
+   {
+      if( bufs[ i ].refs == 0 )
+      {
+         b = &bufs[ i ];
+      }
+   }
+   if( !b )
+   {
+      for( i = 0; i < nStages; i++ )
+      {
+         stages[ i ].skipped += ( iter % stages[ i ].every == 0 );
+      }
+      mutex.unlock();
+      return;
+   }
+   mutex.unlock();
+
+   // No stage looks at a buffer until it is queued.
+   for( i = 0; i < n; i++ )
+   {
+      b->colors[ i ] = s->world[ i ].color;
+   }
+   b->snap.iter = iter;
+   b->snap.x = o->x;
+   b->snap.y = o->y;
+   b->snap.colors = b->colors;
+   b->snap.LRcharge = s->LRcharge;
+   memcpy( b->poreFlux, s->poreFlux, 6 * sizeof( unsigned int ) * o->y );
+   b->snap.poreFlux = b->poreFlux;
+   b->snap.mVPerCharge = o->e / ( o->c * o->a * o->y ) * 1000;
+
+   mutex.lock();
+   b->refs = due;
+   for( i = 0; i < nStages; i++ )
+   {
+      if( iter % stages[ i ].every == 0 )
+      {
+         AnalysisThread *t = threads[ stages[ i ].thread ];
+         struct AnalysisThread::job *j = &t->queue[ ( t->head + t->count ) % t->cap ];
+
+         assert( t->count < t->cap );
+         j->stage = i;
+         j->buf = b;
+         t->count++;
+         t->ready.wakeOne();
+      }
+   }
+   mutex.unlock();
+}
+
+
+void
+AnalysisPipeline::finish()
+{
+   int i;
+
+   if( !threads )
+   {
+      return;
+   }
+
+   mutex.lock();
+   done = 1;
+   for( i = 0; i < nThreads; i++ )
+   {
+      threads[ i ]->ready.wakeOne();
+   }
+   mutex.unlock();
+
+   for( i = 0; i < nThreads; i++ )
+   {
+      threads[ i ]->wait();
+      delete threads[ i ];
+   }
+   free( threads );
+   threads = NULL;
+
+   for( i = 0; i < nStages; i++ )
+   {
+      stages[ i ].stage->finish();
+      if( stages[ i ].skipped )
+      {
+         fprintf( stderr, "analysis: %s fell behind and skipped %ld snapshots.\n",
+                  stages[ i ].name, stages[ i ].skipped );
+      }
+   }
+}
+
+
+//===========================================================================
+// AnalysisThread
+//===========================================================================
+
+AnalysisThread::AnalysisThread( AnalysisPipeline *pipeline, int capacity ) :
+   QThread( 0 ), p( pipeline ), cap( capacity ), head( 0 ), count( 0 )
+{
+   queue = (struct job *)malloc( cap * sizeof( struct job ) );
+   assert( queue );
+}
+
+
+AnalysisThread::~AnalysisThread()
+{
+   free( queue );
+}
+
+
+// Until finish(), and then until the queue is empty.
+void
+AnalysisThread::run()
+{
+   struct job j;
+
+   p->mutex.lock();
+   for( ;; )
+   {
+      while( count == 0 && !p->done )
+      {
+         ready.wait( &p->mutex );
+      }
+      if( count == 0 )
+      {
+         break;
+      }
+      j = queue[ head ];
+      head = ( head + 1 ) % cap;
+      count--;
+      p->mutex.unlock();
+
+      p->stages[ j.stage ].stage->analyze( &j.buf->snap );
+
+      p->mutex.lock();
+      j.buf->refs--;
+   }
+   p->mutex.unlock();
+}
@@ -0,0 +1,158 @@
+/* analysis.h
+ *
+ * Periodic analysis of the running simulation (--analysis).
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+class NernstSim;
+class AnalysisThread;
+
+// What an analysis stage is shown: the world and the simulation's
+// counters as they stood after iteration iter.  Stages may not keep the
+// pointer past analyze().
+struct snapshot
+{
+   int iter;
+   int x, y;
+   const unsigned char *colors;   // x * y squares, row major: ATOM_K etc.
+   int LRcharge;                  // as NernstSim::LRcharge
+   const unsigned int *poreFlux;  // y * 6 crossings so far, as NernstSim::poreFlux
+   double mVPerCharge;            // membrane potential per unit of LRcharge
+};
+
+// One kind of analysis.  A stage sees every snapshot taken for it, in
+// order, always on the same analysis thread, so it needs no locking of
+// its own; different stages may run at the same time as each other and
+// as the simulation.
+class AnalysisStage
+{
+   public:
+      virtual ~AnalysisStage() {}
+      virtual void analyze( const struct snapshot *snap ) = 0;
+      virtual void finish() {}      // after the last snapshot
+};
+
+// Makes a stage that writes to file, or returns NULL after saying why not.
+typedef AnalysisStage *(*analysisFactory)( struct options *o, const char *file );
+
+// Make NAME usable in --analysis=NAME:EVERY.  Stages of one's own can be
+// registered this way from any file, before the simulation starts, with
+// no change to the simulation itself; census, profile, columns, flux,
+// current and channels are built in.  Returns 0 if the name is taken or the table is full.
+int registerAnalysisStage( const char *name, analysisFactory make );
+
+// Runs the stages named by --analysis on --analysis-threads threads of
+// their own.  capture() copies what the stages due at this iteration need
+// into a free snapshot buffer and queues it for them; the simulation
+// never waits for the stages.  If they fall so far behind that no buffer
+// is free, the snapshot is skipped, and finish() says how many were.
+class AnalysisPipeline
+{
+   friend class AnalysisThread;
+
+   public:
+      AnalysisPipeline( struct options *o );
+      ~AnalysisPipeline();
+
+      // Set up the stages in o->analysis, "census:64,flux:16" say, and
+      // start the threads.  0 on failure.
+      int open();
+
+      // A stage that is not in the registry, every every iterations.
+      // Before open().
+      void add( AnalysisStage *stage, const char *name, int every );
+
+      // Iterations between captures that some stage wants, so that the
+      // blocked engine can stop there.
+      int period() { return gcd; }
+
+      void capture( NernstSim *s, int iter );   // from the simulation
+      void finish();                            // wait for the stages
+
+   private:
+      enum
+      {
+         MAX_STAGES    = 16,
+         NUM_SNAPSHOTS = 4
+      };
+
+      struct stageEntry
+      {
+         AnalysisStage *stage;
+         char name[ 32 ];
+         int every;
+         int thread;
+         long skipped;
+      };
+
+      struct snapshotBuf
+      {
+         struct snapshot snap;
+         unsigned char *colors;
+         unsigned int *poreFlux;
+         int refs;                // stages still to see it; free when 0
+      };
+
+      struct options *o;
+      struct stageEntry stages[ MAX_STAGES ];
+      int nStages;
+      int gcd;
+      struct snapshotBuf bufs[ NUM_SNAPSHOTS ];
+      AnalysisThread **threads;
+      int nThreads;
+      int done;
+
+      QMutex mutex;               // guards refs, the queues and done
+};
+
+// Works through the stages' queued snapshots for AnalysisPipeline.
+class AnalysisThread : public QThread
+{
+   friend class AnalysisPipeline;
+
+   public:
+      AnalysisThread( AnalysisPipeline *p, int cap );
+      ~AnalysisThread();
+
+   protected:
+      virtual void run();
+
+   private:
+      struct job
+      {
+         int stage;
+         AnalysisPipeline::snapshotBuf *buf;
+      };
+
+      AnalysisPipeline *p;
+      struct job *queue;
+      int cap, head, count;
+      QWaitCondition ready;
+};
+
+#endif /* ANALYSIS_H */
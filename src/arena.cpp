@@ -0,0 +1,187 @@
+/* arena.cpp
+ *
+ * Huge-page backed memory for the lattice buffers.  See arena.h.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef BLR_USELINUX
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     // for MAP_ANONYMOUS, MAP_HUGETLB, MADV_HUGEPAGE
+#endif
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "arena.h"
+
+
+Arena::Arena( size_t bytes, int hugePages )
+{
+   size_t huge = ( bytes + HUGE_PAGE - 1 ) / HUGE_PAGE * HUGE_PAGE;
+
+   mapped = NULL;
+   kind = ARENA_HEAP;
+
+#ifdef BLR_USELINUX
+   void *p;
+
+   if( hugePages && bytes >= HUGE_PAGE )
+   {
+      p = mmap( NULL, huge, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+      if( p != MAP_FAILED )
+      {
+         mapped = p;
+         mappedSz = huge;
+         base = (char *)p;
+         kind = ARENA_HUGETLB;
+      } else {
+         // Map a huge page more than needed so the arena can start on a
+         // huge page boundary; otherwise its ends are ordinary pages.
+         p = mmap( NULL, huge + HUGE_PAGE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+         if( p != MAP_FAILED )
+         {
+            mapped = p;
+            mappedSz = huge + HUGE_PAGE;
+            base = (char *)( ( (unsigned long)p + HUGE_PAGE - 1 ) / HUGE_PAGE * HUGE_PAGE );
+            madvise( base, huge, MADV_HUGEPAGE );
+            kind = ARENA_THP;
+         }
+      }
+   }
+#else
+   hugePages = hugePages;
+   huge = huge;
+#endif
+
+   if( kind == ARENA_HEAP )
+   {
+      mapped = malloc( bytes + ALIGN );
+      assert( mapped );
+      mappedSz = bytes + ALIGN;
+      base = (char *)mapped + ALIGN - (unsigned long)mapped % ALIGN;
+      memset( base, 0, bytes );
+   } else {
+      // Fault it all in now; fresh anonymous memory is already zero.
+      for( size_t i = 0; i < bytes; i += 4096 )
+      {
+         base[ i ] = 0;
+      }
+   }
+
+   size = bytes;
+   used = 0;
+}
+
+
+Arena::~Arena()
+{
+#ifdef BLR_USELINUX
+   if( kind != ARENA_HEAP )
+   {
+      munmap( mapped, mappedSz );
+      return;
+   }
+#endif
+   free( mapped );
+}
+
+
+size_t
+Arena::need( size_t bytes )
+{
+   return ( bytes + ALIGN - 1 ) / ALIGN * ALIGN;
+}
+
+
+void *
+Arena::take( size_t bytes )
+{
+   char *p = base + used;
+
+   used += need( bytes );
+   assert( used <= size );
+   return p;
+}
+
+
+// Only what was handed out can be dirty.
+void
+Arena::reset()
+{
+   memset( base, 0, used );
+   used = 0;
+}
+
+
+void
+Arena::describe( char *buf, int sz )
+{
+   switch( kind )
+   {
+      case ARENA_HUGETLB:
+         snprintf( buf, sz, "%lu kB on %d kB pages (explicit)",
+                   (unsigned long)( mappedSz >> 10 ), HUGE_PAGE >> 10 );
+         return;
+      case ARENA_THP:
+         break;
+      default:
+#ifdef BLR_USELINUX
+         snprintf( buf, sz, "%lu kB on %d kB pages", (unsigned long)( size >> 10 ),
+                   getpagesize() >> 10 );
+#else
+         snprintf( buf, sz, "%lu kB on ordinary pages", (unsigned long)( size >> 10 ) );
+#endif
+         return;
+   }
+
+#ifdef BLR_USELINUX
+   // The kernel may have found huge pages for all, some or none of a
+   // transparent mapping; /proc/self/smaps says how much.
+   char line[ 256 ];
+   unsigned long lo, hi, kB, hugeKB = 0;
+   int inside = 0;
+   FILE *fp;
+
+   if( ( fp = fopen( "/proc/self/smaps", "r" ) ) != NULL )
+   {
+      while( fgets( line, sizeof( line ), fp ) )
+      {
+         // Each mapping's "lo-hi perms ..." line, then its "Key: value" lines.
+         if( sscanf( line, "%lx-%lx ", &lo, &hi ) == 2 )
+         {
+            inside = ( lo <= (unsigned long)base && (unsigned long)base < hi );
+         } else if( inside && sscanf( line, "AnonHugePages: %lu kB", &kB ) == 1 ) {
+            hugeKB += kB;
+         }
+      }
+      fclose( fp );
+   }
+   snprintf( buf, sz, "%lu of %lu kB mapped on %d kB pages (transparent), the rest on %d kB pages",
+             hugeKB, (unsigned long)( mappedSz >> 10 ), HUGE_PAGE >> 10, getpagesize() >> 10 );
+#endif
+}
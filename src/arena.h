@@ -0,0 +1,89 @@
+/* arena.h
+ *
+ * Huge-page backed memory for the lattice buffers.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// One block of zeroed memory that the buffers a simulation sweeps every
+// iteration are carved from, so that they sit on as few pages as possible.
+// A 2048x2048 world's world, claimed and direction arrays span some 6000
+// 4 KB pages, more than the TLB holds, and every phase walks all of them;
+// on 2 MB pages they take a handful.
+//
+// Blocks of at least HUGE_PAGE bytes are asked for, in order:
+//
+//    explicit huge pages (Linux MAP_HUGETLB), if any are reserved in
+//       /proc/sys/vm/nr_hugepages;
+//    transparent huge pages (Linux madvise( MADV_HUGEPAGE )), which the
+//       kernel hands out if it can find them;
+//    ordinary pages from the heap.
+//
+// Smaller blocks, and every block on other systems or with
+// --no-huge-pages, come from the heap.  The memory is touched up front so
+// that describe() can report what the kernel actually provided.
+class Arena
+{
+   public:
+      Arena( size_t bytes, int hugePages );
+      ~Arena();
+
+      // The next bytes of the arena, zeroed and aligned to ALIGN.  The
+      // arena must have been made big enough; see need().
+      void *take( size_t bytes );
+
+      // How big an arena must be for take( bytes ).
+      static size_t need( size_t bytes );
+
+      // Hand the memory out again from the start, zeroed, so that a
+      // simulation reset to a world no bigger can keep its arena.
+      size_t capacity() { return size; }
+      void reset();
+
+      // Which pages back the arena: "8192 kB on 2048 kB pages (explicit)".
+      void describe( char *buf, int sz );
+
+      enum
+      {
+         ALIGN     = 64,          // a cache line, and enough for SFMT
+         HUGE_PAGE = 2 << 20
+      };
+
+   private:
+      enum
+      {
+         ARENA_HEAP,
+         ARENA_HUGETLB,
+         ARENA_THP
+      };
+
+      char *base;                 // ALIGN aligned
+      size_t size, used;
+      int kind;
+      void *mapped;               // what to give back: mmap()ed or malloc()ed
+      size_t mappedSz;
+};
+
+#endif /* ARENA_H */
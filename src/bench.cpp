@@ -0,0 +1,762 @@
+/* bench.cpp
+ *
+ * Built-in benchmark: runs the simulation over a matrix of world sizes,
+ * ion densities, thread counts and engines and reports throughput.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QThread>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <assert.h>
+#ifndef BLR_USEWIN
+#include <unistd.h>
+#endif
+
+#include "bench.h"
+#include "main.h"
+#include "options.h"
+#include "sim.h"
+#include "timing.h"
+#include "safecalls.h"
+using namespace SafeCalls;
+
+
+// The matrix.  Densities scale all of the configured concentrations.
+static const int    benchSizes[]     = { 256, 512, 1024 };
+static const double benchDensities[] = { 0.5, 1.0, 2.0 };
+
+// Engine variants are selected by adjusting the options.
+struct benchEngine
+{
+   const char *name;
+   void (*select)( struct options *o );
+   int threaded;        // uses --threads; if not, only timed with one
+};
+
+static void
+selectClaimEngine( struct options *o )
+{
+   o->engine = ENGINE_CLAIM;
+   o->atomic_claims = 0;
+}
+
+
+static void
+selectAtomicEngine( struct options *o )
+{
+   o->engine = ENGINE_CLAIM;
+   o->atomic_claims = 1;
+}
+
+
+static void
+selectBlockedEngine( struct options *o )
+{
+   o->engine = ENGINE_BLOCKED;
+}
+
+
+static void
+selectSublatticeEngine( struct options *o )
+{
+   o->engine = ENGINE_SUBLATTICE;
+}
+
+static const struct benchEngine benchEngines[] =
+{
+   { "claim",      selectClaimEngine,      1 },
+   { "atomic",     selectAtomicEngine,     1 },
+   { "blocked",    selectBlockedEngine,    1 },
+   { "sublattice", selectSublatticeEngine, 0 },
+};
+
+#define NELEMS( a ) ( (int)( sizeof( a ) / sizeof( (a)[ 0 ] ) ) )
+
+// Returns 0 if there is no engine by that name.
+static int
+selectEngine( struct options *o, const char *name )
+{
+   int i;
+
+   for( i = 0; i < NELEMS( benchEngines ); i++ )
+   {
+      if( !strcmp( benchEngines[ i ].name, name ) )
+      {
+         benchEngines[ i ].select( o );
+         return 1;
+      }
+   }
+   return 0;
+}
+
+// Every run made here is for timing or checking alone: no GUI, no
+// progress or profiling, and none of the files or caches a run can
+// write.  An option that makes a run write something belongs here.
+static void
+scrubOptions( struct options *o )
+{
+   o->use_gui = o->progress = o->profiling = o->output_file = 0;
+   o->trajectory_file = NULL;
+   o->frame_every = 0;
+   o->analysis = NULL;
+   o->pore_summary = NULL;
+   o->state_cache = NULL;
+   o->checkpoint = NULL;
+   o->resume = NULL;
+}
+
+// A case is a regression only if it slowed down by more than this fraction
+// and by more than twice the combined run-to-run noise.
+static const double regressionThreshold = 0.05;
+
+// --validate fails an engine whose mean equilibrium potential is further
+// than this many standard errors from the claim engine's.  The potential
+// is sampled every validateStride iterations.
+static const double validateThreshold = 3.0;
+static const int    validateStride    = 16;
+
+// --autotune times each candidate tuneRepeats times for tuneIters
+// iterations and keeps its best time.  Only engines that give exactly the
+// claim engine's results are candidates, so tuning never changes a run's
+// output, only how long it takes.
+static const int    tuneIters        = 64;
+static const int    tuneRepeats      = 3;
+static const int    tuneBlockSteps[] = { 2, 4, 8 };
+static const char  *tuneEngines[]    = { "claim", "atomic", "blocked" };
+
+struct benchCase
+{
+   char name[ 128 ];
+   int x, y, threads;
+   const char *engine;
+   double scale;
+   long ions;
+   double cellsMedian, cellsStddev;
+   double updatesMedian, updatesStddev;   // ion update attempts, moved or not
+   double baseMedian, baseStddev;   // from the baseline file, or 0
+   int regression;
+};
+
+
+static int
+compareDoubles( const void *a, const void *b )
+{
+   double da = *(const double *)a, db = *(const double *)b;
+   return ( da > db ) - ( da < db );
+}
+
+
+static void
+summarize( double *samples, int n, double *median, double *stddev )
+{
+   double mean = 0, var = 0;
+   int i;
+
+   qsort( samples, n, sizeof( double ), compareDoubles );
+   if( n % 2 )
+   {
+      *median = samples[ n / 2 ];
+   } else {
+      *median = ( samples[ n / 2 - 1 ] + samples[ n / 2 ] ) / 2.0;
+   }
+
+   for( i = 0; i < n; i++ )
+   {
+      mean += samples[ i ];
+   }
+   mean /= n;
+   for( i = 0; i < n; i++ )
+   {
+      var += ( samples[ i ] - mean ) * ( samples[ i ] - mean );
+   }
+   *stddev = ( n > 1 ) ? sqrt( var / ( n - 1 ) ) : 0.0;
+}
+
+
+// One complete run.  Only the stepping loop is timed; returns seconds.
+static double
+timedRun( struct options *o, long *ions )
+{
+   NernstSim *s = safeNew( NernstSim( o ) );
+   uint64_t start, stop;
+
+   s->initNernstSim();
+   *ions = o->max_atoms;   // initAtoms() leaves the number placed here
+
+   start = nowNsec();
+   if( o->threads > 1 && o->engine == ENGINE_CLAIM )
+   {
+      runWorkers( s, o );
+   } else {
+      s->stepSim();
+   }
+   stop = nowNsec();
+
+   delete s;
+   return ( stop - start ) * 1.0e-9;
+}
+
+
+static void
+runCase( struct options *base, struct benchCase *c )
+{
+   struct options o = *base;
+   double *cells = (double *)malloc( sizeof( double ) * base->bench_repeats );
+   double *updates = (double *)malloc( sizeof( double ) * base->bench_repeats );
+   double seconds;
+   int i;
+
+   o.x = c->x;
+   o.y = c->y;
+   o.threads = c->threads;
+   o.iters = base->bench_iters;
+   o.lK  = (int)( base->lK  * c->scale + 0.5 );
+   o.lNa = (int)( base->lNa * c->scale + 0.5 );
+   o.lCl = (int)( base->lCl * c->scale + 0.5 );
+   o.rK  = (int)( base->rK  * c->scale + 0.5 );
+   o.rNa = (int)( base->rNa * c->scale + 0.5 );
+   o.rCl = (int)( base->rCl * c->scale + 0.5 );
+   scrubOptions( &o );
+   selectEngine( &o, c->engine );
+
+   // Warm-up.
+   o.max_atoms = base->max_atoms;
+   timedRun( &o, &c->ions );
+
+   for( i = 0; i < base->bench_repeats; i++ )
+   {
+      o.max_atoms = base->max_atoms;
+      seconds = timedRun( &o, &c->ions );
+      cells[ i ] = (double)o.x * (double)o.y * o.iters / seconds;
+      updates[ i ] = (double)c->ions * o.iters / seconds;
+      if( base->verbose )
+      {
+         fprintf( stderr, "   %s run %d: %f s\n", c->name, i, seconds );
+      }
+   }
+
+   summarize( cells, base->bench_repeats, &c->cellsMedian, &c->cellsStddev );
+   summarize( updates, base->bench_repeats, &c->updatesMedian, &c->updatesStddev );
+
+   free( cells );
+   free( updates );
+}
+
+
+// Pick up cells_per_sec_median/stddev for this case from a results file
+// written by writeResults().  Each case is on its own line.
+static int
+findBaseline( FILE *fp, struct benchCase *c )
+{
+   char line[ 1024 ], key[ 160 ];
+   char *p;
+
+   snprintf( key, sizeof( key ), "\"name\": \"%s\"", c->name );
+   rewind( fp );
+   while( fgets( line, sizeof( line ), fp ) )
+   {
+      if( !strstr( line, key ) )
+      {
+         continue;
+      }
+      if( ( p = strstr( line, "\"cells_per_sec_median\":" ) ) == NULL ||
+          sscanf( p, "\"cells_per_sec_median\": %lf", &c->baseMedian ) != 1 )
+      {
+         return 0;
+      }
+      if( ( p = strstr( line, "\"cells_per_sec_stddev\":" ) ) == NULL ||
+          sscanf( p, "\"cells_per_sec_stddev\": %lf", &c->baseStddev ) != 1 )
+      {
+         c->baseStddev = 0;
+      }
+      return 1;
+   }
+   return 0;
+}
+
+
+static void
+compareBaseline( struct benchCase *c )
+{
+   double drop, noise;
+
+   drop  = 1.0 - c->cellsMedian / c->baseMedian;
+   noise = 2.0 * sqrt( pow( c->cellsStddev / c->cellsMedian, 2 ) +
+                       pow( c->baseStddev  / c->baseMedian,  2 ) );
+   c->regression = ( drop > regressionThreshold && drop > noise );
+}
+
+
+static void
+writeResults( struct options *o, struct benchCase *cases, int n )
+{
+   FILE *fp = fopen( o->bench_file, "w" );
+   int i;
+
+   if( !fp )
+   {
+      perror( o->bench_file );
+      return;
+   }
+
+   fprintf( fp, "{\n" );
+   fprintf( fp, "  \"nernst_bench\": 1,\n" );
+   fprintf( fp, "  \"iters\": %d,\n", o->bench_iters );
+   fprintf( fp, "  \"repeats\": %d,\n", o->bench_repeats );
+   fprintf( fp, "  \"seed\": %d,\n", o->randseed );
+   fprintf( fp, "  \"cases\": [\n" );
+   for( i = 0; i < n; i++ )
+   {
+      struct benchCase *c = &cases[ i ];
+      fprintf( fp, "    { \"name\": \"%s\", \"x\": %d, \"y\": %d, \"threads\": %d, "
+                   "\"engine\": \"%s\", \"density\": %g, \"ions\": %ld, "
+                   "\"cells_per_sec_median\": %.6e, \"cells_per_sec_stddev\": %.6e, "
+                   "\"cells_per_sec_variance\": %.6e, "
+                   "\"ion_updates_per_sec_median\": %.6e, \"ion_updates_per_sec_stddev\": %.6e, "
+                   "\"ion_updates_per_sec_variance\": %.6e",
+               c->name, c->x, c->y, c->threads, c->engine,
+               (double)c->ions / ( (double)c->x * c->y ), c->ions,
+               c->cellsMedian, c->cellsStddev, c->cellsStddev * c->cellsStddev,
+               c->updatesMedian, c->updatesStddev, c->updatesStddev * c->updatesStddev );
+      if( c->baseMedian > 0 )
+      {
+         fprintf( fp, ", \"baseline_cells_per_sec_median\": %.6e, \"regression\": %s",
+                  c->baseMedian, c->regression ? "true" : "false" );
+      }
+      fprintf( fp, " }%s\n", ( i < n - 1 ) ? "," : "" );
+   }
+   fprintf( fp, "  ]\n" );
+   fprintf( fp, "}\n" );
+   fclose( fp );
+}
+
+
+int
+runBenchmark( struct options *o )
+{
+   struct benchCase *cases;
+   FILE *baseline = NULL;
+   int maxThreads, threads, n = 0, total, regressions = 0;
+   int si, di, ei;
+
+   if( o->bench_repeats < 1 || o->bench_iters < 1 )
+   {
+      fprintf( stderr, "--bench-repeats and --bench-iters must be positive.\n" );
+      return 1;
+   }
+
+   if( o->bench_baseline )
+   {
+      baseline = fopen( o->bench_baseline, "r" );
+      if( !baseline )
+      {
+         perror( o->bench_baseline );
+         return 1;
+      }
+   }
+
+   maxThreads = ( o->threads > 1 ) ? o->threads : QThread::idealThreadCount();
+   for( total = 0, threads = 1; threads <= maxThreads; threads *= 2 )
+   {
+      total++;
+   }
+   total *= NELEMS( benchSizes ) * NELEMS( benchDensities ) * NELEMS( benchEngines );
+   cases = (struct benchCase *)calloc( total, sizeof( struct benchCase ) );
+
+   printf( "%-32s %14s %10s %14s %10s\n", "case", "cells/sec", "+/-", "ion-updates/sec", "+/-" );
+   for( si = 0; si < NELEMS( benchSizes ); si++ )
+   {
+      for( di = 0; di < NELEMS( benchDensities ); di++ )
+      {
+         for( threads = 1; threads <= maxThreads; threads *= 2 )
+         {
+            for( ei = 0; ei < NELEMS( benchEngines ); ei++ )
+            {
+               struct benchCase *c;
+
+               if( threads > 1 && !benchEngines[ ei ].threaded )
+               {
+                  continue;
+               }
+               c = &cases[ n++ ];
+
+               c->x = c->y = benchSizes[ si ];
+               c->scale = benchDensities[ di ];
+               c->threads = threads;
+               c->engine = benchEngines[ ei ].name;
+               snprintf( c->name, sizeof( c->name ), "%dx%d_d%.2f_t%d_%s",
+                         c->x, c->y, c->scale, c->threads, c->engine );
+
+               runCase( o, c );
+
+               printf( "%-32s %14.4e %10.2e %14.4e %10.2e", c->name,
+                       c->cellsMedian, c->cellsStddev, c->updatesMedian, c->updatesStddev );
+               if( baseline && findBaseline( baseline, c ) )
+               {
+                  compareBaseline( c );
+                  printf( "  %+6.1f%%%s", 100.0 * ( c->cellsMedian / c->baseMedian - 1.0 ),
+                          c->regression ? "  REGRESSION" : "" );
+                  regressions += c->regression;
+               }
+               printf( "\n" );
+               fflush( stdout );
+            }
+         }
+      }
+   }
+
+   writeResults( o, cases, n );
+   if( baseline )
+   {
+      fclose( baseline );
+      printf( "%d of %d cases regressed against %s.\n", regressions, n, o->bench_baseline );
+   }
+
+   free( cases );
+   return regressions ? 1 : 0;
+}
+
+
+// Mean membrane potential (mV) over the second half of one run.
+static double
+equilibriumPotential( struct options *o )
+{
+   NernstSim *s = safeNew( NernstSim( o ) );
+   int iters = o->iters, n = 0;
+   double sum = 0;
+
+   s->initNernstSim();
+   for( o->iters = 0; o->iters < iters; )
+   {
+      o->iters += validateStride;
+      if( o->iters > iters )
+      {
+         o->iters = iters;
+      }
+      if( o->threads > 1 && o->engine == ENGINE_CLAIM )
+      {
+         runWorkers( s, o );
+      } else {
+         s->stepSim();
+      }
+      if( o->iters > iters / 2 )
+      {
+         sum += s->LRcharge;
+         n++;
+      }
+   }
+
+   delete s;
+   return sum / n * o->e / ( o->c * o->a * o->y ) * 1000;
+}
+
+
+int
+runValidation( struct options *base )
+{
+   struct options o;
+   double *v, mean[ NELEMS( benchEngines ) ], stddev[ NELEMS( benchEngines ) ];
+   double se, t;
+   int runs = base->validate_runs, failures = 0;
+   int ei, i;
+
+   if( runs < 2 || base->iters < 2 * validateStride )
+   {
+      fprintf( stderr, "--validate needs --validate-runs >= 2 and --iters >= %d.\n",
+               2 * validateStride );
+      return 1;
+   }
+   v = (double *)malloc( sizeof( double ) * runs );
+   assert( v );
+
+   printf( "%-12s %12s %10s %10s %10s %8s\n", "engine", "vm (mV)", "stddev", "stderr", "diff", "t" );
+   for( ei = 0; ei < NELEMS( benchEngines ); ei++ )
+   {
+      for( i = 0; i < runs; i++ )
+      {
+         o = *base;
+         o.randseed = base->randseed + i;
+         scrubOptions( &o );
+         benchEngines[ ei ].select( &o );
+         if( o.atomic_claims && o.threads < 2 )
+         {
+            o.threads = 2;   // with one thread it is the claim engine
+         }
+         v[ i ] = equilibriumPotential( &o );
+         if( base->verbose )
+         {
+            fprintf( stderr, "   %s run %d: %f mV\n", benchEngines[ ei ].name, i, v[ i ] );
+         }
+      }
+
+      for( i = 0, mean[ ei ] = 0; i < runs; i++ )
+      {
+         mean[ ei ] += v[ i ] / runs;
+      }
+      for( i = 0, stddev[ ei ] = 0; i < runs; i++ )
+      {
+         stddev[ ei ] += ( v[ i ] - mean[ ei ] ) * ( v[ i ] - mean[ ei ] ) / ( runs - 1 );
+      }
+      stddev[ ei ] = sqrt( stddev[ ei ] );
+
+      printf( "%-12s %12.4f %10.4f %10.4f", benchEngines[ ei ].name,
+              mean[ ei ], stddev[ ei ], stddev[ ei ] / sqrt( (double)runs ) );
+      if( ei == 0 )
+      {
+         printf( "\n" );
+         continue;
+      }
+
+      // Welch's t against the claim engine.
+      se = sqrt( ( stddev[ ei ] * stddev[ ei ] + stddev[ 0 ] * stddev[ 0 ] ) / runs );
+      if( se > 0 )
+      {
+         t = ( mean[ ei ] - mean[ 0 ] ) / se;
+      } else {
+         t = ( mean[ ei ] == mean[ 0 ] ) ? 0 : HUGE_VAL;
+      }
+      printf( " %10.4f %8.2f  %s\n", mean[ ei ] - mean[ 0 ], t,
+              fabs( t ) > validateThreshold ? "MISMATCH" : "ok" );
+      failures += ( fabs( t ) > validateThreshold );
+      fflush( stdout );
+   }
+
+   free( v );
+   return failures ? 1 : 0;
+}
+
+
+// Identifies this machine in the tune file: host name, processor model and
+// number of hardware threads, with no white space.
+static void
+machineKey( char *buf, int sz )
+{
+   char host[ 64 ] = "unknown", model[ 128 ] = "unknown", line[ 256 ];
+   char *p;
+   FILE *fp;
+
+#ifdef BLR_USEWIN
+   if( ( p = getenv( "COMPUTERNAME" ) ) != NULL )
+   {
+      snprintf( host, sizeof( host ), "%s", p );
+   }
+#else
+   if( gethostname( host, sizeof( host ) ) != 0 )
+   {
+      strcpy( host, "unknown" );
+   }
+   host[ sizeof( host ) - 1 ] = '\0';
+#endif
+#ifdef BLR_USELINUX
+   if( ( fp = fopen( "/proc/cpuinfo", "r" ) ) != NULL )
+   {
+      while( fgets( line, sizeof( line ), fp ) )
+      {
+         if( !strncmp( line, "model name", 10 ) && ( p = strchr( line, ':' ) ) != NULL )
+         {
+            snprintf( model, sizeof( model ), "%s", p + 2 );
+            for( p = model + strlen( model ); p > model && isspace( (unsigned char)p[ -1 ] ); )
+            {
+               *--p = '\0';
+            }
+            break;
+         }
+      }
+      fclose( fp );
+   }
+#else
+   fp = NULL;
+   line[ 0 ] = '\0';
+#endif
+
+   snprintf( buf, sz, "%s/%s/%d", host, model, QThread::idealThreadCount() );
+   for( p = buf; *p; p++ )
+   {
+      if( isspace( (unsigned char)*p ) )
+      {
+         *p = '_';
+      }
+   }
+}
+
+
+// The start of the tune file line for this machine and world.
+static void
+tuneKey( struct options *o, char *buf, int sz )
+{
+   char machine[ 256 ];
+
+   machineKey( machine, sizeof( machine ) );
+   snprintf( buf, sz, "machine=%s world=%dx%d ions=%d,%d,%d,%d,%d,%d max_atoms=%ld",
+             machine, o->x, o->y, o->lK, o->lNa, o->lCl, o->rK, o->rNa, o->rCl,
+             o->max_atoms );
+}
+
+
+// Look up an earlier decision; the last line for key wins.  Returns 0 if
+// there is none.
+static int
+readTuning( struct options *o, const char *key, int *threads, char *engine, int *steps )
+{
+   char line[ 1024 ];
+   int len = strlen( key ), found = 0, t, b;
+   char e[ 16 ];
+   FILE *fp;
+
+   if( ( fp = fopen( o->tune_file, "r" ) ) == NULL )
+   {
+      return 0;
+   }
+   while( fgets( line, sizeof( line ), fp ) )
+   {
+      if( strncmp( line, key, len ) || line[ len ] != ' ' )
+      {
+         continue;
+      }
+      if( sscanf( line + len, " threads=%d engine=%15s block_steps=%d", &t, e, &b ) == 3 &&
+          t >= 1 && b >= 1 )
+      {
+         *threads = t;
+         *steps = b;
+         strcpy( engine, e );
+         found = 1;
+      }
+   }
+   fclose( fp );
+   return found;
+}
+
+
+// Best time of tuneRepeats short runs of o.
+static double
+tuneRun( struct options *o )
+{
+   double best = HUGE_VAL, seconds;
+   long ions;
+   int i;
+
+   for( i = 0; i < tuneRepeats; i++ )
+   {
+      struct options copy = *o;
+      seconds = timedRun( &copy, &ions );
+      if( seconds < best )
+      {
+         best = seconds;
+      }
+   }
+   return best;
+}
+
+
+void
+autotune( struct options *base )
+{
+   char key[ 512 ], engine[ 16 ], bestEngine[ 16 ];
+   struct options o;
+   int maxThreads, threads, bestThreads = 1, steps, bestSteps = base->block_steps;
+   int ei, bi, nSteps;
+   double rate, bestRate = 0;
+   FILE *fp;
+
+   tuneKey( base, key, sizeof( key ) );
+   if( readTuning( base, key, &threads, engine, &steps ) )
+   {
+      o = *base;
+      if( selectEngine( &o, engine ) )
+      {
+         base->threads = threads;
+         base->block_steps = steps;
+         selectEngine( base, engine );
+         fprintf( stderr, "autotune: %d thread%s, engine %s%s, block steps %d (from %s)\n",
+                  threads, threads > 1 ? "s" : "", engine,
+                  base->atomic_claims ? " with atomic claims" : "", steps, base->tune_file );
+         return;
+      }
+   }
+
+   fprintf( stderr, "autotune: timing %d-iteration bursts...\n", tuneIters );
+   strcpy( bestEngine, "claim" );
+   maxThreads = QThread::idealThreadCount();
+   for( threads = 1; threads <= maxThreads; threads *= 2 )
+   {
+      for( ei = 0; ei < NELEMS( tuneEngines ); ei++ )
+      {
+         // With one thread the atomic engine is the claim engine.
+         if( threads == 1 && !strcmp( tuneEngines[ ei ], "atomic" ) )
+         {
+            continue;
+         }
+         nSteps = strcmp( tuneEngines[ ei ], "blocked" ) ? 1 : NELEMS( tuneBlockSteps );
+         for( bi = 0; bi < nSteps; bi++ )
+         {
+            o = *base;
+            o.threads = threads;
+            o.iters = tuneIters;
+            if( nSteps > 1 )
+            {
+               o.block_steps = tuneBlockSteps[ bi ];
+            }
+            scrubOptions( &o );
+            o.verbose = 0;
+            selectEngine( &o, tuneEngines[ ei ] );
+
+            rate = (double)o.x * o.y * o.iters / tuneRun( &o );
+            if( base->verbose )
+            {
+               fprintf( stderr, "   t%d %s", threads, tuneEngines[ ei ] );
+               if( nSteps > 1 )
+               {
+                  fprintf( stderr, " block steps %d", o.block_steps );
+               }
+               fprintf( stderr, ": %.4e cells/sec\n", rate );
+            }
+            if( rate > bestRate )
+            {
+               bestRate = rate;
+               bestThreads = threads;
+               bestSteps = o.block_steps;
+               strcpy( bestEngine, tuneEngines[ ei ] );
+            }
+         }
+      }
+   }
+
+   base->threads = bestThreads;
+   base->block_steps = bestSteps;
+   selectEngine( base, bestEngine );
+   fprintf( stderr, "autotune: %d thread%s, engine %s%s, block steps %d, %.4e cells/sec\n",
+            bestThreads, bestThreads > 1 ? "s" : "", bestEngine,
+            base->atomic_claims ? " with atomic claims" : "", bestSteps, bestRate );
+
+   if( ( fp = fopen( base->tune_file, "a" ) ) == NULL )
+   {
+      perror( base->tune_file );
+      return;
+   }
+   fprintf( fp, "%s threads=%d engine=%s block_steps=%d cells_per_sec=%.4e\n",
+            key, bestThreads, bestEngine, bestSteps, bestRate );
+   fclose( fp );
+}
@@ -0,0 +1,43 @@
+/* bench.h
+ *
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+struct options;
+
+// Run the benchmark matrix described by o (see --bench in options.cpp).
+// Returns the process exit status: 0, or 1 if a regression against
+// o->bench_baseline was found.
+int runBenchmark( struct options *o );
+
+// Compare every engine's equilibrium membrane potential against the claim
+// engine's (see --validate).  Returns 0, or 1 if any differ significantly.
+int runValidation( struct options *o );
+
+// Set o->threads, o->engine, o->block_steps and o->atomic_claims to the
+// fastest combination for this world on this machine, timing short runs
+// unless o->tune_file already has the answer (see --autotune).
+void autotune( struct options *o );
+
+#endif /* BENCH_H */
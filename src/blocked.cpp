@@ -0,0 +1,529 @@
+/* blocked.cpp
+ *
+ * Temporally blocked stepping engine.  See blocked.h.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <SFMT.h>
+
+#include "blocked.h"
+#include "options.h"
+#include "sim.h"
+#include "affinity.h"
+#include "arena.h"
+#include "safecalls.h"
+using namespace SafeCalls;
+
+
+// Same order as NernstSim::moveAtoms_move().
+static const int dir2dx[] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+static const int dir2dy[] = { -1, 1, 0, 0, -1, -1, 1, 1 };
+
+
+static inline int
+isAtomColor( unsigned int c )
+{
+   return ( c == ATOM_K || c == ATOM_Na || c == ATOM_Cl );
+}
+
+
+static inline int
+isPoreColor( unsigned int c )
+{
+   return ( c == PORE_K || c == PORE_Na || c == PORE_Cl );
+}
+
+
+// As NernstSim::isPermeable(), by color.
+static inline int
+permeable( unsigned int pore, unsigned int ion, int selectivity )
+{
+   return ( !selectivity ||
+            ( pore == PORE_K  && ion == ATOM_K  ) ||
+            ( pore == PORE_Na && ion == ATOM_Na ) ||
+            ( pore == PORE_Cl && ion == ATOM_Cl ) );
+}
+
+
+// As WorkerThread::run(), so --affinity -v reads the same for every engine.
+static void
+pinWorker( const struct options *o, int id, int cpu )
+{
+   int pinned = pinThread( cpu );
+   if( o->verbose )
+   {
+      char where[ 128 ];
+      describeCpu( cpu, where, sizeof( where ) );
+      fprintf( stderr, "worker %d: %s%s\n", id, where,
+               pinned ? "" : " (could not pin)" );
+   }
+}
+
+
+// As NernstSim::copyAtom(), within a scratch area.  The tracked registry
+// is brought up to date when the tile is written back.
+static inline void
+moveCell( struct atom *from, struct atom *to, int dx, int dy )
+{
+   to->delta_x = from->delta_x + dx;
+   to->delta_y = from->delta_y + dy;
+   to->color   = from->color;
+   to->tracked = from->tracked;
+   to->id      = from->id;
+
+   from->delta_x = SOLVENT;
+   from->delta_y = SOLVENT;
+   from->color   = SOLVENT;
+   from->tracked = 0;
+}
+
+
+BlockedEngine::BlockedEngine( NernstSim *sim )
+{
+   int m, bx0, bx1, i, sz, maxSz = 0;
+
+   s = sim;
+   o = sim->o;
+   steps = o->block_steps;
+   halo = 2 * steps;
+   assert( steps >= 1 );
+
+   // initWorld() made room for a second world when --engine=blocked.
+   next = s->worldNext;
+   census = (int (*)[ 7 ])calloc( steps, sizeof( *census ) );
+   assert( next && census );
+
+   // The band, then the bulk to either side of it.
+   tiles = (struct tile *)calloc( ( o->x / TILE_W + 3 ) * ( o->y / TILE_H + 1 ), sizeof( struct tile ) );
+   assert( tiles );
+   nTiles = 0;
+   m = o->x / 2;
+   bx0 = ( m - halo + 1 > 0 ) ? m - halo + 1 : 0;
+   bx1 = ( m + halo < o->x ) ? m + halo : o->x;
+   addTile( bx0, bx1, 0, o->y, 1 );
+   addTiles( 0, bx0 );
+   addTiles( bx1, o->x );
+
+   // No more threads than tiles.
+   nThreads = ( o->threads < nTiles ) ? o->threads : nTiles;
+   if( nThreads < 1 )
+   {
+      nThreads = 1;
+   }
+
+   for( i = 0; i < nTiles; i++ )
+   {
+      sz = ( tiles[ i ].sx1 - tiles[ i ].sx0 ) * tiles[ i ].sh;
+      if( sz > maxSz )
+      {
+         maxSz = sz;
+      }
+   }
+
+   // Direction planes, one per iteration of a block, and the scratch
+   // areas, from an arena like the world's.
+   planeSz = s->direction_sz64;
+   arena = safeNew( Arena( Arena::need( planeSz ) * steps +
+                           ( Arena::need( sizeof( struct atom ) * maxSz ) +
+                             Arena::need( maxSz ) ) * nThreads,
+                           o->huge_pages ) );
+   planes = (unsigned char *)arena->take( planeSz * steps );
+   scratch = (struct scratch *)calloc( nThreads, sizeof( struct scratch ) );
+   assert( scratch );
+   for( i = 0; i < nThreads; i++ )
+   {
+      scratch[ i ].cells   = (struct atom *)arena->take( sizeof( struct atom ) * maxSz );
+      scratch[ i ].claimed = (unsigned char *)arena->take( maxSz );
+   }
+
+   // Thread 0 is the caller's, and is pinned along with the others.
+   cpus = NULL;
+   if( o->affinity )
+   {
+      cpus = (int *)malloc( sizeof( int ) * nThreads );
+      assert( cpus );
+      planAffinity( o->affinity, nThreads, cpus );
+      if( cpus[ 0 ] >= 0 )
+      {
+         pinWorker( o, 0, cpus[ 0 ] );
+      }
+   }
+
+   workers = (BlockedWorker **)calloc( nThreads, sizeof( BlockedWorker * ) );
+   assert( workers );
+   for( i = 1; i < nThreads; i++ )
+   {
+      workers[ i ] = safeNew( BlockedWorker( this, i ) );
+      workers[ i ]->cpu = cpus ? cpus[ i ] : -1;
+      workers[ i ]->start();
+   }
+}
+
+
+BlockedEngine::~BlockedEngine()
+{
+   int i;
+
+   for( i = 1; i < nThreads; i++ )
+   {
+      workers[ i ]->quit = 1;
+      workers[ i ]->go.release();
+      workers[ i ]->wait();
+      delete workers[ i ];
+   }
+   free( workers );
+   free( cpus );
+   free( scratch );
+   free( tiles );
+   free( census );
+   delete arena;
+}
+
+
+// Cover core columns [x0, x1) with bulk tiles.
+void
+BlockedEngine::addTiles( int x0, int x1 )
+{
+   int cx, cy, cx1;
+
+   for( cx = x0; cx < x1; cx += TILE_W )
+   {
+      cx1 = ( cx + TILE_W < x1 ) ? cx + TILE_W : x1;
+      if( TILE_H + 2 * halo >= o->y )
+      {
+         addTile( cx, cx1, 0, o->y, 0 );
+      } else {
+         for( cy = 0; cy < o->y; cy += TILE_H )
+         {
+            addTile( cx, cx1, cy, ( cy + TILE_H < o->y ) ? TILE_H : o->y - cy, 0 );
+         }
+      }
+   }
+}
+
+
+void
+BlockedEngine::addTile( int cx0, int cx1, int cy0, int ch, int band )
+{
+   struct tile *t = &tiles[ nTiles++ ];
+
+   t->cx0  = cx0;
+   t->cx1  = cx1;
+   t->cy0  = cy0;
+   t->ch   = ch;
+   t->band = band;
+   t->sx0  = ( cx0 - halo > 0 ) ? cx0 - halo : 0;
+   t->sx1  = ( cx1 + halo < o->x ) ? cx1 + halo : o->x;
+   t->wrap = ( ch == o->y );
+   t->sy0  = t->wrap ? 0 : cy0 - halo;
+   t->sh   = t->wrap ? o->y : ch + 2 * halo;
+}
+
+
+void
+BlockedEngine::advance( int n )
+{
+   int i;
+
+   assert( n >= 1 && n <= steps );
+
+   for( i = 0; i < n; i++ )
+   {
+      fill_array64( (uint64_t *)( planes + i * planeSz ), planeSz / 8 );
+   }
+   stepsNow = n;
+
+   for( i = 1; i < nThreads; i++ )
+   {
+      workers[ i ]->go.release();
+   }
+   runShare( 0 );
+   done.acquire( nThreads - 1 );
+
+   s->worldNext = s->world;
+   s->world = next;
+   next = s->worldNext;
+
+   for( i = 0; i < n - 1; i++ )
+   {
+      s->sampleCharge( s->currentIter + i, census[ i ][ 6 ] );
+      if( o->output_file )
+      {
+         s->writeCensus( s->currentIter + i, census[ i ], census[ i ][ 6 ] );
+      }
+   }
+}
+
+
+// Tiles are dealt out round robin; the band, being the largest, is first.
+void
+BlockedEngine::runShare( int thread )
+{
+   int i;
+
+   for( i = thread; i < nTiles; i += nThreads )
+   {
+      runTile( &tiles[ i ], &scratch[ thread ] );
+   }
+}
+
+
+void
+BlockedEngine::runTile( struct tile *t, struct scratch *sc )
+{
+   struct atom *cells = sc->cells;
+   unsigned char *claimed = sc->claimed;
+   const unsigned char *plane, *dir;
+   int w = t->sx1 - t->sx0, h = t->sh, X = o->x, ymask = o->y - 1;
+   int shrinkL = ( t->sx0 > 0 ), shrinkR = ( t->sx1 < X ), shrinkY = !t->wrap;
+   int rx0 = 0, rx1 = w, ry0 = 0, ry1 = h;
+   int mx0, mx1, my0, my1;
+   int step, lx, ly, tx, ty, d, a, b, gy, k;
+   unsigned int c;
+
+   for( ly = 0; ly < h; ly++ )
+   {
+      gy = ( t->sy0 + ly ) & ymask;
+      memcpy( cells + ly * w, s->world + gy * X + t->sx0, sizeof( struct atom ) * w );
+   }
+
+   // rx0..ry1 bounds the part of the scratch area that is still exact.
+   for( step = 0; step < stepsNow; step++ )
+   {
+      plane = planes + step * planeSz;
+      memset( claimed, 0, w * h );
+
+      // Stake claims, as moveAtoms_stakeclaim().
+      for( ly = ry0; ly < ry1; ly++ )
+      {
+         dir = plane + ( ( t->sy0 + ly ) & ymask ) * X + t->sx0;
+         for( lx = rx0; lx < rx1; lx++ )
+         {
+            a = ly * w + lx;
+            c = cells[ a ].color;
+            if( isAtomColor( c ) )
+            {
+               claimed[ a ]++;
+               d  = dir[ lx ] & DIR_MASK;
+               tx = lx + dir2dx[ d ];
+               ty = ly + dir2dy[ d ];
+               if( t->wrap )
+               {
+                  ty &= ymask;
+               }
+               if( tx >= 0 && tx < w && ty >= 0 && ty < h )
+               {
+                  claimed[ ty * w + tx ]++;
+               }
+            } else if( c != SOLVENT ) {
+               claimed[ a ]++;
+            }
+         }
+      }
+
+      // Claims are complete one square inside that; move there, as
+      // moveAtoms_move().
+      mx0 = rx0 + shrinkL;
+      mx1 = rx1 - shrinkR;
+      my0 = ry0 + shrinkY;
+      my1 = ry1 - shrinkY;
+      for( ly = my0; ly < my1; ly++ )
+      {
+         dir = plane + ( ( t->sy0 + ly ) & ymask ) * X + t->sx0;
+         for( lx = mx0; lx < mx1; lx++ )
+         {
+            a = ly * w + lx;
+            if( claimed[ a ] == 1 && isAtomColor( cells[ a ].color ) )
+            {
+               d  = dir[ lx ] & DIR_MASK;
+               tx = lx + dir2dx[ d ];
+               ty = ly + dir2dy[ d ];
+               if( t->wrap )
+               {
+                  ty &= ymask;
+               }
+               if( tx >= mx0 && tx < mx1 && ty >= my0 && ty < my1 )
+               {
+                  b = ty * w + tx;
+                  if( claimed[ b ] == 1 )
+                  {
+                     moveCell( &cells[ a ], &cells[ b ], dir2dx[ d ], dir2dy[ d ] );
+                     claimed[ b ] = 0;
+                  }
+               }
+            }
+         }
+      }
+
+      if( t->band )
+      {
+         transport( t, sc, plane );
+         census[ step ][ 0 ] = s->initLHS_K;
+         census[ step ][ 1 ] = s->initLHS_Na;
+         census[ step ][ 2 ] = s->initLHS_Cl;
+         census[ step ][ 3 ] = s->initRHS_K;
+         census[ step ][ 4 ] = s->initRHS_Na;
+         census[ step ][ 5 ] = s->initRHS_Cl;
+         census[ step ][ 6 ] = s->LRcharge;
+      }
+
+      // A square is exact after the move if everything that could have
+      // moved into or out of it was.
+      rx0 += 2 * shrinkL;
+      rx1 -= 2 * shrinkR;
+      ry0 += 2 * shrinkY;
+      ry1 -= 2 * shrinkY;
+   }
+
+   // Write back the core, and tell the registry where tracked ions went.
+   for( k = 0; k < t->ch; k++ )
+   {
+      struct atom *src = cells + ( t->cy0 - t->sy0 + k ) * w + ( t->cx0 - t->sx0 );
+      unsigned int dst = ( ( t->cy0 + k ) & ymask ) * X + t->cx0;
+
+      memcpy( next + dst, src, sizeof( struct atom ) * ( t->cx1 - t->cx0 ) );
+      if( s->nTracked )
+      {
+         for( lx = 0; lx < t->cx1 - t->cx0; lx++ )
+         {
+            if( src[ lx ].tracked )
+            {
+               s->tracked[ s->trackedSlot[ src[ lx ].id ] ].position = dst + lx;
+            }
+         }
+      }
+   }
+}
+
+
+// Pore transport for one iteration of the band, as
+// moveAtoms_poretransport().  The band holds every row, so scratch row y
+// is world row y.
+void
+BlockedEngine::transport( struct tile *t, struct scratch *sc, const unsigned char *plane )
+{
+   int w = t->sx1 - t->sx0, X = o->x, m = o->x / 2, lm = m - t->sx0;
+   int y, q;
+   struct atom *row, *left, *right;
+   unsigned int pore;
+
+   for( y = 0; y < o->y; y++ )
+   {
+      row = sc->cells + y * w;
+      pore = row[ lm ].color;
+      if( !isPoreColor( pore ) )
+      {
+         continue;
+      }
+      left  = &row[ lm - 1 ];
+      right = &row[ lm + 1 ];
+
+      // Try movement from left to right
+      if( isAtomColor( left->color ) &&
+          right->color == SOLVENT &&
+          permeable( pore, left->color, o->selectivity ) &&
+          s->transportAccepted( ( left->color == ATOM_Cl ) ? -1 : 1, plane[ y * X + m + 1 ] ) )
+      {
+         q = ( left->color == ATOM_Cl ) ? -1 : 1;
+         moveCell( left, right, 2, 0 );
+         s->LRcharge += -2 * q;
+         s->countCrossing( y, right->color, 0 );
+         switch( right->color )
+         {
+            case ATOM_K:
+               s->initLHS_K--;
+               s->initRHS_K++;
+               break;
+            case ATOM_Na:
+               s->initLHS_Na--;
+               s->initRHS_Na++;
+               break;
+            case ATOM_Cl:
+               s->initLHS_Cl--;
+               s->initRHS_Cl++;
+               break;
+         }
+      } else {
+         // Try movement from right to left
+         if( isAtomColor( right->color ) &&
+             left->color == SOLVENT &&
+             permeable( pore, right->color, o->selectivity ) &&
+             s->transportAccepted( ( right->color == ATOM_Cl ) ? 1 : -1, plane[ y * X + m - 1 ] ) )
+         {
+            q = ( right->color == ATOM_Cl ) ? -1 : 1;
+            moveCell( right, left, -2, 0 );
+            s->LRcharge += 2 * q;
+            s->countCrossing( y, left->color, 1 );
+            switch( left->color )
+            {
+               case ATOM_K:
+                  s->initLHS_K++;
+                  s->initRHS_K--;
+                  break;
+               case ATOM_Na:
+                  s->initLHS_Na++;
+                  s->initRHS_Na--;
+                  break;
+               case ATOM_Cl:
+                  s->initLHS_Cl++;
+                  s->initRHS_Cl--;
+                  break;
+            }
+         }
+      }
+   }
+}
+
+
+//===========================================================================
+// BlockedWorker
+//===========================================================================
+
+BlockedWorker::BlockedWorker( BlockedEngine *engine, int param_id ) :
+   QThread( 0 ), go( 0 ), quit( 0 ), cpu( -1 ), e( engine ), id( param_id )
+{
+}
+
+
+void
+BlockedWorker::run()
+{
+   if( cpu >= 0 )
+   {
+      pinWorker( e->o, id, cpu );
+   }
+
+   for( ;; )
+   {
+      go.acquire();
+      if( quit )
+      {
+         return;
+      }
+      e->runShare( id );
+      e->done.release();
+   }
+}
@@ -0,0 +1,145 @@
+/* blocked.h
+ *
+ * Temporally blocked stepping engine (--engine=blocked).
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLOCKED_H
+#define BLOCKED_H
+
+#include <QThread>
+#include <QSemaphore>
+
+class NernstSim;
+class BlockedWorker;
+class Arena;
+struct atom;
+
+// Advances the world several iterations per pass over memory instead of
+// one.  The claim engine streams the whole lattice through the cache four
+// times an iteration; this one copies a tile into a private scratch area,
+// runs up to --block-steps iterations on it there, and writes it back.
+//
+// An ion moves at most one square per iteration and a claim reaches one
+// square further, so after k iterations everything within 2k squares of
+// the edge of a tile's scratch area may be wrong.  Each tile therefore
+// carries a halo that wide and only its core is written back ("overlapped"
+// or ghost-zone tiling).  The halo is recomputed by the neighbouring tiles,
+// which costs some redundant work but means tiles never wait for each
+// other and can run on any thread in any order.
+//
+// Pore transport is sequential in y and coupled through LRcharge, so the
+// columns around the membrane are one tall tile, the band, that covers
+// every row and runs transport after each of its iterations exactly as
+// moveAtoms_poretransport() does.  Changes caused by transport spread one
+// square per iteration, so the band's core reaches 2 * block_steps
+// squares to each side of the membrane; the bulk tiles next to it never
+// see transport inside their cores.
+//
+// The random direction planes for a block are generated up front, in the
+// order the claim engine would generate them, so both engines produce
+// exactly the same world and static.out for the same seed.
+class BlockedEngine
+{
+   friend class BlockedWorker;
+
+   public:
+      BlockedEngine( NernstSim *sim );
+      ~BlockedEngine();
+
+      // Run iterations s->currentIter .. s->currentIter + n - 1, where
+      // n <= o->block_steps, and write their census lines, all but the
+      // last of which (postIter() writes that one).
+      void advance( int n );
+
+   private:
+      enum
+      {
+         TILE_W = 512,   // core columns per bulk tile
+         TILE_H = 128    // core rows, unless the halo would overlap itself;
+                         // with its halo a tile is about 1 MB at 4 steps
+      };
+
+      struct tile
+      {
+         int sx0, sx1;   // scratch columns [sx0, sx1), clipped to the world
+         int sy0, sh;    // scratch rows sy0 .. sy0 + sh - 1, mod o->y
+         int cx0, cx1;   // core columns, written back
+         int cy0, ch;    // core rows
+         int wrap;       // scratch holds every row and wraps like the torus
+         int band;       // holds the membrane; run pore transport
+      };
+
+      struct scratch
+      {
+         struct atom *cells;
+         unsigned char *claimed;
+      };
+
+      NernstSim *s;
+      struct options *o;
+      int steps;                // o->block_steps when created
+      int halo;
+
+      unsigned long int planeSz;
+      unsigned char *planes;    // steps direction planes of planeSz bytes
+      struct atom *next;        // the world being written, s->worldNext;
+                                // swapped in at the end
+      Arena *arena;             // planes and scratch
+
+      struct tile *tiles;
+      int nTiles;
+      struct scratch *scratch;  // one per thread
+      int nThreads;
+
+      int stepsNow;
+      int (*census)[ 7 ];       // LHS K Na Cl, RHS K Na Cl, LRcharge after each step
+
+      BlockedWorker **workers;
+      int *cpus;                // from --affinity, or NULL
+      QSemaphore done;
+
+      void addTiles( int x0, int x1 );
+      void addTile( int cx0, int cx1, int cy0, int ch, int band );
+      void runShare( int thread );
+      void runTile( struct tile *t, struct scratch *sc );
+      void transport( struct tile *t, struct scratch *sc, const unsigned char *plane );
+};
+
+
+// Runs a share of the tiles on behalf of advance().
+class BlockedWorker : public QThread
+{
+   public:
+      BlockedWorker( BlockedEngine *e, int id );
+      QSemaphore go;
+      int quit;
+      int cpu;          // to pin to at start (see --affinity), or -1
+
+   protected:
+      virtual void run();
+
+   private:
+      BlockedEngine *e;
+      int id;
+};
+
+#endif /* BLOCKED_H */
@@ -0,0 +1,484 @@
+/* checkpoint.cpp
+ *
+ * Periodic checkpoints written by a forked copy.  See checkpoint.h.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#ifdef BLR_USEWIN
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+#include <SFMT.h>
+
+#include "checkpoint.h"
+#include "hash.h"
+#include "options.h"
+#include "sim.h"
+#include "sublattice.h"
+#include "stats.h"
+#include "timing.h"
+#include "safecalls.h"
+using namespace SafeCalls;
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+
+enum
+{
+   CKPT_MAGIC   = 0x4e434b50,   // "NCKP"
+   CKPT_VERSION = 1
+};
+
+// A checkpoint is this header, then
+//
+//    the world                       x * y struct atoms
+//    the Mersenne twister's state    sfmtWords 32-bit words
+//    the pore counters               6 * y unsigned ints
+//    the tracked ions                nTracked struct trackedIons
+//    the potential's statistics      a BatchMeans
+//    the sublattice engine's state   a struct sublatticeState, if any
+//
+// and a 64-bit FNV-1a checksum of all of that.  Native byte order and
+// layout: a checkpoint is for resuming on the machine that wrote it.
+struct checkpointHeader
+{
+   uint32_t magic, version;
+   uint64_t optionsKey;
+   int32_t x, y, nIons, iter;      // iter: the last iteration done
+   int32_t LRcharge, counts[ 6 ];  // initLHS_K .. initRHS_Cl
+   int32_t nTracked, sfmtIdx, sfmtWords, hasSublattice;
+   int64_t censusBytes;            // of static.out, or -1
+};
+
+struct sublatticeState
+{
+   uint32_t sweep, r;
+   int32_t order[ 12 ];
+};
+
+
+// All of data to fd, adding it to the checksum *h.  Only system calls: it
+// runs in the forked writer.
+static int
+writeAll( int fd, const void *data, size_t n, uint64_t *h )
+{
+   const char *p = (const char *)data;
+   long w;
+
+   *h = fnv( *h, data, n );
+   while( n > 0 )
+   {
+      w = write( fd, p, n > ( 1u << 30 ) ? ( 1u << 30 ) : n );
+      if( w < 0 && errno == EINTR )
+      {
+         continue;
+      }
+      if( w <= 0 )
+      {
+         return 0;
+      }
+      p += w;
+      n -= w;
+   }
+   return 1;
+}
+
+
+Checkpointer::Checkpointer( NernstSim *sim )
+{
+   s = sim;
+   o = sim->o;
+   key = optionsKey( o );
+   snprintf( tmp, sizeof( tmp ), "%s.tmp", o->checkpoint );
+   lastIter = s->currentIter - 1;
+   lastNsec = nowNsec();
+   writer = 0;
+   writerIter = 0;
+   written = failed = postponed = 0;
+}
+
+
+Checkpointer::~Checkpointer()
+{
+   finish();
+}
+
+
+// Everything besides the state itself that decides what happens next.
+// After initAtoms(), so o->max_atoms is the number of ions placed.  The
+// claim, atomic and blocked engines step identically with any number of
+// threads, so a run may resume on any of them, on a machine of any shape;
+// only the sublattice engine's moves differ.
+uint64_t
+Checkpointer::optionsKey( struct options *o )
+{
+   char canon[ 1024 ];
+
+   snprintf( canon, sizeof( canon ),
+             "x=%d y=%d max_atoms=%ld lK=%d lNa=%d lCl=%d rK=%d rNa=%d rCl=%d "
+             "pK=%.17g pNa=%.17g pCl=%.17g selectivity=%d electrostatics=%d "
+             "seed=%d dynamics=%s "
+             "e=%.17g k=%.17g t=%.17g d=%.17g a=%.17g eps0=%.17g eps=%.17g c=%.17g cBoltz=%.17g",
+             o->x, o->y, o->max_atoms, o->lK, o->lNa, o->lCl, o->rK, o->rNa, o->rCl,
+             o->pK, o->pNa, o->pCl, o->selectivity, o->electrostatics,
+             o->randseed, o->engine == ENGINE_SUBLATTICE ? "sublattice" : "claim",
+             o->e, o->k, o->t, o->d, o->a, o->eps0, o->eps, o->c, o->cBoltz );
+   return fnv( FNV_BASIS, canon, strlen( canon ) );
+}
+
+
+void
+Checkpointer::poll()
+{
+   int due;
+
+   if( writer )
+   {
+      collect( 0 );
+   }
+
+   due = ( o->checkpoint_every > 0 && s->currentIter - lastIter >= o->checkpoint_every ) ||
+         ( o->checkpoint_seconds > 0 &&
+           nowNsec() - lastNsec >= (uint64_t)o->checkpoint_seconds * 1000000000ull );
+   if( !due )
+   {
+      return;
+   }
+   if( writer )
+   {
+      postponed++;      // try again next iteration
+      return;
+   }
+   start();
+}
+
+
+void
+Checkpointer::finish()
+{
+   if( writer )
+   {
+      collect( 1 );
+   }
+   if( o->verbose && ( written || failed || postponed ) )
+   {
+      fprintf( stderr, "checkpoint: %d written, %d failed, %d postponed while one was being written\n",
+               written, failed, postponed );
+      written = failed = postponed = 0;
+   }
+}
+
+
+void
+Checkpointer::start()
+{
+   long censusBytes = s->censusBytes();   // flushes static.out
+   uint64_t t0 = nowNsec();
+   int fd, ok;
+
+   lastIter = s->currentIter;
+   lastNsec = t0;
+   writerIter = s->currentIter;
+
+#ifdef BLR_USEWIN
+   fd = open( tmp, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666 );
+   ok = fd >= 0 && writeTo( fd, writerIter, censusBytes ) && _commit( fd ) == 0;
+   if( fd >= 0 )
+   {
+      close( fd );
+   }
+   done( ok );
+#else
+   pid_t pid = fork();
+
+   if( pid == 0 )
+   {
+      fd = open( tmp, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666 );
+      ok = fd >= 0 && writeTo( fd, writerIter, censusBytes ) && fsync( fd ) == 0;
+      if( fd >= 0 )
+      {
+         close( fd );
+      }
+      _exit( ok ? 0 : 1 );
+   }
+   if( pid < 0 )
+   {
+      perror( "checkpoint: fork" );
+      done( 0 );
+      return;
+   }
+   writer = pid;
+   if( o->verbose )
+   {
+      fprintf( stderr, "checkpoint: iteration %d, fork took %.3f ms\n",
+               writerIter, ( nowNsec() - t0 ) * 1.0e-6 );
+   }
+#endif
+}
+
+
+void
+Checkpointer::collect( int wait )
+{
+#ifndef BLR_USEWIN
+   int status;
+   pid_t r;
+
+   do
+   {
+      r = waitpid( (pid_t)writer, &status, wait ? 0 : WNOHANG );
+   } while( r < 0 && errno == EINTR );
+   if( r == 0 )
+   {
+      return;
+   }
+   writer = 0;
+   done( r > 0 && WIFEXITED( status ) && WEXITSTATUS( status ) == 0 );
+#else
+   wait = wait;
+#endif
+}
+
+
+// The writer is finished: rotate the old checkpoints and put the new one
+// in their place, or throw it away.
+void
+Checkpointer::done( int ok )
+{
+   char from[ 1040 ], to[ 1040 ];
+   int k;
+
+   if( !ok )
+   {
+      fprintf( stderr, "checkpoint: writing iteration %d to %s failed\n", writerIter, tmp );
+      remove( tmp );
+      failed++;
+      return;
+   }
+
+   for( k = o->checkpoint_keep - 1; k >= 1; k-- )
+   {
+      if( k == 1 )
+      {
+         snprintf( from, sizeof( from ), "%s", o->checkpoint );
+      } else {
+         snprintf( from, sizeof( from ), "%s.%d", o->checkpoint, k - 1 );
+      }
+      snprintf( to, sizeof( to ), "%s.%d", o->checkpoint, k );
+#ifdef BLR_USEWIN
+      remove( to );
+#endif
+      rename( from, to );
+   }
+#ifdef BLR_USEWIN
+   remove( o->checkpoint );
+#endif
+   if( rename( tmp, o->checkpoint ) != 0 )
+   {
+      perror( o->checkpoint );
+      failed++;
+      return;
+   }
+   written++;
+   if( o->verbose )
+   {
+      fprintf( stderr, "checkpoint: iteration %d is in %s\n", writerIter, o->checkpoint );
+   }
+}
+
+
+// Runs in the forked writer: system calls only, no allocation.
+int
+Checkpointer::writeTo( int fd, int iter, long censusBytes )
+{
+   struct checkpointHeader h;
+   struct sublatticeState sub;
+   uint64_t sum = FNV_BASIS, trailer;
+   int i, ok;
+
+   memset( &h, 0, sizeof( h ) );
+   h.magic         = CKPT_MAGIC;
+   h.version       = CKPT_VERSION;
+   h.optionsKey    = key;
+   h.x             = o->x;
+   h.y             = o->y;
+   h.nIons         = s->nIons;
+   h.iter          = iter;
+   h.LRcharge      = s->LRcharge;
+   h.counts[ 0 ]   = s->initLHS_K;
+   h.counts[ 1 ]   = s->initLHS_Na;
+   h.counts[ 2 ]   = s->initLHS_Cl;
+   h.counts[ 3 ]   = s->initRHS_K;
+   h.counts[ 4 ]   = s->initRHS_Na;
+   h.counts[ 5 ]   = s->initRHS_Cl;
+   h.nTracked      = s->nTracked;
+   h.sfmtIdx       = get_sfmt_idx();
+   h.sfmtWords     = sizeofSFMT();
+   h.hasSublattice = ( s->sublattice != NULL );
+   h.censusBytes   = censusBytes;
+
+   ok = writeAll( fd, &h, sizeof( h ), &sum ) &&
+        writeAll( fd, s->world, sizeof( struct atom ) * o->x * o->y, &sum ) &&
+        writeAll( fd, get_sfmt_state32(), sizeof( uint32_t ) * h.sfmtWords, &sum ) &&
+        writeAll( fd, s->poreFlux, 6 * sizeof( unsigned int ) * o->y, &sum ) &&
+        writeAll( fd, s->tracked, sizeof( struct trackedIon ) * s->nTracked, &sum ) &&
+        writeAll( fd, s->vmStats, sizeof( BatchMeans ), &sum );
+   if( ok && s->sublattice )
+   {
+      memset( &sub, 0, sizeof( sub ) );
+      sub.sweep = s->sublattice->sweep;
+      sub.r = s->sublattice->r;
+      for( i = 0; i < SublatticeEngine::NUM_CLASSES; i++ )
+      {
+         sub.order[ i ] = s->sublattice->order[ i ];
+      }
+      ok = writeAll( fd, &sub, sizeof( sub ), &sum );
+   }
+   trailer = sum;
+   return ok && writeAll( fd, &trailer, sizeof( trailer ), &sum );
+}
+
+
+int
+Checkpointer::restore( NernstSim *s, const char *file )
+{
+   struct options *o = s->o;
+   struct checkpointHeader h;
+   struct sublatticeState sub;
+   struct trackedIon *ions;
+   unsigned char *buf, *p;
+   size_t worldSz, sfmtSz, fluxSz, ionsSz, need;
+   uint64_t sum;
+   long n;
+   int i;
+   FILE *fp;
+
+   if( ( fp = fopen( file, "rb" ) ) == NULL )
+   {
+      perror( file );
+      return 0;
+   }
+   fseek( fp, 0, SEEK_END );
+   n = ftell( fp );
+   fseek( fp, 0, SEEK_SET );
+   buf = (unsigned char *)malloc( n > 0 ? n : 1 );
+   assert( buf );
+   if( n < (long)( sizeof( h ) + sizeof( sum ) ) || fread( buf, 1, n, fp ) != (size_t)n )
+   {
+      fclose( fp );
+      free( buf );
+      fprintf( stderr, "%s: not a checkpoint.\n", file );
+      return 0;
+   }
+   fclose( fp );
+
+   memcpy( &h, buf, sizeof( h ) );
+   worldSz = sizeof( struct atom ) * o->x * o->y;
+   sfmtSz  = sizeof( uint32_t ) * sizeofSFMT();
+   fluxSz  = 6 * sizeof( unsigned int ) * o->y;
+   ionsSz  = sizeof( struct trackedIon ) * ( h.nTracked > 0 ? h.nTracked : 0 );
+   need    = sizeof( h ) + worldSz + sfmtSz + fluxSz + ionsSz + sizeof( BatchMeans ) +
+             ( h.hasSublattice ? sizeof( sub ) : 0 ) + sizeof( sum );
+   if( h.magic != CKPT_MAGIC || h.version != CKPT_VERSION )
+   {
+      fprintf( stderr, "%s: not a checkpoint, or from another version.\n", file );
+   } else if( h.optionsKey != optionsKey( o ) || h.x != o->x || h.y != o->y ||
+              h.nIons != s->nIons || h.sfmtWords != sizeofSFMT() ) {
+      fprintf( stderr, "%s was written with different options; resume with the same ones.\n", file );
+   } else if( (size_t)n != need || h.nTracked < 0 ||
+              ( memcpy( &sum, buf + n - sizeof( sum ), sizeof( sum ) ),
+                sum != fnv( FNV_BASIS, buf, n - sizeof( sum ) ) ) ) {
+      fprintf( stderr, "%s is damaged.\n", file );
+   } else {
+      n = 0;
+   }
+   if( n != 0 )
+   {
+      free( buf );
+      return 0;
+   }
+
+   p = buf + sizeof( h );
+   memcpy( s->world, p, worldSz );
+   p += worldSz;
+   memcpy( get_sfmt_state32(), p, sfmtSz );
+   set_sfmt_idx( h.sfmtIdx );
+   p += sfmtSz;
+   memcpy( s->poreFlux, p, fluxSz );
+   p += fluxSz;
+   ions = (struct trackedIon *)p;
+   p += ionsSz;
+   memcpy( (void *)s->vmStats, p, sizeof( BatchMeans ) );
+   p += sizeof( BatchMeans );
+
+   s->LRcharge   = h.LRcharge;
+   s->initLHS_K  = h.counts[ 0 ];
+   s->initLHS_Na = h.counts[ 1 ];
+   s->initLHS_Cl = h.counts[ 2 ];
+   s->initRHS_K  = h.counts[ 3 ];
+   s->initRHS_Na = h.counts[ 4 ];
+   s->initRHS_Cl = h.counts[ 5 ];
+   s->currentIter = h.iter + 1;
+
+   // Tracked ions in their original order, so trajectories list them the
+   // same way.
+   s->nTracked = 0;
+   for( i = 0; i < h.nTracked; i++ )
+   {
+      s->world[ ions[ i ].position ].tracked = 0;
+      s->trackAtom( ions[ i ].position );
+   }
+
+   if( h.hasSublattice )
+   {
+      memcpy( &sub, p, sizeof( sub ) );
+      if( s->sublattice == NULL )
+      {
+         s->sublattice = safeNew( SublatticeEngine( s ) );
+      }
+      s->sublattice->sweep = sub.sweep;
+      s->sublattice->r = sub.r;
+      for( i = 0; i < SublatticeEngine::NUM_CLASSES; i++ )
+      {
+         s->sublattice->order[ i ] = sub.order[ i ];
+      }
+   }
+
+   if( o->output_file && h.censusBytes >= 0 )
+   {
+      s->resumeCensus( h.censusBytes );
+   }
+
+   free( buf );
+   return 1;
+}
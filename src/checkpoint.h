@@ -0,0 +1,89 @@
+/* checkpoint.h
+ *
+ * Periodic checkpoints written by a forked copy (--checkpoint), and
+ * resuming from them (--resume).
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+
+class NernstSim;
+
+// Every --checkpoint-every iterations or --checkpoint-seconds seconds,
+// whichever comes first, the simulation forks.  The child has a
+// copy-on-write image of the world as it stood after that iteration and
+// writes it out while the parent carries on; the parent only pays for the
+// fork and for copying the pages it writes to before the child is done.
+// A checkpoint holds everything the run depends on: the world, the
+// Mersenne twister's state, the pore counters, the tracked ions, the
+// potential's running statistics, the sublattice engine's state, and how
+// much of static.out had been written, so a resumed run carries on
+// exactly as the original would have.
+//
+// The child writes FILE.tmp with plain write()s (after a fork in a
+// threaded process it must not use anything that might take a lock) and
+// ends with a checksum.  The parent collects it at the next iteration,
+// moves FILE to FILE.1, FILE.1 to FILE.2 and so on, keeping
+// --checkpoint-keep of them, and renames FILE.tmp to FILE.  If a
+// checkpoint is still being written when the next is due, the next waits.
+//
+// Where there is no fork() (Windows), checkpoints are written in line.
+class Checkpointer
+{
+   public:
+      Checkpointer( NernstSim *sim );
+      ~Checkpointer();
+
+      // From postIter(): collect a finished writer, and start a
+      // checkpoint if one is due.
+      void poll();
+
+      // Wait for the writer, if any.
+      void finish();
+
+      // After initAtoms(): replace the state of s with that in file.
+      // Prints why and returns 0 if the file is damaged or was written
+      // with different options.
+      static int restore( NernstSim *s, const char *file );
+
+   private:
+      NernstSim *s;
+      struct options *o;
+      char tmp[ 1024 ];         // FILE.tmp
+      int lastIter;             // of the last checkpoint started
+      uint64_t lastNsec;
+      long writer;              // process writing tmp, or 0
+      int writerIter;
+      int written, failed, postponed;
+      uint64_t key;             // optionsKey( o )
+
+      void start();
+      void collect( int wait );
+      void done( int ok );
+
+      static uint64_t optionsKey( struct options *o );
+      int writeTo( int fd, int iter, long censusBytes );
+};
+
+#endif /* CHECKPOINT_H */
@@ -86,7 +86,7 @@ NernstCtrl::NernstCtrl( struct options *options, QWidget *parent )
 
    itersSld = safeNew( QSlider( Qt::Horizontal ) );
    itersSld->setMinimumWidth( 100 );
-   itersSld->setRange( MIN_ITERS, MAX_ITERS );
+   itersSld->setRange( MIN_ITERS, o->iters > MAX_ITERS ? o->iters : MAX_ITERS );
    itersSld->setPageStep( 1000 );
    itersSld->setValue( itersDefault );
    itersSld->setToolTip( "Set the number of iterations of the simulation\nbetween " + QString::number( MIN_ITERS )
@@ -0,0 +1,231 @@
+/* frames.cpp
+ *
+ * Headless export of world images, for movies of console runs.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QImage>
+#include <QString>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "frames.h"
+#include "options.h"
+#include "sim.h"
+
+
+FrameWriter::FrameWriter( struct options *options )
+{
+   o = options;
+   x = o->x;
+   y = o->y;
+   buildPalette( palette, o->electrostatics, o->selectivity );
+   stream = NULL;
+   rgb = NULL;
+   head = count = 0;
+   done = 0;
+
+   for( int i = 0; i < NUM_BUFS; i++ )
+   {
+      bufs[ i ].colors = (unsigned char *)malloc( x * y );
+      assert( bufs[ i ].colors );
+   }
+}
+
+
+FrameWriter::~FrameWriter()
+{
+   finish();
+   for( int i = 0; i < NUM_BUFS; i++ )
+   {
+      free( bufs[ i ].colors );
+   }
+   free( rgb );
+}
+
+
+// A file name without a %d in it (or "-" for standard output) gets every
+// frame, one after another, as binary PPM.
+int
+FrameWriter::open()
+{
+   if( !strcmp( o->frame_file, "-" ) )
+   {
+      stream = stdout;
+   } else if( !strchr( o->frame_file, '%' ) ) {
+      stream = fopen( o->frame_file, "wb" );
+      if( !stream )
+      {
+         perror( o->frame_file );
+         return 0;
+      }
+   } else {
+      // The name is used as a printf format for the iteration.
+      const char *p = strchr( o->frame_file, '%' ) + 1;
+      p += strspn( p, "0123456789" );
+      if( *p != 'd' || strchr( p, '%' ) )
+      {
+         fprintf( stderr, "--frame-file may contain only one %%d.\n" );
+         return 0;
+      }
+   }
+
+   if( stream )
+   {
+      rgb = (unsigned char *)malloc( 3 * x );
+      assert( rgb );
+   }
+
+   start();
+   return 1;
+}
+
+
+// Simulation thread, between iterations.
+void
+FrameWriter::capture( NernstSim *s, int iter )
+{
+   struct frame *f;
+   int i, n = x * y;
+
+   mutex.lock();
+   while( count == NUM_BUFS )
+   {
+      room.wait( &mutex );
+   }
+   f = &bufs[ ( head + count ) % NUM_BUFS ];
+   mutex.unlock();
+
+   // The writer leaves a buffer alone until it is queued.
+   for( i = 0; i < n; i++ )
+   {
+      f->colors[ i ] = s->world[ i ].color;
+   }
+   for( i = 0; i < s->nTracked; i++ )
+   {
+      f->colors[ s->tracked[ i ].position ] |= PALETTE_TRACKED;
+   }
+   f->iter = iter;
+
+   mutex.lock();
+   count++;
+   ready.wakeOne();
+   mutex.unlock();
+}
+
+
+void
+FrameWriter::finish()
+{
+   if( isRunning() )
+   {
+      mutex.lock();
+      done = 1;
+      ready.wakeOne();
+      mutex.unlock();
+      wait();
+   }
+
+   if( stream )
+   {
+      if( stream != stdout )
+      {
+         fclose( stream );
+      }
+      stream = NULL;
+   }
+}
+
+
+void
+FrameWriter::run()
+{
+   for( ;; )
+   {
+      mutex.lock();
+      while( count == 0 && !done )
+      {
+         ready.wait( &mutex );
+      }
+      if( count == 0 )
+      {
+         mutex.unlock();
+         return;
+      }
+      struct frame *f = &bufs[ head ];
+      mutex.unlock();
+
+      write( f );
+
+      mutex.lock();
+      head = ( head + 1 ) % NUM_BUFS;
+      count--;
+      room.wakeOne();
+      mutex.unlock();
+   }
+}
+
+
+// Rows are written top to bottom, so y increases upwards as in the GUI.
+void
+FrameWriter::write( struct frame *f )
+{
+   int i, j;
+
+   if( stream )
+   {
+      fprintf( stream, "P6\n%d %d\n255\n", x, y );
+      for( j = y - 1; j >= 0; j-- )
+      {
+         const unsigned char *row = f->colors + j * x;
+         for( i = 0; i < x; i++ )
+         {
+            uint32_t c = palette[ row[ i ] ];
+            rgb[ 3 * i     ] = ( c >> 16 ) & 0xff;
+            rgb[ 3 * i + 1 ] = ( c >> 8 ) & 0xff;
+            rgb[ 3 * i + 2 ] =   c & 0xff;
+         }
+         fwrite( rgb, 3, x, stream );
+      }
+      fflush( stream );
+   } else {
+      QImage image( x, y, QImage::Format_RGB32 );
+      char name[ 1024 ];
+
+      for( j = 0; j < y; j++ )
+      {
+         const unsigned char *row = f->colors + ( y - 1 - j ) * x;
+         uint32_t *line = (uint32_t *)image.scanLine( j );
+         for( i = 0; i < x; i++ )
+         {
+            line[ i ] = palette[ row[ i ] ];
+         }
+      }
+
+      snprintf( name, sizeof( name ), o->frame_file, f->iter );
+      if( !image.save( QString( name ), "PNG" ) )
+      {
+         fprintf( stderr, "Could not write %s.\n", name );
+      }
+   }
+}
@@ -0,0 +1,83 @@
+/* frames.h
+ *
+ * Headless export of world images, for movies of console runs.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <stdio.h>
+#include <stdint.h>
+#include "palette.h"
+
+class NernstSim;
+
+// Writes a picture of the world every --frame-every iterations, colored
+// as the GUI colors it, without needing a display.  The simulation only
+// copies the color plane; a thread of its own turns it into pixels and
+// writes them, either as one PNG per frame or as a stream of binary PPM
+// images for piping to an encoder (see --frame-file).
+//
+// Two frames may be waiting at once.  If the writer falls further behind
+// than that, capture() blocks rather than drop frames.
+class FrameWriter : public QThread
+{
+   public:
+      FrameWriter( struct options *o );
+      ~FrameWriter();
+
+      int open();                               // 0 on failure
+      void capture( NernstSim *s, int iter );   // from the simulation
+      void finish();                            // write what is left
+
+   protected:
+      virtual void run();
+
+   private:
+      enum { NUM_BUFS = 2 };
+
+      struct frame
+      {
+         unsigned char *colors;
+         int iter;
+      };
+
+      struct options *o;
+      int x, y;
+      uint32_t palette[ PALETTE_SIZE ];
+      FILE *stream;     // NULL when writing one image per frame
+      unsigned char *rgb;
+
+      QMutex mutex;
+      QWaitCondition ready;   // a frame is waiting
+      QWaitCondition room;    // a buffer is free
+      struct frame bufs[ NUM_BUFS ];
+      int head, count;        // bufs[ head ], ... are waiting, oldest first
+      int done;
+
+      void write( struct frame *f );
+};
+
+#endif /* FRAMES_H */
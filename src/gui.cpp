@@ -26,6 +26,7 @@
 #include <QtGui>
 #include <qwt_plot.h>
 #include <qwt_plot_curve.h>
+#include <qwt_plot_canvas.h>
 #include <SFMT.h>
 #include <math.h>
 #include <limits>
@@ -37,14 +38,13 @@
 #include "ctrl.h"
 #include "paint.h"
 #include "options.h"
+#include "timeseries.h"
+#include "stats.h"
 #include "safecalls.h"
 using namespace SafeCalls;
 
-double x_iters[ MAX_ITERS ];
-double y_volts[ MAX_ITERS ];
-double y_ghk[ MAX_ITERS ];
-// double y_gibbs[ MAX_ITERS ];
-// double y_boltzmann[ MAX_ITERS ];
+TimeSeries voltsSeries;   // membrane potential (mV), one sample per iteration
+BatchMeans voltsStats;    // the same after --burn-in, for its mean and error
 
 
 NernstGUI::NernstGUI( struct options *options, QWidget *parent, Qt::WindowFlags flags )
@@ -121,9 +121,12 @@ NernstGUI::NernstGUI( struct options *options, QWidget *parent, Qt::WindowFlags
    numCurves = 4;
    curves = safeNew( QwtPlotCurve *[ numCurves ] );
    currentNernstCurve = 3;
+   nernstHasSomeData = 0;
+   plottedIter = -1;
+   ghkSeries = safeNew( TimeSeries() );
 
    curves[ 0 ] = safeNew( QwtPlotCurve( "Membrane Potential" ) );
-   curves[ 0 ]->setData( x_iters, y_volts, 0 );
+   plotSeries( curves[ 0 ], &voltsSeries );
    curves[ 0 ]->attach( voltsPlot );
 
    /*
@@ -142,7 +145,7 @@ NernstGUI::NernstGUI( struct options *options, QWidget *parent, Qt::WindowFlags
 
    curves[ currentNernstCurve ] = safeNew( QwtPlotCurve( "GHK Potential" ) );
    curves[ currentNernstCurve ]->setPen( QColor( Qt::red ) );
-   curves[ currentNernstCurve ]->setData( x_iters, y_ghk, 0 );
+   plotSeries( curves[ currentNernstCurve ], ghkSeries );
    curves[ currentNernstCurve ]->attach( voltsPlot );
    voltsGHK = 0;
 
@@ -191,6 +194,8 @@ NernstGUI::NernstGUI( struct options *options, QWidget *parent, Qt::WindowFlags
    plotLayout->addWidget( voltsPlot );
    curveLbl = safeNew( QLabel() );
    plotLayout->addWidget( curveLbl );
+   statsLbl = safeNew( QLabel() );
+   plotLayout->addWidget( statsLbl );
    resultsLayout->addWidget( plotFrame );
 
    concFrame = safeNew( QFrame() );
@@ -896,31 +901,7 @@ NernstGUI::disableLoadWorld()
 void
 NernstGUI::clearTrackedIons()
 {
-   if( s->world != NULL )
-   {
-      for( int x = 0; x < o->x; x++ )
-      {
-         for( int y = 0; y < o->y; y++ )
-         {
-            switch( s->world[ s->idx( x, y ) ].color )
-            {
-               case ATOM_K_TRACK:
-                  s->world[ s->idx( x, y ) ].color = ATOM_K;
-                  break;
-               case ATOM_Na_TRACK:
-                  s->world[ s->idx( x, y ) ].color = ATOM_Na;
-                  break;
-               case ATOM_Cl_TRACK:
-                  s->world[ s->idx( x, y ) ].color = ATOM_Cl;
-                  break;
-               default:
-                  break;
-            }
-         }
-      }
-      canvas->update();
-      zoom->update();
-   }
+   sim->clearTrackedIons();
 }
 
 
@@ -972,8 +953,7 @@ NernstGUI::calcEquilibrium()
    //voltsNernst = R * t / F * log( (double)initRHS_K / (double)initLHS_K ) * 1000;
 
    // Equilibrium predicted by the Goldman-Hodgkin-Katz voltage equation
-   voltsGHK = o->R * o->t / o->F * log( ( ( o->pK * s->initRHS_K ) + ( o->pNa * s->initRHS_Na ) + ( o->pCl * s->initLHS_Cl ) ) /
-                               ( ( o->pK * s->initLHS_K ) + ( o->pNa * s->initLHS_Na ) + ( o->pCl * s->initRHS_Cl ) ) ) * 1000;
+   voltsGHK = s->ghkPotential();
 
    /*
    int q;
@@ -1057,27 +1037,29 @@ NernstGUI::calcEquilibrium()
 }
 
 
+// Hand a curve as many points as the plot is wide.
 void
-NernstGUI::updatePlots( int currentIter )
+NernstGUI::plotSeries( QwtPlotCurve *curve, TimeSeries *series )
 {
-   static int nernstHasSomeData = 0;
-   static int beganThisNernstCurve = 0;
+   const double *x, *y;
+   int n = series->decimate( 2 * voltsPlot->canvas()->width(), &x, &y );
 
-   if( currentIter < 0 )
-   {
-      nernstHasSomeData = 0;
-      beganThisNernstCurve = 0;
-      return;
-   }
+   curve->setData( x, y, n );
+}
 
-   x_iters[ currentIter ] = currentIter;
-   y_volts[ currentIter ] = s->LRcharge * o->e / ( o->c * o->a * o->y ) * 1000;  // Current membrane potential (mV)
-   // y_gibbs[ currentIter ] = voltsGibbs;
-   // y_boltzmann[ currentIter ] = voltsBoltzmann;
 
-   curves[ 0 ]->setData( x_iters, y_volts, currentIter );
-   // curves[ 1 ]->setData( x_iters, y_gibbs, currentIter );
-   // curves[ 2 ]->setData( x_iters, y_boltzmann, currentIter );
+// Record the data point for currentIter.  This runs for every iteration,
+// so it only appends to the series; updatePlots() hands them to Qwt.
+void
+NernstGUI::appendPlotPoint( int currentIter )
+{
+   double volts = sim->chargeAt( currentIter ) * o->e / ( o->c * o->a * o->y ) * 1000;  // Current membrane potential (mV)
+
+   voltsSeries.append( volts );
+   if( currentIter > o->burn_in )
+   {
+      voltsStats.add( volts );
+   }
 
    int drawThisTime = 1;
    if( o->electrostatics != 1                               ||
@@ -1093,25 +1075,16 @@ NernstGUI::updatePlots( int currentIter )
    {
       if( !nernstHasSomeData )
       {
-         beganThisNernstCurve = currentIter;
+         ghkSeries->clear( currentIter );
          nernstHasSomeData = 1;
       }
 
-      y_ghk[ currentIter ] = voltsGHK;
-      curves[ currentNernstCurve ]->setData( x_iters + beganThisNernstCurve,
-                                             y_ghk + beganThisNernstCurve,
-                                             currentIter - beganThisNernstCurve + 1 );
-      if( ( o->pK >  0 && o->pNa == 0 && o->pCl == 0 ) ||
-          ( o->pK == 0 && o->pNa >  0 && o->pCl == 0 ) ||
-          ( o->pK == 0 && o->pNa == 0 && o->pCl >  0 ) )
-      {
-         curveLbl->setText( "<font color=#ff0000>Nernst: " + QString::number( voltsGHK ) + " mV</font>" );
-      } else {
-         curveLbl->setText( "<font color=#ff0000>Goldman-Hodgkin-Katz: " + QString::number( voltsGHK ) + " mV</font>" );
-      }
+      ghkSeries->append( voltsGHK );
    } else {
       if( nernstHasSomeData )
       {
+         // Finish off this curve; the next stretch of GHK data gets a new one.
+         plotSeries( curves[ currentNernstCurve ], ghkSeries );
          currentNernstCurve++;
          if( currentNernstCurve >= numCurves )
          {
@@ -1133,8 +1106,56 @@ NernstGUI::updatePlots( int currentIter )
          curves[ currentNernstCurve ]->attach( voltsPlot );
          nernstHasSomeData = 0;
       }
+   }
+}
+
+
+// Called once per frame: catch the series up to currentIter and redraw.
+// A negative currentIter forgets the history.
+void
+NernstGUI::updatePlots( int currentIter )
+{
+   if( currentIter < 0 )
+   {
+      nernstHasSomeData = 0;
+      plottedIter = -1;
+      voltsSeries.clear();
+      voltsStats.clear();
+      ghkSeries->clear();
+      return;
+   }
+
+   while( plottedIter < currentIter )
+   {
+      appendPlotPoint( ++plottedIter );
+   }
+
+   plotSeries( curves[ 0 ], &voltsSeries );
+
+   if( nernstHasSomeData )
+   {
+      plotSeries( curves[ currentNernstCurve ], ghkSeries );
+      if( ( o->pK >  0 && o->pNa == 0 && o->pCl == 0 ) ||
+          ( o->pK == 0 && o->pNa >  0 && o->pCl == 0 ) ||
+          ( o->pK == 0 && o->pNa == 0 && o->pCl >  0 ) )
+      {
+         curveLbl->setText( "<font color=#ff0000>Nernst: " + QString::number( voltsGHK ) + " mV</font>" );
+      } else {
+         curveLbl->setText( "<font color=#ff0000>Goldman-Hodgkin-Katz: " + QString::number( voltsGHK ) + " mV</font>" );
+      }
+   } else {
       curveLbl->setText( "<font color=#ff0000>Goldman-Hodgkin-Katz: N/A</font>" );
    }
+   if( voltsStats.batches() >= 2 )
+   {
+      // A question mark until the batches are long enough to trust.
+      statsLbl->setText( "Mean: " + QString::number( voltsStats.mean(), 'f', 2 ) +
+                         " +/- " + QString::number( voltsStats.stdErr(), 'f', 2 ) +
+                         " mV, tau " + QString::number( voltsStats.tau(), 'f', 0 ) + " iters" +
+                         ( voltsStats.settled() ? "" : " ?" ) );
+   } else {
+      statsLbl->setText( "Mean: N/A" );
+   }
    voltsPlot->replot();
 }
 
@@ -1142,20 +1163,19 @@ NernstGUI::updatePlots( int currentIter )
 void
 NernstGUI::resetPlots()
 {
-   curves[ 0 ]->setData( x_iters, y_volts, 0 );
-   // curves[ 1 ]->setData( x_iters, y_gibbs, 0 );
-   // curves[ 2 ]->setData( x_iters, y_boltzmann, 0 );
+   updatePlots( -1 );
+   plotSeries( curves[ 0 ], &voltsSeries );
 
    for( int i = 3; i <= currentNernstCurve; i++ )
    {
-      curves[ i ]->setData( x_iters, y_ghk, 0 );
+      plotSeries( curves[ i ], ghkSeries );
    }
 
    currentNernstCurve = 3;
-   updatePlots( -1 );
    voltsPlot->replot();
 
    curveLbl->setText( "" );
+   statsLbl->setText( "" );
 }
 
 
@@ -1203,20 +1223,25 @@ NernstGUI::adjustTable()
 void
 NernstGUI::updateTable()
 {
-   // Fill the concentration table with the current concentrations.
+   // Fill the concentration table with the concentrations last published.
    int numK, numNa, numCl;
+   const struct simSnapshot *snap = sim->lockSnapshot();
+   int initLHS_K  = snap->initLHS_K,  initRHS_K  = snap->initRHS_K;
+   int initLHS_Na = snap->initLHS_Na, initRHS_Na = snap->initRHS_Na;
+   int initLHS_Cl = snap->initLHS_Cl, initRHS_Cl = snap->initRHS_Cl;
+   sim->unlockSnapshot();
 
-   numK  = (int)( (double)(s->initLHS_K)  / ( (double)( o->x / 2 - 1 ) * (double)( o->y ) / 3.0 ) * (double)MAX_CONC + 0.5 );
-   numNa = (int)( (double)(s->initLHS_Na) / ( (double)( o->x / 2 - 1 ) * (double)( o->y ) / 3.0 ) * (double)MAX_CONC + 0.5 );
-   numCl = (int)( (double)(s->initLHS_Cl) / ( (double)( o->x / 2 - 1 ) * (double)( o->y ) / 3.0 ) * (double)MAX_CONC + 0.5 );
+   numK  = (int)( (double)(initLHS_K)  / ( (double)( o->x / 2 - 1 ) * (double)( o->y ) / 3.0 ) * (double)MAX_CONC + 0.5 );
+   numNa = (int)( (double)(initLHS_Na) / ( (double)( o->x / 2 - 1 ) * (double)( o->y ) / 3.0 ) * (double)MAX_CONC + 0.5 );
+   numCl = (int)( (double)(initLHS_Cl) / ( (double)( o->x / 2 - 1 ) * (double)( o->y ) / 3.0 ) * (double)MAX_CONC + 0.5 );
 
    KInLbl->setText( QString::number( numK ) + " mM" );
    NaInLbl->setText( QString::number( numNa ) + " mM" );
    ClInLbl->setText( QString::number( numCl ) + " mM" );
 
-   numK  = (int)( (double)(s->initRHS_K)  / ( (double)( o->x / 2 - 2 ) * (double)( o->y ) / 3.0 ) * (double)MAX_CONC + 0.5 );
-   numNa = (int)( (double)(s->initRHS_Na) / ( (double)( o->x / 2 - 2 ) * (double)( o->y ) / 3.0 ) * (double)MAX_CONC + 0.5 );
-   numCl = (int)( (double)(s->initRHS_Cl) / ( (double)( o->x / 2 - 2 ) * (double)( o->y ) / 3.0 ) * (double)MAX_CONC + 0.5 );
+   numK  = (int)( (double)(initRHS_K)  / ( (double)( o->x / 2 - 2 ) * (double)( o->y ) / 3.0 ) * (double)MAX_CONC + 0.5 );
+   numNa = (int)( (double)(initRHS_Na) / ( (double)( o->x / 2 - 2 ) * (double)( o->y ) / 3.0 ) * (double)MAX_CONC + 0.5 );
+   numCl = (int)( (double)(initRHS_Cl) / ( (double)( o->x / 2 - 2 ) * (double)( o->y ) / 3.0 ) * (double)MAX_CONC + 0.5 );
 
    KOutLbl->setText( QString::number( numK ) + " mM" );
    NaOutLbl->setText( QString::number( numNa ) + " mM" );
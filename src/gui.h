@@ -43,8 +43,9 @@ class QProgressBar;
 class QwtPlot;
 class QwtPlotCurve;
 class NernstSim;
+class TimeSeries;
 
-extern double x_iters[], y_volts[], y_ghk[]; // y_gibbs[], y_boltzmann[];
+extern TimeSeries voltsSeries;
 
 
 class NernstGUI : public QMainWindow
@@ -121,6 +122,7 @@ class NernstGUI : public QMainWindow
       QFrame *plotFrame;
       QVBoxLayout *plotLayout;
       QLabel *curveLbl;
+      QLabel *statsLbl;
 
       QFrame *concFrame;
       QGridLayout *concLayout;
@@ -169,6 +171,12 @@ class NernstGUI : public QMainWindow
       QwtPlotCurve **curves;
       int numCurves;
       int currentNernstCurve;
+      int nernstHasSomeData;     // the current GHK curve has points
+      TimeSeries *ghkSeries;     // ... and these are they
+      int plottedIter;           // last iteration in voltsSeries
+
+      void appendPlotPoint( int currentIter );
+      void plotSeries( QwtPlotCurve *curve, TimeSeries *series );
       // double voltsNernst;
       double voltsGHK;
       // double voltsGibbs;
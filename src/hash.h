@@ -0,0 +1,48 @@
+/* hash.h
+ *
+ * The 64-bit FNV-1a hash, for cache keys and file checksums.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+static const uint64_t FNV_BASIS = 14695981039346656037ull;
+
+// Continue the hash h (FNV_BASIS to start) over n bytes of data.  Not for
+// anything an adversary chooses; it only has to tell honest inputs apart.
+static inline uint64_t
+fnv( uint64_t h, const void *data, size_t n )
+{
+   const unsigned char *p = (const unsigned char *)data;
+
+   while( n-- )
+   {
+      h ^= *p++;
+      h *= 1099511628211ull;
+   }
+   return h;
+}
+
+#endif /* HASH_H */
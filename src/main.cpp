@@ -33,6 +33,10 @@
 #include "options.h"
 #include "sim.h"
 #include "gui.h"
+#include "bench.h"
+#include "timing.h"
+#include "affinity.h"
+#include "results.h"
 #include "safecalls.h"
 using namespace SafeCalls;
 
@@ -41,6 +45,7 @@ int WorkerThread::inCount[2];
 int WorkerThread::outCount[2];
 QSemaphore* WorkerThread::semaphore[2];
 QSemaphore* WorkerThread::barrier[2];
+int WorkerThread::halt;
 NernstSim*  WorkerThread::s;
 struct options* WorkerThread::o;
 
@@ -48,68 +53,52 @@ int
 main( int argc, char *argv[] )
 {
 	QCoreApplication *app;
-	int i;
-	class WorkerThread **worker = NULL;
 	class NernstSim *s = NULL;
 	struct options *o;
-	int nWorkers=0;
 	o = parseOptions( argc, argv );
-	nWorkers = o->threads;
 
-	if( o->use_gui && o->threads == 1) {
-	//Single-threaded gui.
+	// A console run identical to an earlier one is not run again, nor
+	// tuned first.
+	ResultStore results( o );
+	if( results.replay() ){
+		return 0;
+	}
+
+	if( o->autotune && !o->bench && !o->validate ){
+		autotune( o );
+	}
+
+	if( o->bench ){
+	//Benchmark matrix.
+		app = safeNew( QCoreApplication( argc, argv ) );
+		return runBenchmark( o );
+
+	} else if( o->validate ){
+	//Engine equilibrium check.
+		app = safeNew( QCoreApplication( argc, argv ) );
+		return runValidation( o );
+
+	} else if( o->use_gui ) {
+	//Gui, simulation on its own thread(s).
 		app = safeNew( QApplication( argc, argv ) );
 		NernstGUI gui( o );
 		gui.show();
 		return app->exec();
 
-	} else if (o->threads > 1){
-	//Multi-threaded console.
-
-		// Make room for workers.
-		worker = (class WorkerThread **)
-			 malloc( sizeof(class WorkerThread *) * nWorkers );
-
-		// Create the workers.
-		for(i=0; i<nWorkers; i++){
-			worker[i] = safeNew( WorkerThread( i, NULL ) );
-		}
-
-		// Populate the static variables.
-		worker[0]->o = o;
-		worker[0]->s = s        = safeNew( NernstSim( o ) );
-		worker[0]->inCount[0]   = worker[0]->inCount[1] = 0;
-		worker[0]->outCount[0]  = worker[0]->outCount[1]= 0;
-		worker[0]->semaphore[0] = safeNew( QSemaphore(1) );
-		worker[0]->semaphore[1] = safeNew( QSemaphore(1) );
-		worker[0]->barrier[0]   = safeNew( QSemaphore(0) );
-		worker[0]->barrier[1]   = safeNew( QSemaphore(0) );
+	} else if (o->threads > 1 && o->engine == ENGINE_CLAIM){
+	//Multi-threaded console.  Other engines run their own threads.
+		s = safeNew( NernstSim( o ) );
 
 		// Initialization.
 		s->initNernstSim();
-		s->qtime->start();
-
-		// Start the workers.
-		for(i=0; i<nWorkers; i++){
-
-			// Set indicies.
-			worker[i]->start_idx1 = (i * o->x * o->y)/nWorkers;
-			worker[i]->end_idx1   = (i * o->x * o->y)/nWorkers + (o->x * o->y)/(2 * nWorkers);
-			worker[i]->start_idx2 = (i * o->x * o->y)/nWorkers + (o->x * o->y)/(2 * nWorkers);
-			worker[i]->end_idx2   = ( (i+1) * o->x * o->y)/nWorkers; 
-
-			// Begin the thread w/ an event queue.
-			worker[i]->start();
-		}
+		uint64_t start = nowNsec();
 
-		// Wait for the workers to finish.
-		for(i=0; i<nWorkers; i++){
-			worker[i]->wait();
-		}
+		runWorkers( s, o );
 		
 		// Cleanup.
-		s->elapsed += s->qtime->elapsed() / 1000.0;
+		s->elapsed += ( nowNsec() - start ) * 1.0e-9;
 		s->completeNernstSim();
+		results.save();
 		return 0;
 
 	}else{
@@ -117,6 +106,7 @@ main( int argc, char *argv[] )
 		app = safeNew( QCoreApplication( argc, argv ) );
 		NernstSim sim( o );
 		sim.runSim();
+		results.save();
 		return 0;
 	}
 }
@@ -126,31 +116,150 @@ main( int argc, char *argv[] )
 // WorkerThread
 //===========================================================================
 
+// Run an already initialized simulation to completion on o->threads
+// worker threads and wait for them to finish.
 void
-WorkerThread::run(){
-	int i=0;
+runWorkers( NernstSim *s, struct options *o ){
+	int i;
+	int nWorkers = o->threads;
+	class WorkerThread **worker = NULL;
 
-	for(i=0; i<o->iters; i++){
-		if(id == 0){  s->moveAtoms_prep(id, id);	}
-		Barrier();
+	// Make room for workers.
+	worker = (class WorkerThread **)
+		 malloc( sizeof(class WorkerThread *) * nWorkers );
 
-		s->moveAtoms_stakeclaim( start_idx1, end_idx1 );	
-		Barrier();
-	
-		s->moveAtoms_stakeclaim( start_idx2, end_idx2 ); 
-		Barrier();
+	// Create the workers.
+	for(i=0; i<nWorkers; i++){
+		worker[i] = safeNew( WorkerThread( i, NULL ) );
+	}
 
-		s->moveAtoms_move( start_idx1, end_idx1 ); 
-		Barrier();
+	// Decide where they run.
+	if( o->affinity ){
+		int *cpus = (int *)malloc( sizeof(int) * nWorkers );
+		planAffinity( o->affinity, nWorkers, cpus );
+		for(i=0; i<nWorkers; i++){
+			worker[i]->cpu = cpus[i];
+		}
+		free( cpus );
+	}
+
+	// Populate the static variables.
+	WorkerThread::o = o;
+	WorkerThread::s = s;
+	WorkerThread::inCount[0]   = WorkerThread::inCount[1] = 0;
+	WorkerThread::outCount[0]  = WorkerThread::outCount[1]= 0;
+	WorkerThread::halt         = 0;
+	WorkerThread::semaphore[0] = safeNew( QSemaphore(1) );
+	WorkerThread::semaphore[1] = safeNew( QSemaphore(1) );
+	WorkerThread::barrier[0]   = safeNew( QSemaphore(0) );
+	WorkerThread::barrier[1]   = safeNew( QSemaphore(0) );
+
+	// Start the workers.
+	for(i=0; i<nWorkers; i++){
+
+		// Set indicies.
+		worker[i]->start_idx1 = (i * o->x * o->y)/nWorkers;
+		worker[i]->end_idx1   = (i * o->x * o->y)/nWorkers + (o->x * o->y)/(2 * nWorkers);
+		worker[i]->start_idx2 = (i * o->x * o->y)/nWorkers + (o->x * o->y)/(2 * nWorkers);
+		worker[i]->end_idx2   = ( (i+1) * o->x * o->y)/nWorkers; 
+
+		// Begin the thread w/ an event queue.
+		worker[i]->start();
+	}
 
-		s->moveAtoms_move( start_idx2, end_idx2); 
+	// Wait for the workers to finish.
+	for(i=0; i<nWorkers; i++){
+		worker[i]->wait();
+	}
+
+	// Cleanup.
+	for(i=0; i<nWorkers; i++){
+		delete worker[i];
+	}
+	free( worker );
+	for(i=0; i<2; i++){
+		delete WorkerThread::semaphore[i];
+		delete WorkerThread::barrier[i];
+	}
+}
+
+
+void
+WorkerThread::run(){
+	if( cpu >= 0 ){
+		int pinned = pinThread( cpu );
+		if( o->verbose ){
+			char where[ 128 ];
+			describeCpu( cpu, where, sizeof( where ) );
+			fprintf( stderr, "worker %d: %s%s\n", id, where,
+				 pinned ? "" : " (could not pin)" );
+		}
+	}
+
+	uint64_t t = s->phaseStart();
+
+	// Runs from wherever the simulation left off until it is done or
+	// preIter() asks to stop (the GUI pausing, say).  Thread 0 decides
+	// and everyone finds out at the first barrier.
+	for(;;){
+		if(id == 0){  
+			halt = ( s->currentIter > o->iters ) || s->preIter();
+			if( !halt ){
+				s->moveAtoms_prep(id, id);
+				s->phaseTick( id, PHASE_PREP, &t );
+			}
+		}
 		Barrier();
+		s->phaseTick( id, PHASE_BARRIER, &t );
+		if( halt ){
+			break;
+		}
+
+		if( o->atomic_claims ){
+			// One pass each over the whole slice; the edges
+			// are shared with the neighbours (see sim.cpp).
+			s->moveAtoms_stakeclaim_atomic( start_idx1, end_idx2 );
+			s->phaseTick( id, PHASE_CLAIM, &t );
+			Barrier();
+			s->phaseTick( id, PHASE_BARRIER, &t );
+
+			s->moveAtoms_move_atomic( start_idx1, end_idx2 );
+			s->phaseTick( id, PHASE_MOVE, &t );
+			Barrier();
+			s->phaseTick( id, PHASE_BARRIER, &t );
+		} else {
+			// Each half slice is longer than an ion's reach, so
+			// no two threads work next to each other at once.
+			s->moveAtoms_stakeclaim( start_idx1, end_idx1 );	
+			s->phaseTick( id, PHASE_CLAIM, &t );
+			Barrier();
+			s->phaseTick( id, PHASE_BARRIER, &t );
+	
+			s->moveAtoms_stakeclaim( start_idx2, end_idx2 ); 
+			s->phaseTick( id, PHASE_CLAIM, &t );
+			Barrier();
+			s->phaseTick( id, PHASE_BARRIER, &t );
+
+			s->moveAtoms_move( start_idx1, end_idx1 ); 
+			s->phaseTick( id, PHASE_MOVE, &t );
+			Barrier();
+			s->phaseTick( id, PHASE_BARRIER, &t );
+
+			s->moveAtoms_move( start_idx2, end_idx2); 
+			s->phaseTick( id, PHASE_MOVE, &t );
+			Barrier();
+			s->phaseTick( id, PHASE_BARRIER, &t );
+		}
 
 		if( id == 0 ){ 
 			s->moveAtoms_poretransport( id, id ); 
+			s->phaseTick( id, PHASE_TRANSPORT, &t );
+			s->postIter();
+			s->phaseTick( id, PHASE_CENSUS, &t );
 			s->currentIter++;
 		}
 		Barrier();
+		s->phaseTick( id, PHASE_BARRIER, &t );
 	}
 	
 
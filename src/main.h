@@ -24,8 +24,9 @@ class WorkerThread : public QThread {
 		// 3.  Pass param_parent along to the parent class (QThread).
 		// 4.  Set this->id = param_id.
 		int id; 
+		int cpu;	// to pin to at start (see --affinity), or -1
 		WorkerThread(int param_id, QObject *param_parent=0) : 
-			QThread( param_parent ), id( param_id ){}
+			QThread( param_parent ), id( param_id ), cpu( -1 ){}
 		
 		// This is a pure virtual function that we have to override.
 		// I think all it needs to do is call exec.
@@ -37,6 +38,7 @@ class WorkerThread : public QThread {
 		static int outCount[2];
 		static QSemaphore *semaphore[2];
 		static QSemaphore *barrier[2];
+		static int halt;	// set by thread 0 when the run should stop
 
 		static NernstSim *s;
 		static struct options *o;
@@ -45,3 +47,5 @@ class WorkerThread : public QThread {
 
 };
 
+void runWorkers( NernstSim *s, struct options *o );
+
@@ -31,7 +31,7 @@ unix:!macx {
    message( "Generating makefile for Linux systems." )
    INCLUDEPATH += /usr/include/qwt-qt4
    DEFINES += BLR_USELINUX HAVE_SSE2
-   LIBS += -lqwt-qt4
+   LIBS += -lqwt-qt4 -lrt
    QMAKE_CFLAGS += -msse2
 }
 
@@ -73,6 +73,6 @@ win32 {
 }
 
 # Input
-HEADERS += ctrl.h gui.h options.h paint.h safecalls.h sim.h status.h util.h xsim.h
-SOURCES += ctrl.cpp gui.cpp main.cpp options.cpp paint.cpp safecalls.cpp sim.cpp status.cpp xsim.cpp ../SFMT/SFMT.c
+HEADERS += affinity.h analysis.h arena.h bench.h blocked.h checkpoint.h ctrl.h frames.h gui.h hash.h options.h paint.h palette.h results.h safecalls.h sim.h statecache.h stats.h status.h sublattice.h timeseries.h timing.h trajectory.h util.h xsim.h
+SOURCES += affinity.cpp analysis.cpp arena.cpp bench.cpp blocked.cpp checkpoint.cpp ctrl.cpp frames.cpp gui.cpp main.cpp options.cpp paint.cpp palette.cpp results.cpp safecalls.cpp sim.cpp statecache.cpp stats.cpp status.cpp sublattice.cpp timeseries.cpp trajectory.cpp xsim.cpp ../SFMT/SFMT.c
 
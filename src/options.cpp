@@ -50,6 +50,42 @@ enum{
 	OPT_MEMBRANE_DIELECTRIC,
 	OPT_MEMBRANE_CAPACITACE,
 	OPT_CBOLTZ,
+	OPT_BENCH,
+	OPT_BENCH_ITERS,
+	OPT_BENCH_REPEATS,
+	OPT_BENCH_FILE,
+	OPT_BENCH_BASELINE,
+	OPT_REFRESH_RATE,
+	OPT_TRAJECTORY,
+	OPT_TRACK_RANDOM,
+	OPT_TRACK_REGION,
+	OPT_FRAME_EVERY,
+	OPT_FRAME_FILE,
+	OPT_ANALYSIS,
+	OPT_ANALYSIS_PREFIX,
+	OPT_ANALYSIS_THREADS,
+	OPT_PORE_SUMMARY,
+	OPT_EQUILIBRIUM_INIT,
+	OPT_STATE_CACHE,
+	OPT_STATE_CACHE_SIZE,
+	OPT_RESULT_CACHE,
+	OPT_RESULT_CACHE_SIZE,
+	OPT_NO_CACHE,
+	OPT_BURN_IN,
+	OPT_CHECKPOINT,
+	OPT_CHECKPOINT_EVERY,
+	OPT_CHECKPOINT_SECONDS,
+	OPT_CHECKPOINT_KEEP,
+	OPT_RESUME,
+	OPT_ENGINE,
+	OPT_BLOCK_STEPS,
+	OPT_VALIDATE,
+	OPT_VALIDATE_RUNS,
+	OPT_ATOMIC_CLAIMS,
+	OPT_AFFINITY,
+	OPT_AUTOTUNE,
+	OPT_TUNE_FILE,
+	OPT_NO_HUGE_PAGES,
 	OPT_NUM_OPTIONS_THAT_ONLY_TAKE_LONG_FORM	//bleah.
 };	
 
@@ -99,6 +135,48 @@ const char
    "-B, --pNa                 Permeability of Na. Default=0.04.",
    "-C, --pCl                 Permeability of Cl. Default=0.45.",
    "-e, --no-electrostatics   Turn off electrostatics.",
+   "--equilibrium-init         Start with the membrane already",
+   "                           charged to the GHK potential: move",
+   "                           that many ions across, into the",
+   "                           squares next to the membrane, before",
+   "                           the first iteration, so that less of",
+   "                           the run is spent getting there.",
+   "--state-cache              Directory of worlds left by earlier",
+   "                           runs.  Start from the one whose",
+   "                           world size, concentrations and seed",
+   "                           match and whose permeabilities are",
+   "                           nearest, if any, and leave this",
+   "                           run's world there at the end.",
+   "--state-cache-size         Megabytes the directory may hold   (256)",
+   "                           before the least recently used",
+   "                           worlds are removed.",
+   "--result-cache             Directory of the output files of   (nernst.results)",
+   "                           earlier console runs.  A run whose",
+   "                           options, seed and program are the",
+   "                           same as one there writes its",
+   "                           outputs from there instead of",
+   "                           running.",
+   "--result-cache-size        Megabytes the directory may hold   (256)",
+   "                           before the least recently used",
+   "                           results are removed.",
+   "--no-cache                 Always run.",
+   "--checkpoint               Write the simulation's state here",
+   "                           every --checkpoint-every iterations",
+   "                           or --checkpoint-seconds, from a",
+   "                           forked copy-on-write copy of the",
+   "                           process, so the run hardly pauses.",
+   "                           With huge pages, a write during a",
+   "                           checkpoint copies a whole page;",
+   "                           --no-huge-pages avoids that.",
+   "--checkpoint-every         Iterations between checkpoints;    (0)",
+   "                           0 for none but the timed ones.",
+   "--checkpoint-seconds       Seconds between checkpoints; 0 for (600)",
+   "                           none but --checkpoint-every's.",
+   "--checkpoint-keep          Checkpoints to keep: FILE is the   (2)",
+   "                           newest, then FILE.1, FILE.2...",
+   "--resume                   Carry on from a checkpoint, with the",
+   "                           options it was written with.  With",
+   "                           -f, static.out carries on too.",
    "-f, --output-file         Generate output files.",
    "-g, --no-gui              Don't use the GUI.",
    "-h, --help                Display this information.",
@@ -138,6 +216,132 @@ const char
    "--membrane-dielectric      Membrane dielectric (unitless)     (250)",
    "--membrane-capacitance     Membrane capacitance (F m^-2)      (see doc)", //FIXME
    "--cboltz                   Constant used in Boltzmann coef    (see doc)",
+   "",
+   "--bench                    Run the benchmark matrix (world sizes, ion",
+   "                           densities, thread counts and engines) and",
+   "                           write the results as JSON.  Threads are",
+   "                           tried in powers of 2 up to --threads, or up",
+   "                           to the number of cores if --threads is 1.",
+   "--bench-iters              Iterations per timed run.          (256)",
+   "--bench-repeats            Timed runs per case, after one     (5)",
+   "                           warm-up run.",
+   "--bench-file               Where to write the JSON results.   (bench.json)",
+   "--bench-baseline           Compare against a saved results file and",
+   "                           flag regressions.  Exits with status 1",
+   "                           if any case got slower.",
+   "",
+   "--refresh-rate             GUI redraws per second.  The       (30)",
+   "                           simulation runs as fast as it can",
+   "                           in between; 0 redraws every",
+   "                           iteration.",
+   "",
+   "--trajectory               Record the path of every tracked ion to",
+   "                           this file, one compact record per",
+   "                           iteration (see trajectory.h).  Ions are",
+   "                           tracked by clicking on them in the GUI, or",
+   "                           with the options below.",
+   "--track-random             Track this many ions of each       (0)",
+   "                           species, chosen at random.",
+   "--track-region             Track every ion in the rectangle",
+   "                           X0,Y0,X1,Y1 (lattice squares, inclusive).",
+   "",
+   "--frame-every              Save a picture of the world every  (0)",
+   "                           this many iterations, colored as in",
+   "                           the GUI.  Works without a display.",
+   "--frame-file               Where to save them.  A name with a (frame%06d.png)",
+   "                           %d in it gets one PNG per frame,",
+   "                           numbered by iteration; any other name,",
+   "                           or - for standard output, gets all of",
+   "                           them as a stream of binary PPM images",
+   "                           for piping to an encoder.",
+   "",
+   "--analysis                 Analysis stages to run, and every how",
+   "                           many iterations, as stage:every,...",
+   "                           census writes the static.out columns;",
+   "                           profile, each species' concentration",
+   "                           (mM) in every column; columns, the",
+   "                           same as raw counts in a compact",
+   "                           binary file (see analysis.cpp), cheap",
+   "                           enough to take every few iterations;",
+   "                           flux, the net",
+   "                           ions of each species that crossed left",
+   "                           to right since the last snapshot;",
+   "                           current, the crossings through all",
+   "                           pores in each direction and the net",
+   "                           current, per iteration; channels, the",
+   "                           net charge each pore carried.  The",
+   "                           stages run on threads of their own and",
+   "                           never hold up the simulation.",
+   "--analysis-prefix          Start of each stage's output file  (analysis_)",
+   "                           name; census writes",
+   "                           analysis_census.dat, and so on.",
+   "--analysis-threads         Threads to run the stages on.      (2)",
+   "--pore-summary             At the end of the run, write each",
+   "                           pore's crossings by species and",
+   "                           direction, and the net charge it",
+   "                           carried, to this file.",
+   "--burn-in                  Iterations to leave out of the     (0)",
+   "                           mean membrane potential, its",
+   "                           standard error and autocorrelation",
+   "                           time, which -f writes to stats.out",
+   "                           and -p prints.",
+   "",
+   "--engine                   How to step the world.  claim      (claim)",
+   "                           sweeps the whole world once per",
+   "                           phase per iteration; blocked",
+   "                           advances cache-sized tiles several",
+   "                           iterations at a time, with exactly",
+   "                           the same results, console runs",
+   "                           only; sublattice moves ions on",
+   "                           interleaved sublattices with no",
+   "                           claim pass, on one thread.  Its",
+   "                           dynamics differ but its equilibrium",
+   "                           should not (see --validate).",
+   "--block-steps              Iterations per tile for blocked.   (4)",
+   "                           1 with --trajectory.",
+   "--atomic-claims            With claim and --threads, have each",
+   "                           thread claim and move over its whole",
+   "                           slice in one pass, using atomic",
+   "                           increments where slices meet, rather",
+   "                           than in two half passes.  4 barriers",
+   "                           per iteration instead of 6; same",
+   "                           results.",
+   "--affinity                 Pin each worker thread to a CPU:",
+   "                           compact fills one core's hardware",
+   "                           threads before the next; scatter",
+   "                           puts one worker on every core, across",
+   "                           packages, before doubling up;",
+   "                           physical uses one hardware thread per",
+   "                           core only; or a CPU list like",
+   "                           0,2,4-7.  -v reports where each",
+   "                           worker landed.  Default: not pinned.",
+   "--autotune                 Time short bursts of this world with",
+   "                           each thread count (powers of 2 up to",
+   "                           the number of cores) and each engine",
+   "                           that gives the same results as claim,",
+   "                           then run with the fastest.  The",
+   "                           choice is saved in --tune-file for",
+   "                           this machine, world size and ion",
+   "                           counts, and reused without timing",
+   "                           next time.  Overrides --threads,",
+   "                           --engine, --block-steps and",
+   "                           --atomic-claims.",
+   "--tune-file                Where autotune choices are kept.   (nernst.tune)",
+   "--no-huge-pages            Keep the lattice on ordinary pages.",
+   "                           By default worlds of 2 MB or more ask",
+   "                           for huge pages, explicit if any are",
+   "                           reserved, else transparent; -v",
+   "                           reports what the kernel provided.",
+   "--validate                 Check that every engine reaches the",
+   "                           claim engine's equilibrium membrane",
+   "                           potential: run each --validate-runs",
+   "                           times from different seeds, average",
+   "                           the potential over the second half",
+   "                           of each run, and compare the means.",
+   "                           Exits with status 1 on a mismatch.",
+   "                           atomic runs with --threads, at",
+   "                           least 2.",
+   "--validate-runs            Runs per engine.                   (8)",
    NULL
 };
 
@@ -190,6 +394,17 @@ set_defaults( struct options *o )
    o->pCl            = 0.45;
    o->selectivity    = 1;
    o->electrostatics = 1;
+   o->huge_pages     = 1;
+   o->equilibrium_init = 0;
+   o->state_cache    = NULL;
+   o->state_cache_mb = 256;
+   o->result_cache   = (char*)"nernst.results";
+   o->result_cache_mb = 256;
+   o->checkpoint     = NULL;
+   o->checkpoint_every = 0;
+   o->checkpoint_seconds = 600;
+   o->checkpoint_keep = 2;
+   o->resume         = NULL;
 
    o->use_gui        = 1;
    o->sleep          = 0;
@@ -199,10 +414,36 @@ set_defaults( struct options *o )
    o->help           = 0;
    o->version        = 0;
    o->threads        = 1;
+   o->engine         = ENGINE_CLAIM;
+   o->block_steps    = 4;
+   o->atomic_claims  = 0;
+   o->affinity       = NULL;
+   o->autotune       = 0;
+   o->tune_file      = (char*)"nernst.tune";
+   o->validate       = 0;
+   o->validate_runs  = 8;
 
    o->profiling      = 0;
    o->progress       = 0;
    o->output_file    = 0;
+   o->trajectory_file = NULL;
+   o->track_random   = 0;
+   o->track_region[ 0 ] = o->track_region[ 1 ] = -1;
+   o->track_region[ 2 ] = o->track_region[ 3 ] = -1;
+   o->frame_every    = 0;
+   o->frame_file     = (char*)"frame%06d.png";
+   o->analysis       = NULL;
+   o->analysis_prefix= (char*)"analysis_";
+   o->analysis_threads = 2;
+   o->pore_summary   = NULL;
+   o->burn_in        = 0;
+
+   o->bench          = 0;
+   o->bench_iters    = 256;
+   o->bench_repeats  = 5;
+   o->bench_file     = (char*)"bench.json";
+   o->bench_baseline = NULL;
+   o->refresh_rate   = 30;
 
    o->e 	= 1.60218e-19;     // Elementary charge (C)
    o->k 	= 1.38056e-23;     // Boltzmann's constant (J K^-1)
@@ -239,6 +480,17 @@ dump_options( struct options *o )
    fprintf( stderr, "pCl =            %f\n", o->pCl );
    fprintf( stderr, "selectivity =    %d\n", o->selectivity );
    fprintf( stderr, "electrostatics = %d\n", o->electrostatics );
+   fprintf( stderr, "huge_pages =     %d\n", o->huge_pages );
+   fprintf( stderr, "equilibrium_init=%d\n", o->equilibrium_init );
+   fprintf( stderr, "state_cache =    %s\n", o->state_cache ? o->state_cache : "(none)" );
+   fprintf( stderr, "state_cache_mb = %d\n", o->state_cache_mb );
+   fprintf( stderr, "result_cache =   %s\n", o->result_cache ? o->result_cache : "(none)" );
+   fprintf( stderr, "result_cache_mb = %d\n", o->result_cache_mb );
+   fprintf( stderr, "checkpoint =     %s\n", o->checkpoint ? o->checkpoint : "(none)" );
+   fprintf( stderr, "checkpoint_every=%d\n", o->checkpoint_every );
+   fprintf( stderr, "checkpoint_seconds=%d\n", o->checkpoint_seconds );
+   fprintf( stderr, "checkpoint_keep= %d\n", o->checkpoint_keep );
+   fprintf( stderr, "resume =         %s\n", o->resume ? o->resume : "(none)" );
 
    fprintf( stderr, "use_gui =        %d\n", o->use_gui );
    fprintf( stderr, "sleep =          %d\n", o->sleep );
@@ -248,10 +500,36 @@ dump_options( struct options *o )
    fprintf( stderr, "help =           %d\n", o->help );
    fprintf( stderr, "version =        %d\n", o->version );
    fprintf( stderr, "threads =        %d\n", o->threads );
+   fprintf( stderr, "engine =         %s\n", o->engine == ENGINE_BLOCKED ? "blocked" :
+            o->engine == ENGINE_SUBLATTICE ? "sublattice" : "claim" );
+   fprintf( stderr, "block_steps =    %d\n", o->block_steps );
+   fprintf( stderr, "atomic_claims =  %d\n", o->atomic_claims );
+   fprintf( stderr, "affinity =       %s\n", o->affinity ? o->affinity : "(none)" );
+   fprintf( stderr, "autotune =       %d\n", o->autotune );
+   fprintf( stderr, "tune_file =      %s\n", o->tune_file );
+   fprintf( stderr, "validate =       %d\n", o->validate );
+   fprintf( stderr, "validate_runs =  %d\n", o->validate_runs );
 
    fprintf( stderr, "progress =       %d\n", o->progress );
    fprintf( stderr, "profiling =      %d\n", o->profiling );
    fprintf( stderr, "output_file =    %d\n", o->output_file );
+   fprintf( stderr, "trajectory_file = %s\n", o->trajectory_file ? o->trajectory_file : "(none)" );
+   fprintf( stderr, "track_random =   %d\n", o->track_random );
+   fprintf( stderr, "track_region =   %d,%d,%d,%d\n", o->track_region[ 0 ], o->track_region[ 1 ],
+            o->track_region[ 2 ], o->track_region[ 3 ] );
+   fprintf( stderr, "frame_every =    %d\n", o->frame_every );
+   fprintf( stderr, "frame_file =     %s\n", o->frame_file );
+   fprintf( stderr, "analysis =       %s\n", o->analysis ? o->analysis : "(none)" );
+   fprintf( stderr, "analysis_prefix= %s\n", o->analysis_prefix );
+   fprintf( stderr, "analysis_threads=%d\n", o->analysis_threads );
+   fprintf( stderr, "pore_summary =   %s\n", o->pore_summary ? o->pore_summary : "(none)" );
+   fprintf( stderr, "burn_in =        %d\n", o->burn_in );
+   fprintf( stderr, "bench =          %d\n", o->bench );
+   fprintf( stderr, "bench_iters =    %d\n", o->bench_iters );
+   fprintf( stderr, "bench_repeats =  %d\n", o->bench_repeats );
+   fprintf( stderr, "bench_file =     %s\n", o->bench_file );
+   fprintf( stderr, "bench_baseline = %s\n", o->bench_baseline ? o->bench_baseline : "(none)" );
+   fprintf( stderr, "refresh_rate =   %d\n", o->refresh_rate );
    fprintf( stderr, "---------------------------------------------------------------------------\n" );
    fprintf( stderr, "elementary-charge     %lf\n", o->e		);
    fprintf( stderr, "boltzmann		 %lf\n", o->k		);
@@ -316,6 +594,42 @@ parseOptions(int argc, char **argv)
       { "membrane-dielectric",  	1, 0, OPT_MEMBRANE_DIELECTRIC},
       { "membrane-capacitance", 	1, 0, OPT_MEMBRANE_CAPACITACE},
       { "cboltz",               	1, 0, OPT_CBOLTZ},
+      { "bench",                	0, 0, OPT_BENCH},
+      { "bench-iters",          	1, 0, OPT_BENCH_ITERS},
+      { "bench-repeats",        	1, 0, OPT_BENCH_REPEATS},
+      { "bench-file",           	1, 0, OPT_BENCH_FILE},
+      { "bench-baseline",       	1, 0, OPT_BENCH_BASELINE},
+      { "refresh-rate",         	1, 0, OPT_REFRESH_RATE},
+      { "trajectory",           	1, 0, OPT_TRAJECTORY},
+      { "track-random",         	1, 0, OPT_TRACK_RANDOM},
+      { "track-region",         	1, 0, OPT_TRACK_REGION},
+      { "frame-every",          	1, 0, OPT_FRAME_EVERY},
+      { "frame-file",           	1, 0, OPT_FRAME_FILE},
+      { "analysis",             	1, 0, OPT_ANALYSIS},
+      { "analysis-prefix",      	1, 0, OPT_ANALYSIS_PREFIX},
+      { "analysis-threads",     	1, 0, OPT_ANALYSIS_THREADS},
+      { "pore-summary",         	1, 0, OPT_PORE_SUMMARY},
+      { "equilibrium-init",     	0, 0, OPT_EQUILIBRIUM_INIT},
+      { "state-cache",          	1, 0, OPT_STATE_CACHE},
+      { "state-cache-size",     	1, 0, OPT_STATE_CACHE_SIZE},
+      { "result-cache",         	1, 0, OPT_RESULT_CACHE},
+      { "result-cache-size",    	1, 0, OPT_RESULT_CACHE_SIZE},
+      { "no-cache",             	0, 0, OPT_NO_CACHE},
+      { "burn-in",              	1, 0, OPT_BURN_IN},
+      { "checkpoint",           	1, 0, OPT_CHECKPOINT},
+      { "checkpoint-every",     	1, 0, OPT_CHECKPOINT_EVERY},
+      { "checkpoint-seconds",   	1, 0, OPT_CHECKPOINT_SECONDS},
+      { "checkpoint-keep",      	1, 0, OPT_CHECKPOINT_KEEP},
+      { "resume",               	1, 0, OPT_RESUME},
+      { "engine",               	1, 0, OPT_ENGINE},
+      { "block-steps",          	1, 0, OPT_BLOCK_STEPS},
+      { "validate",             	0, 0, OPT_VALIDATE},
+      { "atomic-claims",        	0, 0, OPT_ATOMIC_CLAIMS},
+      { "affinity",             	1, 0, OPT_AFFINITY},
+      { "autotune",             	0, 0, OPT_AUTOTUNE},
+      { "tune-file",            	1, 0, OPT_TUNE_FILE},
+      { "no-huge-pages",        	0, 0, OPT_NO_HUGE_PAGES},
+      { "validate-runs",        	1, 0, OPT_VALIDATE_RUNS},
       { 0,                   0, 0,  0  }
    };
 
@@ -453,6 +767,149 @@ parseOptions(int argc, char **argv)
 	 case OPT_CBOLTZ:
             options->cBoltz = safeStrtod( optarg );
 	    break;
+	 case OPT_BENCH:
+            options->bench = 1;
+	    break;
+	 case OPT_BENCH_ITERS:
+            options->bench_iters = safeStrtol( optarg );
+	    break;
+	 case OPT_BENCH_REPEATS:
+            options->bench_repeats = safeStrtol( optarg );
+	    break;
+	 case OPT_BENCH_FILE:
+            options->bench_file = optarg;
+	    break;
+	 case OPT_BENCH_BASELINE:
+            options->bench_baseline = optarg;
+	    break;
+	 case OPT_REFRESH_RATE:
+            options->refresh_rate = safeStrtol( optarg );
+	    break;
+	 case OPT_TRAJECTORY:
+            options->trajectory_file = optarg;
+	    break;
+	 case OPT_TRACK_RANDOM:
+            options->track_random = safeStrtol( optarg );
+	    break;
+	 case OPT_TRACK_REGION:
+            if( sscanf( optarg, "%d,%d,%d,%d", &options->track_region[ 0 ], &options->track_region[ 1 ],
+                        &options->track_region[ 2 ], &options->track_region[ 3 ] ) != 4 ||
+                options->track_region[ 0 ] < 0 )
+            {
+               fprintf( stderr, "--track-region takes X0,Y0,X1,Y1.\n" );
+               exit( -1 );
+            }
+	    break;
+	 case OPT_FRAME_EVERY:
+            options->frame_every = safeStrtol( optarg );
+	    break;
+	 case OPT_FRAME_FILE:
+            options->frame_file = optarg;
+	    break;
+	 case OPT_ANALYSIS:
+            options->analysis = optarg;
+	    break;
+	 case OPT_ANALYSIS_PREFIX:
+            options->analysis_prefix = optarg;
+	    break;
+	 case OPT_ANALYSIS_THREADS:
+            options->analysis_threads = safeStrtol( optarg );
+	    break;
+	 case OPT_PORE_SUMMARY:
+            options->pore_summary = optarg;
+	    break;
+	 case OPT_EQUILIBRIUM_INIT:
+            options->equilibrium_init = 1;
+	    break;
+	 case OPT_STATE_CACHE:
+            options->state_cache = optarg;
+	    break;
+	 case OPT_STATE_CACHE_SIZE:
+            options->state_cache_mb = safeStrtol( optarg );
+            if( options->state_cache_mb < 1 )
+            {
+               fprintf( stderr, "--state-cache-size must be at least 1.\n" );
+               exit( -1 );
+            }
+	    break;
+	 case OPT_RESULT_CACHE:
+            options->result_cache = optarg;
+	    break;
+	 case OPT_RESULT_CACHE_SIZE:
+            options->result_cache_mb = safeStrtol( optarg );
+            if( options->result_cache_mb < 1 )
+            {
+               fprintf( stderr, "--result-cache-size must be at least 1.\n" );
+               exit( -1 );
+            }
+	    break;
+	 case OPT_NO_CACHE:
+            options->result_cache = NULL;
+	    break;
+	 case OPT_BURN_IN:
+            options->burn_in = safeStrtol( optarg );
+	    break;
+	 case OPT_CHECKPOINT:
+            options->checkpoint = optarg;
+	    break;
+	 case OPT_CHECKPOINT_EVERY:
+            options->checkpoint_every = safeStrtol( optarg );
+	    break;
+	 case OPT_CHECKPOINT_SECONDS:
+            options->checkpoint_seconds = safeStrtol( optarg );
+	    break;
+	 case OPT_CHECKPOINT_KEEP:
+            options->checkpoint_keep = safeStrtol( optarg );
+            if( options->checkpoint_keep < 1 )
+            {
+               options->checkpoint_keep = 1;
+            }
+	    break;
+	 case OPT_RESUME:
+            options->resume = optarg;
+	    break;
+	 case OPT_ENGINE:
+            if( !strcmp( optarg, "claim" ) )
+            {
+               options->engine = ENGINE_CLAIM;
+            } else if( !strcmp( optarg, "blocked" ) ) {
+               options->engine = ENGINE_BLOCKED;
+            } else if( !strcmp( optarg, "sublattice" ) ) {
+               options->engine = ENGINE_SUBLATTICE;
+            } else {
+               fprintf( stderr, "--engine must be claim, blocked or sublattice.\n" );
+               exit( -1 );
+            }
+	    break;
+	 case OPT_BLOCK_STEPS:
+            options->block_steps = safeStrtol( optarg );
+            if( options->block_steps < 1 )
+            {
+               fprintf( stderr, "--block-steps must be at least 1.\n" );
+               exit( -1 );
+            }
+	    break;
+	 case OPT_VALIDATE:
+            options->validate = 1;
+	    break;
+	 case OPT_ATOMIC_CLAIMS:
+            options->atomic_claims = 1;
+	    break;
+	 case OPT_AFFINITY:
+            options->affinity = optarg;
+	    break;
+	 case OPT_AUTOTUNE:
+            options->autotune = 1;
+	    break;
+	 case OPT_TUNE_FILE:
+            options->tune_file = optarg;
+	    break;
+	 case OPT_NO_HUGE_PAGES:
+            options->huge_pages = 0;
+	    break;
+	 case OPT_VALIDATE_RUNS:
+            options->validate_runs = safeStrtol( optarg );
+	    break;
          default:
             fprintf( stderr, "Unknown option.  Try --help for a full list.\n" );
             exit( -1 );
@@ -32,6 +32,14 @@ extern "C" {
 
 class NernstSim;
 
+// Stepping engines, selected with --engine.
+enum
+{
+   ENGINE_CLAIM = 0,    // claim and move over the whole world, one iteration at a time
+   ENGINE_BLOCKED,      // several iterations per cache-sized tile (see blocked.h)
+   ENGINE_SUBLATTICE    // interleaved sublattices, no claim pass (see sublattice.h)
+};
+
 struct options
 {
    // sim ptr.
@@ -56,11 +64,26 @@ struct options
    double pCl;          // --pCl[=0.45]
    int selectivity;     // --selectivity[=1]
    int electrostatics;  // --electrostatics[=1]
+   int huge_pages;      // --no-huge-pages  Lattice buffers on ordinary pages.
+   int equilibrium_init;// --equilibrium-init  Start the membrane charged.
+   char *state_cache;   // --state-cache[=none]  Directory of equilibrated
+                        //                       worlds (statecache.h).
+   int state_cache_mb;  // --state-cache-size[=256]  Megabytes it may hold.
+   char *result_cache;  // --result-cache[=nernst.results]  Outputs of earlier
+                        //   identical runs (results.h); NULL with --no-cache.
+   int result_cache_mb; // --result-cache-size[=256]  Megabytes it may hold.
+   char *checkpoint;    // --checkpoint[=none]  Where to write checkpoints
+                        //                      (checkpoint.h).
+   int checkpoint_every;   // --checkpoint-every[=0]  Iterations between them.
+   int checkpoint_seconds; // --checkpoint-seconds[=600]  Seconds between them.
+   int checkpoint_keep;    // --checkpoint-keep[=2]  How many to keep.
+   char *resume;        // --resume[=none]  Checkpoint to carry on from.
 
    // gui options
    int use_gui;         // --[no-]gui
    int sleep;           // --sleep[=0]    How many seconds to sleep
                         //                between each iteration.
+   int refresh_rate;    // --refresh-rate[=30]  Redraws per second.
 
    // housekeeping
    int randseed;
@@ -68,11 +91,41 @@ struct options
    int help;
    int version;
    int threads;         // --threads[=1]
+   int engine;          // --engine[=claim]
+   int block_steps;     // --block-steps[=4]  Iterations per tile for
+                        //                    --engine=blocked.
+   int atomic_claims;   // --atomic-claims  One claim and one move pass
+                        //                  per thread per iteration.
+   char *affinity;      // --affinity[=none]  compact, scatter, physical
+                        //                    or a CPU list (affinity.h).
+   int autotune;        // --autotune  Pick threads and engine by timing.
+   char *tune_file;     // --tune-file[=nernst.tune]  Decisions made so far.
 
    // runtime options
    int profiling;
    int progress;
    int output_file;
+   char *trajectory_file;  // --trajectory[=none]  Record tracked ions' paths.
+   int track_random;       // --track-random[=0]   Ions of each species to track.
+   int track_region[ 4 ];  // --track-region=X0,Y0,X1,Y1  Track every ion in
+                           //                 the rectangle.  X0 < 0 if unset.
+   int frame_every;        // --frame-every[=0]   Iterations between images.
+   char *frame_file;       // --frame-file[=frame%06d.png]
+   char *analysis;         // --analysis[=none]  stage:every,...  See analysis.h.
+   char *analysis_prefix;  // --analysis-prefix[=analysis_]  Output file names.
+   int analysis_threads;   // --analysis-threads[=2]
+   char *pore_summary;     // --pore-summary[=none]  Per-pore crossings at the end.
+   int burn_in;            // --burn-in[=0]  Iterations left out of the
+                           //                potential's mean (stats.h).
+
+   // benchmark options
+   int bench;           // --bench
+   int bench_iters;     // --bench-iters[=256]
+   int bench_repeats;   // --bench-repeats[=5]
+   char *bench_file;    // --bench-file[=bench.json]
+   char *bench_baseline;// --bench-baseline[=none]
+   int validate;        // --validate
+   int validate_runs;   // --validate-runs[=8]
 
 	// constants
    double e;		//= 1.60218e-19;     // Elementary charge (C)
@@ -26,12 +26,27 @@
 #include <QApplication>
 #include <QMouseEvent>
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SFMT.h>
 
 
 #include "paint.h"
 #include "options.h"
+#include "palette.h"
 #include "sim.h"
+#include "xsim.h"
+
+// Older GL headers (notably Windows') stop at OpenGL 1.1.
+#ifndef GL_BGRA
+#define GL_BGRA 0x80E1
+#endif
+#ifndef GL_UNSIGNED_INT_8_8_8_8_REV
+#define GL_UNSIGNED_INT_8_8_8_8_REV 0x8367
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
 
 
 NernstPainter::NernstPainter( struct options *options, int zoomOn, QWidget *parent ) 
@@ -39,9 +54,21 @@ NernstPainter::NernstPainter( struct options *options, int zoomOn, QWidget *pare
 {
    o = options;
    s = o->s;
+   sim = static_cast<XNernstSim *>( s );   // the GUI's simulation is always one
    running = 0;
    zoom = zoomOn;
 
+   texture   = 0;
+   texW      = 0;
+   texH      = 0;
+   image     = NULL;
+   imageSz   = 0;
+   tracked   = NULL;
+   trackedSz = 0;
+   nTracked  = 0;
+   preview   = NULL;
+   previewSz = 0;
+
    s->shufflePositions( o );
  
    setFormat( QGLFormat( QGL::DoubleBuffer | QGL::DepthBuffer ) );
@@ -61,6 +88,19 @@ NernstPainter::NernstPainter( struct options *options, int zoomOn, QWidget *pare
 }
 
 
+NernstPainter::~NernstPainter()
+{
+   if( texture )
+   {
+      makeCurrent();
+      glDeleteTextures( 1, &texture );
+   }
+   free( image );
+   free( tracked );
+   free( preview );
+}
+
+
 void
 NernstPainter::adjustPaintRegion()
 {
@@ -123,7 +163,7 @@ NernstPainter::zoomOut()
 void
 NernstPainter::mousePressEvent( QMouseEvent *event )
 {
-   int mouseX, mouseY, x, y;
+   int mouseX, mouseY;
    mouseX = event->x() * ( zoomXRange ) / ( zoomXWindow ) + minX;
    mouseY = ( zoomYWindow - 1 - event->y() ) * ( zoomYRange ) / ( zoomYWindow ) + minY;
 
@@ -135,48 +175,9 @@ NernstPainter::mousePressEvent( QMouseEvent *event )
       event->accept();
    }
 
-   x = mouseX;
-   y = mouseY;
-
-   if( !s->isUntrackedAtom( s->idx( x, y ) ) )
-   {
-      int offset = 1, done = 0;
-      double offsetMax = 5.0 * (double)zoomXWindow / (double)zoomXRange;
-
-      while( !done && offset < offsetMax )
-      {
-         for( x = mouseX - offset; x <= mouseX + offset && !done; x++ )
-         {
-            for( y = mouseY - offset; y <= mouseY + offset && !done; y++ )
-            {
-               if( s->isUntrackedAtom( s->idx( x, y ) ) )
-               {
-                  done = 1;
-               }
-            }
-         }
-         offset++;
-      }
-      x--;
-      y--;
-   }
-
-
-   switch( s->world[ s->idx( x, y ) ].color )
-   {
-      case ATOM_K:
-         s->world[ s->idx( x, y ) ].color = ATOM_K_TRACK;
-         break;
-      case ATOM_Na:
-         s->world[ s->idx( x, y ) ].color = ATOM_Na_TRACK;
-         break;
-      case ATOM_Cl:
-         s->world[ s->idx( x, y ) ].color = ATOM_Cl_TRACK;
-         break;
-      default:
-         event->ignore();
-         break;
-   }
+   // The simulation finds the nearest ion and marks it, between iterations
+   // if it is running.
+   sim->trackIon( mouseX, mouseY, 5.0 * (double)zoomXWindow / (double)zoomXRange );
 
    emit ionMarked();
 }
@@ -207,6 +208,16 @@ NernstPainter::initializeGL()
    glShadeModel( GL_FLAT );
    glEnable( GL_DEPTH_TEST );
    glEnable( GL_CULL_FACE );
+
+   // The world is drawn as a single texture, one texel per lattice square.
+   glGenTextures( 1, &texture );
+   glBindTexture( GL_TEXTURE_2D, texture );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+   glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE );
+   texW = texH = 0;
 }
 
 
@@ -235,6 +246,23 @@ void
 NernstPainter::draw()
 {
    adjustPaintRegion();
+   buildPalette( palette, o->electrostatics, o->selectivity );
+   nTracked = 0;
+
+   // One texel per lattice square in view; grow the buffer if zoomed out.
+   if( zoomXRange * zoomYRange > imageSz )
+   {
+      imageSz = zoomXRange * zoomYRange;
+      image = (uint32_t *)realloc( image, imageSz * sizeof( uint32_t ) );
+      assert( image );
+   }
+
+   if( running )
+   {
+      drawWorld();
+   } else {
+      drawPreview();
+   }
 
    glMatrixMode( GL_MODELVIEW );
    glLoadIdentity();
@@ -243,389 +271,281 @@ NernstPainter::draw()
    glRotatef( rotationY, 0.0, 1.0, 0.0 );
    glRotatef( rotationZ, 0.0, 0.0, 1.0 );
 
-   double xWindowPerLatticeSquare = 1.0 / (double)zoomXRange;
-   double yWindowPerLatticeSquare = 1.0 / (double)zoomYRange;
-
-   double atomDiameterX        = 1.0 * xWindowPerLatticeSquare;      // in percentage of the window
-   double atomDiameterY        = 1.0 * yWindowPerLatticeSquare;      // in percentage of the window
-   double atomRadiusX          = atomDiameterX / 2.0;                // in percentage of the window
-   double atomRadiusY          = atomDiameterY / 2.0;                // in percentage of the window
-
-   double trackedAtomDiameterX = 5.0 * xWindowPerLatticeSquare;      // in percentage of the window
-   double trackedAtomDiameterY = 5.0 * yWindowPerLatticeSquare;      // in percentage of the window
-   double trackedAtomRadiusX   = trackedAtomDiameterX / 2.0;         // in percentage of the window
-   double trackedAtomRadiusY   = trackedAtomDiameterY / 2.0;         // in percentage of the window
-
-   // Realtime world visualization
-   if( running )
+   // Upload the frame into the corner of the texture.  GL before 2.0
+   // only takes power of 2 sizes, so the texture is the next power of 2
+   // up from the view, and is reallocated only when the view outgrows it.
+   glBindTexture( GL_TEXTURE_2D, texture );
+   glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+   if( texW < zoomXRange || texH < zoomYRange )
    {
-      glBegin( GL_POINTS );
+      for( texW = 1; texW < zoomXRange; texW *= 2 );
+      for( texH = 1; texH < zoomYRange; texH *= 2 );
+      glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, texW, texH, 0,
+                    GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL );
+   }
+   glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, zoomXRange, zoomYRange,
+                    GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, image );
+   GLfloat s1 = (GLfloat)zoomXRange / texW;
+   GLfloat t1 = (GLfloat)zoomYRange / texH;
+
+   // Lattice square (x,y) is centered at ( x - minX + 1, y - minY + 1 ) / range
+   // in window coordinates.
+   GLfloat x0 = (GLfloat)( 0.5 / (double)zoomXRange );
+   GLfloat y0 = (GLfloat)( 0.5 / (double)zoomYRange );
+   GLfloat x1 = (GLfloat)( ( zoomXRange + 0.5 ) / (double)zoomXRange );
+   GLfloat y1 = (GLfloat)( ( zoomYRange + 0.5 ) / (double)zoomYRange );
+
+   glEnable( GL_TEXTURE_2D );
+   glColor3f( 1.f, 1.f, 1.f );
+   glBegin( GL_QUADS );
+   glTexCoord2f( 0.f, 0.f ); glVertex3f( x0, y0, (GLfloat)0.0 );
+   glTexCoord2f( s1,  0.f ); glVertex3f( x1, y0, (GLfloat)0.0 );
+   glTexCoord2f( s1,  t1  ); glVertex3f( x1, y1, (GLfloat)0.0 );
+   glTexCoord2f( 0.f, t1  ); glVertex3f( x0, y1, (GLfloat)0.0 );
+   glEnd();
+   glDisable( GL_TEXTURE_2D );
+
+   // Tracked ions are drawn five lattice squares wide on top of the world.
+   if( nTracked )
+   {
+      double trackedAtomRadiusX = 2.5 / (double)zoomXRange;
+      double trackedAtomRadiusY = 2.5 / (double)zoomYRange;
 
-      for( int y = minY; y < maxY; y++ )
+      glBegin( GL_QUADS );
+      for( int i = 0; i < nTracked; i++ )
       {
-         for( int x = minX; x < maxX; x++ )
-         {
-            if( x >= 0 && x < o->x && y >= 0 && y < o->y )
-            {
-               int tracked = 0;
-
-               switch( s->world[ s->idx( x, y ) ].color )
-               {
-                  case SOLVENT:
-                     continue;
-                  case ATOM_K:
-                     if( o->electrostatics )
-                     {
-                        glColor3f( 1.f, 0.15f, 0.f );    // Red
-                     } else {
-                        glColor3f( 1.f, 0.64f, 0.57f );  // Pale red
-                     }
-                     break;
-                  case ATOM_Na:
-                     if( o->electrostatics )
-                     {
-                        glColor3f( 0.f, 0.f, 1.f );      // Blue
-                     } else {
-                        glColor3f( 0.57f, 0.57f, 1.f );  // Pale blue
-                     }
-                     break;
-                  case ATOM_Cl:
-                     if( o->electrostatics )
-                     {
-                        glColor3f( 0.f, 0.70f, 0.35f );  // Green
-                     } else {
-                        glColor3f( 0.57f, 0.87f, 0.72f );// Pale green
-                     }
-                     break;
-                  case ATOM_K_TRACK:
-                     glColor3f( 1.f, 0.15f, 0.f );    // Red
-                     tracked = 1;
-                     break;
-                  case ATOM_Na_TRACK:
-                     glColor3f( 0.f, 0.f, 1.f );      // Blue
-                     tracked = 1;
-                     break;
-                  case ATOM_Cl_TRACK:
-                     glColor3f( 0.f, 0.70f, 0.35f );  // Green
-                     tracked = 1;
-                     break;
-                  case PORE_K:
-                     if( o->selectivity )
-                     {
-                        glColor3f( 1.f, 0.64f, 0.57f );  // Pale red
-                     } else {
-                        glColor3f( 1.f, 1.f, 1.f );      // White
-                     }
-                     break;
-                  case PORE_Na:
-                     if( o->selectivity )
-                     {
-                        glColor3f( 0.57f, 0.57f, 1.f );  // Pale blue
-                     } else {
-                        glColor3f( 1.f, 1.f, 1.f );      // White
-                     }
-                     break;
-                  case PORE_Cl:
-                     if( o->selectivity )
-                     {
-                        glColor3f( 0.57f, 0.87f, 0.72f );// Pale green
-                     } else {
-                        glColor3f( 1.f, 1.f, 1.f );      // White
-                     }
-                     break;
-                  case MEMBRANE:
-                     glColor3f( 0.f, 0.f, 0.f );      // Black
-                     break;
-                  default:
-                     glColor3f( 1.f, 1.f, 1.f );      // White
-                     break;
-               }
-
-               if( tracked )
-               {
-                  // Tracked ions
-                  for( double xOff = -trackedAtomRadiusX; xOff < trackedAtomRadiusX; xOff += 1.0 / (double)zoomXWindow )
-                  {
-                     for( double yOff = -trackedAtomRadiusY; yOff < trackedAtomRadiusY; yOff += 1.0 / (double)zoomYWindow )
-                     {
-                        glVertex3f( (GLfloat)( ( x - minX + 1 ) / (double)zoomXRange + xOff ),
-                                    (GLfloat)( ( y - minY + 1 ) / (double)zoomYRange + yOff ),
-                                    (GLfloat)0.0 );
-                     }
-                  }
-               } else {
-                  // Nontracked ions
-                  for( double xOff = -atomRadiusX; xOff < atomRadiusX; xOff += 1.0 / (double)zoomXWindow )
-                  {
-                     for( double yOff = -atomRadiusY; yOff < atomRadiusY; yOff += 1.0 / (double)zoomYWindow )
-                     {
-                        glVertex3f( (GLfloat)( ( x + 1 - minX ) / (double)zoomXRange + xOff ),
-                                    (GLfloat)( ( y + 1 - minY ) / (double)zoomYRange + yOff ),
-                                    (GLfloat)0.0 );
-                     }
-                  }
-               }
-            }
-         }
+         int x = tracked[ i ] % zoomXRange;
+         int y = tracked[ i ] / zoomXRange;
+         double cx = ( x + 1 ) / (double)zoomXRange;
+         double cy = ( y + 1 ) / (double)zoomYRange;
+         uint32_t c = image[ tracked[ i ] ];
+
+         glColor3ub( ( c >> 16 ) & 0xff, ( c >> 8 ) & 0xff, c & 0xff );
+         glVertex3f( (GLfloat)( cx - trackedAtomRadiusX ), (GLfloat)( cy - trackedAtomRadiusY ), (GLfloat)0.01 );
+         glVertex3f( (GLfloat)( cx + trackedAtomRadiusX ), (GLfloat)( cy - trackedAtomRadiusY ), (GLfloat)0.01 );
+         glVertex3f( (GLfloat)( cx + trackedAtomRadiusX ), (GLfloat)( cy + trackedAtomRadiusY ), (GLfloat)0.01 );
+         glVertex3f( (GLfloat)( cx - trackedAtomRadiusX ), (GLfloat)( cy + trackedAtomRadiusY ), (GLfloat)0.01 );
       }
       glEnd();
+   }
+}
 
-   } else {
-      // World preview visualization
-      glBegin( GL_POINTS );
-      int numK, numNa, numCl;
-      unsigned int *posK, *posNa, *posCl;
-      int placed = 0, x, y, i;
-
-      numK  = (int)( (double)( 1.0 ) * (double)( o->y / 2 ) / 3.0 * (double)( o->pK  ) + 0.5 );
-      numNa = (int)( (double)( 1.0 ) * (double)( o->y / 2 ) / 3.0 * (double)( o->pNa ) + 0.5 );
-      numCl = (int)( (double)( 1.0 ) * (double)( o->y / 2 ) / 3.0 * (double)( o->pCl ) + 0.5 );
 
-      posK  = s->positionsPORES;
-      posNa = s->positionsPORES + (int)( (double)( ( 1 ) * ( o->y / 2 ) ) * 1.0 / 3.0 );
-      posCl = s->positionsPORES + (int)( (double)( ( 1 ) * ( o->y / 2 ) ) * 2.0 / 3.0 );
+// Realtime world visualization: run the last published color plane in
+// view through the palette, then pick out the tracked ions.
+void
+NernstPainter::drawWorld()
+{
+   uint32_t *row = image;
+   const struct simSnapshot *snap = sim->lockSnapshot();
 
-      for( y = 0; y < o->y; y++ )
+   for( int y = minY; y < maxY; y++, row += zoomXRange )
+   {
+      for( int x = minX; x < maxX; x++ )
       {
-         // Left membrane
-         glColor3f( 0.f, 0.f, 0.f );   // Black
-
-         for( double xOff = -atomRadiusX; xOff < atomRadiusX; xOff += 1.0 / (double)zoomXWindow )
-         {
-            for( double yOff = -atomRadiusY; yOff < atomRadiusY; yOff += 1.0 / (double)zoomYWindow )
-            {
-               glVertex3f( (GLfloat)( ( 0.0 + 1 - minX ) / (double)zoomXRange + xOff ),
-                           (GLfloat)( ( y + 1 - minY ) / (double)zoomYRange + yOff ),
-                           (GLfloat)0.0 );
-            }
-         }
-
-         // Central membrane with pores
-         glColor3f( 0.f, 0.f, 0.f );   // Black
-         for( i = 0; i < numK; i++ )
-         {
-            if( y == (int)posK[ i ] )
-            {
-               if( o->selectivity )
-               {
-                  glColor3f( 1.f, 0.64f, 0.57f );  // Pale red
-               } else {
-                  glColor3f( 1.f, 1.f, 1.f );      // White
-               }
-            }
-         }
-         for( i = 0; i < numNa; i++ )
-         {
-            if( y == (int)posNa[ i ] )
-            {
-               if( o->selectivity )
-               {
-                  glColor3f( 0.57f, 0.57f, 1.f );  // Pale blue
-               } else {
-                  glColor3f( 1.f, 1.f, 1.f );      // White
-               }
-            }
-         }
-         for( i = 0; i < numCl; i++ )
-         {
-            if( y == (int)posCl[ i ] )
-            {
-               if( o->selectivity )
-               {
-                  glColor3f( 0.57f, 0.87f, 0.72f );// Pale green
-               } else {
-                  glColor3f( 1.f, 1.f, 1.f );      // White
-               }
-            }
-         }
+         unsigned char color = SOLVENT;
 
-         for( double xOff = -atomRadiusX; xOff < atomRadiusX; xOff += 1.0 / (double)zoomXWindow )
+         if( x >= 0 && x < o->x && y >= 0 && y < o->y && snap->colors )
          {
-            for( double yOff = -atomRadiusY; yOff < atomRadiusY; yOff += 1.0 / (double)zoomYWindow )
-            {
-               glVertex3f( (GLfloat)( ( o->x / 2 + 1 - minX ) / (double)zoomXRange + xOff ),
-                           (GLfloat)( ( y + 1 - minY ) / (double)zoomYRange + yOff ),
-                           (GLfloat)0.0 );
-            }
+            color = snap->colors[ s->idx( x, y ) ];
          }
 
-         // Right membrane
-         glColor3f( 0.f, 0.f, 0.f );   // Black
+         row[ x - minX ] = palette[ color ];
+      }
+   }
 
-         for( double xOff = -atomRadiusX; xOff < atomRadiusX; xOff += 1.0 / (double)zoomXWindow )
-         {
-            for( double yOff = -atomRadiusY; yOff < atomRadiusY; yOff += 1.0 / (double)zoomYWindow )
-            {
-               glVertex3f( (GLfloat)( ( o->x - minX ) / (double)zoomXRange + xOff ),
-                           (GLfloat)( ( y + 1 - minY ) / (double)zoomYRange + yOff ),
-                           (GLfloat)0.0 );
-            }
-         }
-     }
+   for( int i = 0; i < snap->nTracked; i++ )
+   {
+      int x = snap->tracked[ i ] % o->x;
+      int y = snap->tracked[ i ] / o->x;
 
-      // Draw LHS atoms.
-      numK  = (int)( (double)( o->x / 2 - 1 ) * (double)( o->y ) / 3.0 * (double)( o->lK  ) / (double)MAX_CONC + 0.5 );
-      numNa = (int)( (double)( o->x / 2 - 1 ) * (double)( o->y ) / 3.0 * (double)( o->lNa ) / (double)MAX_CONC + 0.5 );
-      numCl = (int)( (double)( o->x / 2 - 1 ) * (double)( o->y ) / 3.0 * (double)( o->lCl ) / (double)MAX_CONC + 0.5 );
+      if( x >= minX && x < maxX && y >= minY && y < maxY )
+      {
+         int texel = ( y - minY ) * zoomXRange + ( x - minX );
 
-      posK  = s->positionsLHS;
-      posNa = s->positionsLHS + (int)( (double)( ( o->x / 2 - 1 ) * ( o->y ) ) * 1.0 / 3.0 );
-      posCl = s->positionsLHS + (int)( (double)( ( o->x / 2 - 1 ) * ( o->y ) ) * 2.0 / 3.0 );
+         image[ texel ] = palette[ snap->colors[ snap->tracked[ i ] ] | PALETTE_TRACKED ];
+         markTracked( texel );
+      }
+   }
 
-      for( i = 0; i < numK && placed < o->max_atoms; i++ )
-      {
-         x = ( posK[ i ] % ( o->x / 2 - 1 ) ) + 1;
-         y =   posK[ i ] / ( o->x / 2 - 1 );
+   sim->unlockSnapshot();
+}
 
-         if( o->electrostatics )
-         {
-            glColor3f( 1.f, 0.15f, 0.f );    // Red
-         } else {
-            glColor3f( 1.f, 0.64f, 0.57f );  // Pale red
-         }
 
-         for( double xOff = -atomRadiusX; xOff < atomRadiusX; xOff += 1.0 / (double)zoomXWindow )
-         {
-            for( double yOff = -atomRadiusY; yOff < atomRadiusY; yOff += 1.0 / (double)zoomYWindow )
-            {
-               glVertex3f( (GLfloat)( ( x + 1 - minX ) / (double)zoomXRange + xOff ),
-                           (GLfloat)( ( y + 1 - minY ) / (double)zoomYRange + yOff ),
-                           (GLfloat)0.0 );
-            }
-         }
-         placed++;
-      }
+void
+NernstPainter::markTracked( int texel )
+{
+   if( nTracked == trackedSz )
+   {
+      trackedSz = trackedSz ? 2 * trackedSz : 64;
+      tracked = (int *)realloc( tracked, trackedSz * sizeof( int ) );
+      assert( tracked );
+   }
+   tracked[ nTracked++ ] = texel;
+}
 
-      for( i = 0; i < numNa && placed < o->max_atoms; i++ )
-      {
-         x = ( posNa[ i ] % ( o->x / 2 - 1 ) ) + 1;
-         y =   posNa[ i ] / ( o->x / 2 - 1 );
 
-         if( o->electrostatics )
-         {
-            glColor3f( 0.f, 0.f, 1.f );      // Blue
-         } else {
-            glColor3f( 0.57f, 0.57f, 1.f );  // Pale blue
-         }
+// World preview visualization: where initAtoms() will put the pores and
+// ions, without building the world.  The layout is kept rasterized in
+// preview (one byte per lattice square); only the view is run through the
+// palette on each paint.
+void
+NernstPainter::drawPreview()
+{
+   uint32_t *row = image;
 
-         for( double xOff = -atomRadiusX; xOff < atomRadiusX; xOff += 1.0 / (double)zoomXWindow )
-         {
-            for( double yOff = -atomRadiusY; yOff < atomRadiusY; yOff += 1.0 / (double)zoomYWindow )
-            {
-               glVertex3f( (GLfloat)( ( x + 1 - minX ) / (double)zoomXRange + xOff ),
-                           (GLfloat)( ( y + 1 - minY ) / (double)zoomYRange + yOff ),
-                           (GLfloat)0.0 );
-            }
-         }
-         placed++;
-      }
+   rasterizePreview();
 
-      for( i = 0; i < numCl && placed < o->max_atoms; i++ )
+   for( int y = minY; y < maxY; y++, row += zoomXRange )
+   {
+      for( int x = minX; x < maxX; x++ )
       {
-         x = ( posCl[ i ] % ( o->x / 2 - 1 ) ) + 1;
-         y =   posCl[ i ] / ( o->x / 2 - 1 );
+         unsigned char color = SOLVENT;
 
-         if( o->electrostatics )
+         if( x >= 0 && x < o->x && y >= 0 && y < o->y )
          {
-            glColor3f( 0.f, 0.70f, 0.35f );  // Green
-         } else {
-            glColor3f( 0.57f, 0.87f, 0.72f );// Pale green
+            color = preview[ y * o->x + x ];
          }
 
-         for( double xOff = -atomRadiusX; xOff < atomRadiusX; xOff += 1.0 / (double)zoomXWindow )
-         {
-            for( double yOff = -atomRadiusY; yOff < atomRadiusY; yOff += 1.0 / (double)zoomYWindow )
-            {
-               glVertex3f( (GLfloat)( ( x + 1 - minX ) / (double)zoomXRange + xOff ),
-                           (GLfloat)( ( y + 1 - minY ) / (double)zoomYRange + yOff ),
-                           (GLfloat)0.0 );
-            }
-         }
-         placed++;
+         row[ x - minX ] = palette[ color ];
       }
+   }
+}
 
-      // Draw RHS atoms.
-      numK  = (int)( (double)( o->x / 2 - 2 ) * (double)( o->y ) / 3.0 * (double)( o->rK  ) / (double)MAX_CONC + 0.5 );
-      numNa = (int)( (double)( o->x / 2 - 2 ) * (double)( o->y ) / 3.0 * (double)( o->rNa ) / (double)MAX_CONC + 0.5 );
-      numCl = (int)( (double)( o->x / 2 - 2 ) * (double)( o->y ) / 3.0 * (double)( o->rCl ) / (double)MAX_CONC + 0.5 );
 
-      posK  = s->positionsRHS;
-      posNa = s->positionsRHS + (int)( (double)( ( o->x / 2 - 2 ) * ( o->y ) ) * 1.0 / 3.0 );
-      posCl = s->positionsRHS + (int)( (double)( ( o->x / 2 - 2 ) * ( o->y ) ) * 2.0 / 3.0 );
+// Bring preview up to date with the options.  After a change to a single
+// concentration or permeability only the ions or pores that were added or
+// removed are touched; anything else redraws the whole layout.
+void
+NernstPainter::rasterizePreview()
+{
+   static const unsigned char ionColors[ 3 ] = { ATOM_K, ATOM_Na, ATOM_Cl };
+   int ions[ 2 ][ 3 ], pores[ 3 ];
+   int side, species, total, capped, placed, n;
+
+   ions[ 0 ][ 0 ] = (int)( (double)( o->x / 2 - 1 ) * (double)( o->y ) / 3.0 * (double)( o->lK  ) / (double)MAX_CONC + 0.5 );
+   ions[ 0 ][ 1 ] = (int)( (double)( o->x / 2 - 1 ) * (double)( o->y ) / 3.0 * (double)( o->lNa ) / (double)MAX_CONC + 0.5 );
+   ions[ 0 ][ 2 ] = (int)( (double)( o->x / 2 - 1 ) * (double)( o->y ) / 3.0 * (double)( o->lCl ) / (double)MAX_CONC + 0.5 );
+   ions[ 1 ][ 0 ] = (int)( (double)( o->x / 2 - 2 ) * (double)( o->y ) / 3.0 * (double)( o->rK  ) / (double)MAX_CONC + 0.5 );
+   ions[ 1 ][ 1 ] = (int)( (double)( o->x / 2 - 2 ) * (double)( o->y ) / 3.0 * (double)( o->rNa ) / (double)MAX_CONC + 0.5 );
+   ions[ 1 ][ 2 ] = (int)( (double)( o->x / 2 - 2 ) * (double)( o->y ) / 3.0 * (double)( o->rCl ) / (double)MAX_CONC + 0.5 );
+
+   pores[ 0 ] = (int)( (double)( 1.0 ) * (double)( o->y / 2 ) / 3.0 * (double)( o->pK  ) + 0.5 );
+   pores[ 1 ] = (int)( (double)( 1.0 ) * (double)( o->y / 2 ) / 3.0 * (double)( o->pNa ) + 0.5 );
+   pores[ 2 ] = (int)( (double)( 1.0 ) * (double)( o->y / 2 ) / 3.0 * (double)( o->pCl ) + 0.5 );
+
+   // initAtoms() stops at max_atoms, in the order LHS K, Na, Cl, then RHS.
+   // While that limit is in play the species depend on each other, so
+   // incremental updates are not attempted.
+   for( total = 0, side = 0; side < 2; side++ )
+   {
+      for( species = 0; species < 3; species++ )
+      {
+         total += ions[ side ][ species ];
+      }
+   }
+   capped = ( total > o->max_atoms );
 
-      for( i = 0; i < numK && placed < o->max_atoms; i++ )
+   if( preview == NULL || previewX != o->x || previewY != o->y ||
+       previewGen != s->positionsGen || capped || previewCapped )
+   {
+      if( o->x * o->y > previewSz )
       {
-         x = ( posK[ i ] % ( o->x / 2 - 2 ) ) + o->x / 2 + 1;
-         y =   posK[ i ] / ( o->x / 2 - 2 );
+         previewSz = o->x * o->y;
+         preview = (unsigned char *)realloc( preview, previewSz );
+         assert( preview );
+      }
+      memset( preview, SOLVENT, o->x * o->y );
 
-         if( o->electrostatics )
-         {
-            glColor3f( 1.f, 0.15f, 0.f );    // Red
-         } else {
-            glColor3f( 1.f, 0.64f, 0.57f );  // Pale red
-         }
+      for( int y = 0; y < o->y; y++ )
+      {
+         preview[ y * o->x ]            = MEMBRANE;
+         preview[ y * o->x + o->x - 1 ] = MEMBRANE;
+      }
+      previewPoreCells( pores );
 
-         for( double xOff = -atomRadiusX; xOff < atomRadiusX; xOff += 1.0 / (double)zoomXWindow )
+      for( placed = 0, side = 0; side < 2; side++ )
+      {
+         for( species = 0; species < 3; species++ )
          {
-            for( double yOff = -atomRadiusY; yOff < atomRadiusY; yOff += 1.0 / (double)zoomYWindow )
+            n = ions[ side ][ species ];
+            if( n > o->max_atoms - placed )
             {
-               glVertex3f( (GLfloat)( ( x + 1 - minX ) / (double)zoomXRange + xOff ),
-                           (GLfloat)( ( y + 1 - minY ) / (double)zoomYRange + yOff ),
-                           (GLfloat)0.0 );
+               n = (int)( o->max_atoms - placed );
             }
+            previewIonCells( side, species, 0, n, ionColors[ species ] );
+            placed += n;
          }
-        placed++;
       }
 
-      for( i = 0; i < numNa && placed < o->max_atoms; i++ )
+      previewX = o->x;
+      previewY = o->y;
+      previewGen = s->positionsGen;
+   } else {
+      if( memcmp( pores, previewPores, sizeof( pores ) ) )
       {
-         x = ( posNa[ i ] % ( o->x / 2 - 2 ) ) + o->x / 2 + 1;
-         y =   posNa[ i ] / ( o->x / 2 - 2 );
-
-         if( o->electrostatics )
-         {
-            glColor3f( 0.f, 0.f, 1.f );      // Blue
-         } else {
-            glColor3f( 0.57f, 0.57f, 1.f );  // Pale blue
-         }
+         previewPoreCells( pores );
+      }
 
-         for( double xOff = -atomRadiusX; xOff < atomRadiusX; xOff += 1.0 / (double)zoomXWindow )
+      for( side = 0; side < 2; side++ )
+      {
+         for( species = 0; species < 3; species++ )
          {
-            for( double yOff = -atomRadiusY; yOff < atomRadiusY; yOff += 1.0 / (double)zoomYWindow )
+            n = previewIons[ side ][ species ];
+            if( ions[ side ][ species ] > n )
             {
-               glVertex3f( (GLfloat)( ( x + 1 - minX ) / (double)zoomXRange + xOff ),
-                           (GLfloat)( ( y + 1 - minY ) / (double)zoomYRange + yOff ),
-                           (GLfloat)0.0 );
+               previewIonCells( side, species, n, ions[ side ][ species ], ionColors[ species ] );
+            } else if( ions[ side ][ species ] < n ) {
+               previewIonCells( side, species, ions[ side ][ species ], n, SOLVENT );
             }
          }
-         placed++;
       }
+   }
 
-      for( i = 0; i < numCl && placed < o->max_atoms; i++ )
-      {
-         x = ( posCl[ i ] % ( o->x / 2 - 2 ) ) + o->x / 2 + 1;
-         y =   posCl[ i ] / ( o->x / 2 - 2 );
+   memcpy( previewIons, ions, sizeof( ions ) );
+   memcpy( previewPores, pores, sizeof( pores ) );
+   previewCapped = capped;
+}
 
-         if( o->electrostatics )
-         {
-            glColor3f( 0.f, 0.70f, 0.35f );  // Green
-         } else {
-            glColor3f( 0.57f, 0.87f, 0.72f );// Pale green
-         }
 
-         for( double xOff = -atomRadiusX; xOff < atomRadiusX; xOff += 1.0 / (double)zoomXWindow )
-         {
-            for( double yOff = -atomRadiusY; yOff < atomRadiusY; yOff += 1.0 / (double)zoomYWindow )
-            {
-               glVertex3f( (GLfloat)( ( x + 1 - minX ) / (double)zoomXRange + xOff ),
-                           (GLfloat)( ( y + 1 - minY ) / (double)zoomYRange + yOff ),
-                           (GLfloat)0.0 );
-            }
-         }
-         placed++;
-      }
+// Color ions [from, to) of one species on one side (0 = LHS, 1 = RHS), in
+// the order initAtoms() places them.  Each species has its own third of
+// the shuffled positions, so they never overlap.
+void
+NernstPainter::previewIonCells( int side, int species, int from, int to, unsigned char color )
+{
+   int width  = side ? ( o->x / 2 - 2 ) : ( o->x / 2 - 1 );
+   int offset = side ? ( o->x / 2 + 1 ) : 1;
+   unsigned int *pos = side ? s->positionsRHS : s->positionsLHS;
 
-      glEnd();
+   pos += (int)( (double)( width * o->y ) * (double)species / 3.0 );
+   for( int i = from; i < to; i++ )
+   {
+      int x = pos[ i ] % width + offset;
+      int y = pos[ i ] / width;
+      preview[ y * o->x + x ] = color;
    }
 }
 
+
+// Redraw the central membrane and its pores.
+void
+NernstPainter::previewPoreCells( const int *pores )
+{
+   static const unsigned char poreColors[ 3 ] = { PORE_K, PORE_Na, PORE_Cl };
+   unsigned int *pos;
+
+   for( int y = 0; y < o->y; y++ )
+   {
+      preview[ y * o->x + o->x / 2 ] = MEMBRANE;
+   }
+
+   for( int species = 0; species < 3; species++ )
+   {
+      pos = s->positionsPORES + (int)( (double)( ( 1 ) * ( o->y / 2 ) ) * (double)species / 3.0 );
+      for( int i = 0; i < pores[ species ]; i++ )
+      {
+         preview[ pos[ i ] * o->x + o->x / 2 ] = poreColors[ species ];
+      }
+   }
+}
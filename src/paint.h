@@ -27,14 +27,17 @@
 
 
 #include <QGLWidget>
+#include <stdint.h>
 
 class NernstSim;
+class XNernstSim;
 class NernstPainter : public QGLWidget
 {
    Q_OBJECT
 
    public:
       NernstPainter( struct options *o, int zoomOn = 0, QWidget *parent = 0 );
+      ~NernstPainter();
 
    public slots:
       void adjustPaintRegion();
@@ -55,6 +58,7 @@ class NernstPainter : public QGLWidget
    private:
       struct options *o;
       class NernstSim *s;
+      class XNernstSim *sim;
       int running;
       int zoom;
       int zoomXRange;
@@ -70,7 +74,37 @@ class NernstPainter : public QGLWidget
       GLfloat rotationY;
       GLfloat rotationZ;
       // QPoint lastPos;
+
+      // The frame: one texel per lattice square in view, in the corner of
+      // a texture of texW x texH, powers of 2.
+      GLuint texture;
+      int texW, texH;
+      uint32_t palette[ 256 ];
+      uint32_t *image;
+      int imageSz;
+
+      // Texels holding tracked ions, drawn larger on top of the frame.
+      int *tracked;
+      int trackedSz;
+      int nTracked;
+
+      // The preview layout, one color per lattice square of the whole
+      // world, and what it was last rasterized from.
+      unsigned char *preview;
+      int previewSz;
+      int previewX, previewY;
+      int previewGen;
+      int previewIons[ 2 ][ 3 ];
+      int previewPores[ 3 ];
+      int previewCapped;
+
       void draw();
+      void drawWorld();
+      void drawPreview();
+      void rasterizePreview();
+      void previewIonCells( int side, int species, int from, int to, unsigned char color );
+      void previewPoreCells( const int *pores );
+      void markTracked( int texel );
 };
 
 #endif /* PAINT_H */
@@ -0,0 +1,68 @@
+/* palette.cpp
+ *
+ * Species to color lookup shared by everything that draws the world.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "palette.h"
+#include "sim.h"
+
+
+static uint32_t
+rgb( float r, float g, float b )
+{
+   return 0xff000000u
+        | ( (uint32_t)( r * 255.f + 0.5f ) << 16 )
+        | ( (uint32_t)( g * 255.f + 0.5f ) << 8 )
+        |   (uint32_t)( b * 255.f + 0.5f );
+}
+
+
+void
+buildPalette( uint32_t *lut, int electrostatics, int selectivity )
+{
+   uint32_t red        = rgb( 1.f, 0.15f, 0.f );
+   uint32_t blue       = rgb( 0.f, 0.f, 1.f );
+   uint32_t green      = rgb( 0.f, 0.70f, 0.35f );
+   uint32_t paleRed    = rgb( 1.f, 0.64f, 0.57f );
+   uint32_t paleBlue   = rgb( 0.57f, 0.57f, 1.f );
+   uint32_t paleGreen  = rgb( 0.57f, 0.87f, 0.72f );
+   uint32_t white      = rgb( 1.f, 1.f, 1.f );
+   uint32_t black      = rgb( 0.f, 0.f, 0.f );
+   int i;
+
+   for( i = 0; i < PALETTE_SIZE; i++ )
+   {
+      lut[ i ] = white;
+   }
+
+   lut[ ATOM_K ]        = electrostatics ? red   : paleRed;
+   lut[ ATOM_Na ]       = electrostatics ? blue  : paleBlue;
+   lut[ ATOM_Cl ]       = electrostatics ? green : paleGreen;
+   lut[ ATOM_K  | PALETTE_TRACKED ] = red;
+   lut[ ATOM_Na | PALETTE_TRACKED ] = blue;
+   lut[ ATOM_Cl | PALETTE_TRACKED ] = green;
+   lut[ PORE_K ]        = selectivity ? paleRed   : white;
+   lut[ PORE_Na ]       = selectivity ? paleBlue  : white;
+   lut[ PORE_Cl ]       = selectivity ? paleGreen : white;
+   lut[ MEMBRANE ]      = black;
+}
@@ -0,0 +1,45 @@
+/* palette.h
+ *
+ * Species to color lookup shared by everything that draws the world.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdint.h>
+
+// The lookup table is indexed by the color field of struct atom.  Entries
+// are 0xAARRGGBB, the same layout as QRgb.
+enum
+{
+   PALETTE_SIZE = 256,
+   PALETTE_TRACKED = 0x80   // lut[ color | PALETTE_TRACKED ] is a tracked ion
+};
+
+// Fill lut with the colors for the current display options.  Ions are
+// drawn pale when electrostatics are off; pores take the color of the ion
+// they pass only when selectivity is on.  Solvent is white.  Tracked ions
+// are always drawn in full color.
+void buildPalette( uint32_t *lut, int electrostatics, int selectivity );
+
+#endif /* PALETTE_H */
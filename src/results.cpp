@@ -0,0 +1,470 @@
+/* results.cpp
+ *
+ * Replaying the outputs of identical runs.  See results.h.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#ifdef BLR_USEWIN
+#include <direct.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#include "results.h"
+#include "hash.h"
+#include "options.h"
+
+extern const char *version[];   // options.cpp
+
+
+// An entry is a text header,
+//
+//    nernst-results 1
+//    options <the canonical options>
+//    file <name> <bytes> <checksum>      one per output
+//    end
+//
+// followed by the outputs' contents in the same order.
+static const char *magic = "nernst-results 1";
+
+
+// Which program this is: a hash of the executable where it can be read,
+// else of the version text and when this file was compiled.
+static uint64_t
+programHash()
+{
+   uint64_t h = FNV_BASIS;
+   int i;
+
+#ifdef BLR_USELINUX
+   unsigned char buf[ 65536 ];
+   size_t n;
+   FILE *fp;
+
+   if( ( fp = fopen( "/proc/self/exe", "rb" ) ) != NULL )
+   {
+      while( ( n = fread( buf, 1, sizeof( buf ), fp ) ) > 0 )
+      {
+         h = fnv( h, buf, n );
+      }
+      fclose( fp );
+      return h;
+   }
+#endif
+   for( i = 0; version[ i ] != NULL; i++ )
+   {
+      h = fnv( h, version[ i ], strlen( version[ i ] ) );
+   }
+   return fnv( h, __DATE__ " " __TIME__, strlen( __DATE__ " " __TIME__ ) );
+}
+
+
+// The whole of file, or NULL.
+static unsigned char *
+slurp( const char *file, long *n )
+{
+   unsigned char *data;
+   FILE *fp;
+
+   if( ( fp = fopen( file, "rb" ) ) == NULL )
+   {
+      return NULL;
+   }
+   fseek( fp, 0, SEEK_END );
+   *n = ftell( fp );
+   fseek( fp, 0, SEEK_SET );
+   data = (unsigned char *)malloc( *n + 1 );
+   assert( data );
+   if( *n < 0 || fread( data, 1, *n, fp ) != (size_t)*n )
+   {
+      free( data );
+      data = NULL;
+   }
+   fclose( fp );
+   return data;
+}
+
+
+ResultStore::ResultStore( struct options *options )
+{
+   enum { CANON_SZ = 2048 };
+
+   o = options;
+   canon = NULL;
+   entryName[ 0 ] = path[ 0 ] = '\0';
+   nOutputs = 0;
+   entries = NULL;
+   nEntries = szEntries = 0;
+   clock = 0;
+   if( o->output_file )
+   {
+      names[ nOutputs ] = files[ nOutputs ] = "static.out";
+      nOutputs++;
+      names[ nOutputs ] = files[ nOutputs ] = "world.out";
+      nOutputs++;
+      names[ nOutputs ] = files[ nOutputs ] = "stats.out";
+      nOutputs++;
+   }
+   if( o->pore_summary )
+   {
+      names[ nOutputs ] = "pore-summary";
+      files[ nOutputs ] = o->pore_summary;
+      nOutputs++;
+   }
+
+   usable = o->result_cache && nOutputs > 0 && !o->use_gui && !o->bench && !o->validate &&
+            !o->trajectory_file && o->frame_every == 0 && !o->analysis &&
+            !o->state_cache && !o->profiling && !o->checkpoint && !o->resume;
+   if( !usable )
+   {
+      return;
+   }
+
+   // Before the run, which overwrites o->max_atoms with the number placed.
+   // The claim, atomic and blocked engines give the same outputs for any
+   // thread count or block length, so only the sublattice engine, whose
+   // moves differ, is told apart; --autotune only picks among the others.
+   canon = (char *)malloc( CANON_SZ );
+   assert( canon );
+   snprintf( canon, CANON_SZ,
+             "program=%016llx x=%d y=%d iters=%d max_atoms=%ld "
+             "lK=%d lNa=%d lCl=%d rK=%d rNa=%d rCl=%d "
+             "pK=%.17g pNa=%.17g pCl=%.17g selectivity=%d electrostatics=%d "
+             "equilibrium_init=%d seed=%d dynamics=%s "
+             "e=%.17g k=%.17g R=%.17g F=%.17g t=%.17g d=%.17g a=%.17g "
+             "eps0=%.17g eps=%.17g c=%.17g cBoltz=%.17g "
+             "burn_in=%d output_file=%d pore_summary=%d",
+             (unsigned long long)programHash(), o->x, o->y, o->iters, o->max_atoms,
+             o->lK, o->lNa, o->lCl, o->rK, o->rNa, o->rCl,
+             o->pK, o->pNa, o->pCl, o->selectivity, o->electrostatics,
+             o->equilibrium_init, o->randseed,
+             o->engine == ENGINE_SUBLATTICE && !o->autotune ? "sublattice" : "claim",
+             o->e, o->k, o->R, o->F, o->t, o->d, o->a, o->eps0, o->eps, o->c, o->cBoltz,
+             o->burn_in, o->output_file, o->pore_summary != NULL );
+   snprintf( entryName, sizeof( entryName ), "%016llx.res",
+             (unsigned long long)fnv( FNV_BASIS, canon, strlen( canon ) ) );
+   snprintf( path, sizeof( path ), "%s/%s", o->result_cache, entryName );
+}
+
+
+ResultStore::~ResultStore()
+{
+   free( canon );
+   free( entries );
+}
+
+
+void
+ResultStore::readIndex()
+{
+   char file[ 1030 ], line[ 256 ];
+   struct entry e;
+   FILE *fp;
+
+   nEntries = 0;
+   snprintf( file, sizeof( file ), "%s/index", o->result_cache );
+   if( ( fp = fopen( file, "r" ) ) == NULL )
+   {
+      return;
+   }
+   while( fgets( line, sizeof( line ), fp ) )
+   {
+      if( sscanf( line, "clock %ld", &clock ) == 1 )
+      {
+         continue;
+      }
+      if( sscanf( line, "%23s %ld %ld", e.name, &e.bytes, &e.used ) != 3 ||
+          e.name[ 0 ] == '#' )
+      {
+         continue;
+      }
+      if( nEntries == szEntries )
+      {
+         szEntries = szEntries ? 2 * szEntries : 16;
+         entries = (struct entry *)realloc( entries, szEntries * sizeof( struct entry ) );
+         assert( entries );
+      }
+      entries[ nEntries++ ] = e;
+   }
+   fclose( fp );
+}
+
+
+void
+ResultStore::writeIndex()
+{
+   char file[ 1030 ], tmp[ 1040 ];
+   FILE *fp;
+   int i;
+
+   snprintf( file, sizeof( file ), "%s/index", o->result_cache );
+   snprintf( tmp, sizeof( tmp ), "%s.tmp", file );
+   if( ( fp = fopen( tmp, "w" ) ) == NULL )
+   {
+      perror( tmp );
+      return;
+   }
+   fprintf( fp, "clock %ld\n", clock );
+   fprintf( fp, "# name bytes used\n" );
+   for( i = 0; i < nEntries; i++ )
+   {
+      fprintf( fp, "%s %ld %ld\n", entries[ i ].name, entries[ i ].bytes, entries[ i ].used );
+   }
+   fclose( fp );
+#ifdef BLR_USEWIN
+   remove( file );
+#endif
+   rename( tmp, file );
+}
+
+
+// Mark this configuration's entry, of bytes bytes, as just used.
+void
+ResultStore::touch( long bytes )
+{
+   struct entry *e = NULL;
+   int i;
+
+   for( i = 0; i < nEntries; i++ )
+   {
+      if( !strcmp( entries[ i ].name, entryName ) )
+      {
+         e = &entries[ i ];
+      }
+   }
+   if( e == NULL )
+   {
+      if( nEntries == szEntries )
+      {
+         szEntries = szEntries ? 2 * szEntries : 16;
+         entries = (struct entry *)realloc( entries, szEntries * sizeof( struct entry ) );
+         assert( entries );
+      }
+      e = &entries[ nEntries++ ];
+      strcpy( e->name, entryName );
+   }
+   e->bytes = bytes;
+   e->used  = ++clock;
+}
+
+
+// Least recently used first, until the entries fit in --result-cache-size.
+// Never this configuration's own.
+void
+ResultStore::evict()
+{
+   char file[ 1030 ];
+   long total = 0, limit = (long)o->result_cache_mb * 1024 * 1024;
+   int i, lru;
+
+   for( i = 0; i < nEntries; i++ )
+   {
+      total += entries[ i ].bytes;
+   }
+   while( total > limit )
+   {
+      lru = -1;
+      for( i = 0; i < nEntries; i++ )
+      {
+         if( strcmp( entries[ i ].name, entryName ) &&
+             ( lru < 0 || entries[ i ].used < entries[ lru ].used ) )
+         {
+            lru = i;
+         }
+      }
+      if( lru < 0 )
+      {
+         break;
+      }
+      if( o->verbose )
+      {
+         fprintf( stderr, "result cache: evicting %s\n", entries[ lru ].name );
+      }
+      snprintf( file, sizeof( file ), "%s/%s", o->result_cache, entries[ lru ].name );
+      remove( file );
+      total -= entries[ lru ].bytes;
+      entries[ lru ] = entries[ --nEntries ];
+   }
+}
+
+
+int
+ResultStore::replay()
+{
+   char line[ 4096 ], name[ 64 ];
+   unsigned char *data[ MAX_OUTPUTS ];
+   unsigned long long sums[ MAX_OUTPUTS ];
+   long bytes[ MAX_OUTPUTS ], size = 0;
+   int i, n = 0, end = 0, ok = 1;
+   FILE *fp;
+
+   if( !usable || ( fp = fopen( path, "rb" ) ) == NULL )
+   {
+      return 0;
+   }
+
+   // Another configuration with the same hash is simply not a hit.
+   if( !fgets( line, sizeof( line ), fp ) || strncmp( line, magic, strlen( magic ) ) ||
+       !fgets( line, sizeof( line ), fp ) || strncmp( line, "options ", 8 ) ||
+       strncmp( line + 8, canon, strlen( canon ) ) || line[ 8 + strlen( canon ) ] != '\n' )
+   {
+      fclose( fp );
+      return 0;
+   }
+
+   while( ok && !end && fgets( line, sizeof( line ), fp ) )
+   {
+      if( !strcmp( line, "end\n" ) )
+      {
+         end = 1;
+         continue;
+      }
+      ok = n < nOutputs &&
+           sscanf( line, "file %63s %ld %llx", name, &bytes[ n ], &sums[ n ] ) == 3 &&
+           !strcmp( name, names[ n ] ) && bytes[ n ] >= 0;
+      n += ok;
+   }
+   ok = ok && end && n == nOutputs;
+
+   // Every file is read and checked before any is written.
+   for( i = 0; i < nOutputs; i++ )
+   {
+      data[ i ] = NULL;
+   }
+   for( i = 0; ok && i < nOutputs; i++ )
+   {
+      data[ i ] = (unsigned char *)malloc( bytes[ i ] + 1 );
+      assert( data[ i ] );
+      ok = fread( data[ i ], 1, bytes[ i ], fp ) == (size_t)bytes[ i ] &&
+           fnv( FNV_BASIS, data[ i ], bytes[ i ] ) == sums[ i ];
+   }
+   size = ftell( fp );
+   fclose( fp );
+
+   for( i = 0; ok && i < nOutputs; i++ )
+   {
+      if( ( fp = fopen( files[ i ], "wb" ) ) == NULL )
+      {
+         perror( files[ i ] );
+         ok = 0;
+         break;
+      }
+      fwrite( data[ i ], 1, bytes[ i ], fp );
+      fclose( fp );
+   }
+   for( i = 0; i < nOutputs; i++ )
+   {
+      free( data[ i ] );
+   }
+
+   if( !ok )
+   {
+      fprintf( stderr, "%s is damaged; running instead.\n", path );
+      remove( path );
+      return 0;
+   }
+   readIndex();
+   touch( size );
+   writeIndex();
+   fprintf( stderr, "Replayed the results of an identical run from %s (--no-cache to run it again).\n",
+            path );
+   return 1;
+}
+
+
+void
+ResultStore::save()
+{
+   unsigned char *data[ MAX_OUTPUTS ];
+   long bytes[ MAX_OUTPUTS ], size;
+   char tmp[ 1030 ];
+   int i, ok = 1;
+   FILE *fp;
+
+   if( !usable )
+   {
+      return;
+   }
+
+   for( i = 0; i < nOutputs; i++ )
+   {
+      data[ i ] = slurp( files[ i ], &bytes[ i ] );
+      ok = ok && data[ i ] != NULL;
+   }
+
+   if( ok )
+   {
+#ifdef BLR_USEWIN
+      _mkdir( o->result_cache );
+#else
+      mkdir( o->result_cache, 0777 );
+#endif
+      snprintf( tmp, sizeof( tmp ), "%s.tmp", path );
+      if( ( fp = fopen( tmp, "wb" ) ) == NULL )
+      {
+         perror( tmp );
+      } else {
+         fprintf( fp, "%s\noptions %s\n", magic, canon );
+         for( i = 0; i < nOutputs; i++ )
+         {
+            fprintf( fp, "file %s %ld %016llx\n", names[ i ], bytes[ i ],
+                     (unsigned long long)fnv( FNV_BASIS, data[ i ], bytes[ i ] ) );
+         }
+         fprintf( fp, "end\n" );
+         for( i = 0; i < nOutputs; i++ )
+         {
+            fwrite( data[ i ], 1, bytes[ i ], fp );
+         }
+         size = ftell( fp );
+         if( ferror( fp ) | fclose( fp ) )
+         {
+            perror( tmp );
+            remove( tmp );
+         } else {
+#ifdef BLR_USEWIN
+            remove( path );
+#endif
+            rename( tmp, path );
+            if( o->verbose )
+            {
+               fprintf( stderr, "results stored in %s\n", path );
+            }
+
+            // Another job may have been here since replay().
+            readIndex();
+            touch( size );
+            evict();
+            writeIndex();
+         }
+      }
+   }
+
+   for( i = 0; i < nOutputs; i++ )
+   {
+      free( data[ i ] );
+   }
+}
@@ -0,0 +1,89 @@
+/* results.h
+ *
+ * Replaying the outputs of identical runs (--result-cache, --no-cache).
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stdint.h>
+
+// A console run is a pure function of its options, its seed and the
+// program that runs it, so a run identical to an earlier one need not be
+// run again.  Each entry in the --result-cache directory holds the files
+// a run wrote (static.out, world.out and stats.out with -f, and the
+// --pore-summary file) under a key made from all of the options that
+// shape them, in a fixed textual form, and a hash of the executable.  The textual form is
+// kept in the entry and compared in full, so two configurations whose
+// keys collide are never confused, and each file carries a checksum that
+// is checked before anything is written.
+//
+// The index file in the directory lists the entries and when each was
+// last stored or replayed.  save() removes the least recently used ones
+// once the directory holds more than --result-cache-size megabytes.
+//
+// Runs that write anything else (trajectories, frames, analysis,
+// profiling times), that start from --state-cache, or that use the GUI,
+// are always run.
+class ResultStore
+{
+   public:
+      ResultStore( struct options *o );
+      ~ResultStore();
+
+      // Before the run: write its outputs from the store.  Returns 1 if
+      // it did, and the run can be skipped.
+      int replay();
+
+      // After the run: keep its outputs.
+      void save();
+
+   private:
+      enum { MAX_OUTPUTS = 4 };
+
+      struct options *o;
+      int usable;
+      char *canon;            // the options that shape the outputs, as text
+      char entryName[ 24 ];   // this configuration's entry
+      char path[ 1024 ];      //   and where it is
+      const char *names[ MAX_OUTPUTS ];   // as stored
+      const char *files[ MAX_OUTPUTS ];   // as written by the run
+      int nOutputs;
+
+      struct entry
+      {
+         char name[ 24 ];      // file in the directory
+         long bytes;
+         long used;            // clock when last stored or replayed
+      };
+
+      struct entry *entries;
+      int nEntries, szEntries;
+      long clock;             // kept in the index across runs
+
+      void readIndex();
+      void writeIndex();
+      void touch( long bytes );
+      void evict();
+};
+
+#endif /* RESULTS_H */
@@ -49,6 +49,15 @@
 
 #include "sim.h"
 #include "options.h"
+#include "trajectory.h"
+#include "frames.h"
+#include "blocked.h"
+#include "sublattice.h"
+#include "arena.h"
+#include "analysis.h"
+#include "statecache.h"
+#include "checkpoint.h"
+#include "stats.h"
 #include "util.h"
 #include "safecalls.h"
 
@@ -62,22 +71,189 @@ NernstSim::NernstSim( struct options *options )
    maxatomsDefault = o->max_atoms;
    currentIter = 0;
    qtime = safeNew( QTime() );
+
+   world          = NULL;
+   claimed        = NULL;
+   direction      = NULL;
+   worldNext      = NULL;
+   arena          = NULL;
+   positionsLHS   = NULL;
+   positionsRHS   = NULL;
+   positionsPORES = NULL;
+   positionsGen   = 0;
+   tracked        = NULL;
+   nTracked       = 0;
+   trackedSz      = 0;
+   trackedSlot    = NULL;
+   trackedSlotSz  = 0;
+   poreFlux       = NULL;
+   poreFluxRows   = 0;
+   trackedGen     = 0;
+   nIons          = 0;
+   trajectory     = NULL;
+   frames         = NULL;
+   analysis       = NULL;
+   cache          = NULL;
+   checkpoints    = NULL;
+   blocked        = NULL;
+   sublattice     = NULL;
+   phaseTimes     = NULL;
+   nPhaseThreads  = 0;
+   vmStats        = safeNew( BatchMeans() );
+}
+
+
+NernstSim::~NernstSim()
+{
+   delete arena;
+   free( positionsLHS );
+   free( positionsRHS );
+   free( positionsPORES );
+   free( tracked );
+   free( trackedSlot );
+   free( poreFlux );
+   delete trajectory;
+   delete frames;
+   delete analysis;
+   delete checkpoints;
+   delete cache;
+   delete blocked;
+   delete sublattice;
+   free( phaseTimes );
+   delete vmStats;
+   delete qtime;
 }
 
 
 void
 NernstSim::initNernstSim()
 {
+   int warm, resumed;
+
    currentIter = 1;
    elapsed = 0;
+   vmStats->clear();
+
+   free( phaseTimes );
+   phaseTimes = NULL;
+   if( o->profiling )
+   {
+      nPhaseThreads = ( o->threads > 1 ) ? o->threads : 1;
+      phaseTimes = (struct phaseTimes *)calloc( nPhaseThreads, sizeof( struct phaseTimes ) );
+      assert( phaseTimes );
+   }
+
+   // Sized for the previous world, if any.
+   delete blocked;
+   blocked = NULL;
+   delete sublattice;
+   sublattice = NULL;
+
    shufflePositions( o );
    initWorld( o );
    initAtoms( o );
-   if( o->output_file )
+
+   // A checkpoint replaces everything that follows up to the first
+   // iteration, which it has already seen.  --resume is used only once.
+   resumed = 0;
+   if( o->resume )
+   {
+      if( !Checkpointer::restore( this, o->resume ) )
+      {
+         exit( 1 );
+      }
+      if( o->verbose )
+      {
+         fprintf( stderr, "resumed from %s after iteration %d\n", o->resume, currentIter - 1 );
+      }
+      o->resume = NULL;
+      resumed = 1;
+   }
+
+   // A cached world, if there is one, is already charged.
+   delete cache;
+   cache = NULL;
+   warm = resumed;
+   if( o->state_cache && !resumed )
+   {
+      cache = safeNew( StateCache( o ) );
+      warm = cache->warmStart( this );
+   }
+   if( o->equilibrium_init && !warm )
+   {
+      int moved = preCharge();
+      if( o->verbose )
+      {
+         fprintf( stderr, "equilibrium-init: moved %d ions across; %f mV to start\n",
+                  moved, LRcharge * o->e / ( o->c * o->a * o->y ) * 1000 );
+      }
+   }
+   if( o->verbose )
+   {
+      char pages[ 160 ];
+      arena->describe( pages, sizeof( pages ) );
+      fprintf( stderr, "lattice buffers: %s\n", pages );
+   }
+   if( o->output_file && !resumed )
    {
       takeCensus( 0 );
    }
 
+   if( o->track_region[ 0 ] >= 0 && !resumed )
+   {
+      trackRegion( o->track_region[ 0 ], o->track_region[ 1 ],
+                   o->track_region[ 2 ], o->track_region[ 3 ] );
+   }
+   if( !resumed )
+   {
+      trackRandom( o->track_random );
+   }
+
+   if( o->trajectory_file )
+   {
+      if( trajectory == NULL )
+      {
+         trajectory = safeNew( TrajectoryWriter() );
+      }
+      trajectory->open( o->trajectory_file, o->x, o->y );
+      trajectory->record( this, currentIter - 1 );
+   }
+
+   delete frames;
+   frames = NULL;
+   if( o->frame_every > 0 )
+   {
+      frames = safeNew( FrameWriter( o ) );
+      if( frames->open() )
+      {
+         frames->capture( this, currentIter - 1 );
+      } else {
+         delete frames;
+         frames = NULL;
+      }
+   }
+
+   delete analysis;
+   analysis = NULL;
+   if( o->analysis )
+   {
+      analysis = safeNew( AnalysisPipeline( o ) );
+      if( analysis->open() )
+      {
+         analysis->capture( this, currentIter - 1 );
+      } else {
+         delete analysis;
+         analysis = NULL;
+      }
+   }
+
+   delete checkpoints;
+   checkpoints = NULL;
+   if( o->checkpoint )
+   {
+      checkpoints = safeNew( Checkpointer( this ) );
+   }
+
    if( o->progress )
 	{
       std::cout << "Iteration: 0 of " << o->iters << " | ";
@@ -96,18 +272,49 @@ NernstSim::preIter()
 void 
 NernstSim::Iter()
 {
-   moveAtoms();
+   if( o->engine == ENGINE_SUBLATTICE )
+   {
+      if( sublattice == NULL )
+      {
+         sublattice = safeNew( SublatticeEngine( this ) );
+      }
+      sublattice->step();
+   } else {
+      moveAtoms();
+   }
 }
 
 
 void 
 NernstSim::postIter()
 {
+   sampleCharge( currentIter, LRcharge );
+
    if( o->output_file )
    {
       takeCensus( currentIter );
    }
 
+   if( trajectory )
+   {
+      trajectory->record( this, currentIter );
+   }
+
+   if( frames && currentIter % o->frame_every == 0 )
+   {
+      frames->capture( this, currentIter );
+   }
+
+   if( analysis )
+   {
+      analysis->capture( this, currentIter );
+   }
+
+   if( checkpoints )
+   {
+      checkpoints->poll();
+   }
+
    if( o->progress && currentIter % 256 == 0 )
    {
       std::cout << "                                                                    \r" << std::flush;
@@ -122,6 +329,38 @@ NernstSim::completeNernstSim()
 {
    if(o->output_file){
 	   finalizeAtoms();
+	   writeStats();
+   }
+
+   if( o->pore_summary )
+   {
+      writePoreSummary();
+   }
+
+   if( checkpoints )
+   {
+      checkpoints->finish();
+   }
+
+   if( cache )
+   {
+      cache->store( this, currentIter - 1 );
+      cache->report();
+   }
+
+   if( trajectory )
+   {
+      trajectory->close();
+   }
+
+   if( frames )
+   {
+      frames->finish();
+   }
+
+   if( analysis )
+   {
+      analysis->finish();
    }
 
    if( o->progress )
@@ -140,6 +379,85 @@ NernstSim::completeNernstSim()
                 << "  density = "        << (double)o->max_atoms / ( (long)(o->x) * (long)(o->y) )
                 << "  seed = "           << o->randseed
                 << std::endl;
+      std::cout << "vm = "               << vmStats->mean()
+                << " +/- "               << vmStats->stdErr()
+                << " mV  tau_int = "     << vmStats->tau()
+                << " iters  batches = "  << vmStats->batches()
+                << " x "                 << vmStats->batchSize()
+                << "  burn-in = "        << o->burn_in
+                << ( vmStats->settled() ? "" : "  (too short for these estimates)" )
+                << std::endl;
+      reportPhaseTimes();
+   }
+}
+
+
+// Per-thread breakdown of the iteration.  A large barrier share means the
+// run is synchronization-bound; the lattice traffic figure for the claim
+// and move passes, compared against the machine's memory bandwidth, tells
+// memory-bound from compute-bound.
+void
+NernstSim::reportPhaseTimes()
+{
+   static const char *names[ NUM_PHASES ] =
+      { "prep", "claim", "move", "transport", "census", "barrier" };
+   uint64_t sum[ NUM_PHASES ] = { 0 };
+   uint64_t total = 0, threadTotal, scan = 0;
+   double bytes;
+   int i, j;
+
+   if( !phaseTimes )
+   {
+      return;
+   }
+
+   printf( "%-8s", "thread" );
+   for( j = 0; j < NUM_PHASES; j++ )
+   {
+      printf( " %11s", names[ j ] );
+   }
+   printf( " %11s\n", "total" );
+
+   for( i = 0; i < nPhaseThreads; i++ )
+   {
+      threadTotal = 0;
+      printf( "%-8d", i );
+      for( j = 0; j < NUM_PHASES; j++ )
+      {
+         printf( " %11.6f", phaseTimes[ i ].nsec[ j ] * 1.0e-9 );
+         threadTotal += phaseTimes[ i ].nsec[ j ];
+         sum[ j ] += phaseTimes[ i ].nsec[ j ];
+      }
+      printf( " %11.6f\n", threadTotal * 1.0e-9 );
+      total += threadTotal;
+      if( phaseTimes[ i ].nsec[ PHASE_CLAIM ] + phaseTimes[ i ].nsec[ PHASE_MOVE ] > scan )
+      {
+         scan = phaseTimes[ i ].nsec[ PHASE_CLAIM ] + phaseTimes[ i ].nsec[ PHASE_MOVE ];
+      }
+   }
+
+   printf( "%-8s", "share" );
+   for( j = 0; j < NUM_PHASES; j++ )
+   {
+      printf( " %10.1f%%", total ? 100.0 * sum[ j ] / total : 0.0 );
+   }
+   printf( "\n" );
+
+   // Each of the claim and move passes reads every atom and direction byte
+   // and reads or writes every claimed byte.
+   bytes = 2.0 * (double)o->x * o->y * ( currentIter - 1 ) *
+           ( sizeof( struct atom ) + 2 * sizeof( unsigned char ) );
+   if( scan )
+   {
+      printf( "claim+move lattice traffic ~ %.2f GB/s (slowest thread)\n",
+              bytes / ( scan * 1.0e-9 ) / 1.0e9 );
+   }
+
+   if( phaseTimes[ 0 ].calls[ PHASE_BARRIER ] && currentIter > 1 )
+   {
+      printf( "barriers per iteration = %.2f  mean wait = %.2f us (thread 0)\n",
+              (double)phaseTimes[ 0 ].calls[ PHASE_BARRIER ] / ( currentIter - 1 ),
+              phaseTimes[ 0 ].nsec[ PHASE_BARRIER ] * 1.0e-3 / phaseTimes[ 0 ].calls[ PHASE_BARRIER ] );
    }
 }
 
@@ -149,26 +467,91 @@ NernstSim::runSim()
 {
    initNernstSim();
 
-   qtime->start();
+   uint64_t start = nowNsec();
+
+   stepSim();
+
+   elapsed += ( nowNsec() - start ) * 1.0e-9;
+
+   completeNernstSim();
+}
+
+
+// Run the remaining iterations without any setup or teardown.
+void
+NernstSim::stepSim()
+{
+   uint64_t t;
+
+   if( o->engine == ENGINE_BLOCKED )
+   {
+      stepBlocked();
+      return;
+   }
 
    for( ; currentIter <= o->iters; currentIter++ )
    {
       preIter();
       Iter();
+      t = phaseStart();
       postIter();
+      phaseTick( 0, PHASE_CENSUS, &t );
    }
+}
 
-   elapsed += qtime->elapsed() / 1000.0;
 
-   completeNernstSim();
+// The blocked engine advances up to o->block_steps iterations at a time.
+// preIter() and postIter() run once per block, as though the block were a
+// single iteration numbered by its last; a block never steps over an
+// iteration that --frame-every wants a picture of, or --analysis a
+// snapshot of.  --trajectory records every iteration, so with it blocks
+// are one iteration long.
+void
+NernstSim::stepBlocked()
+{
+   uint64_t t;
+   int n;
+
+   if( blocked == NULL )
+   {
+      blocked = safeNew( BlockedEngine( this ) );
+   }
+
+   while( currentIter <= o->iters )
+   {
+      n = o->iters - currentIter + 1;
+      if( n > o->block_steps )
+      {
+         n = o->block_steps;
+      }
+      if( trajectory )
+      {
+         n = 1;
+      }
+      if( frames && n > o->frame_every - ( currentIter - 1 ) % o->frame_every )
+      {
+         n = o->frame_every - ( currentIter - 1 ) % o->frame_every;
+      }
+      if( analysis && n > analysis->period() - ( currentIter - 1 ) % analysis->period() )
+      {
+         n = analysis->period() - ( currentIter - 1 ) % analysis->period();
+      }
+
+      preIter();
+      t = phaseStart();
+      blocked->advance( n );
+      phaseTick( 0, PHASE_MOVE, &t );
+      currentIter += n - 1;
+      postIter();
+      phaseTick( 0, PHASE_CENSUS, &t );
+      currentIter++;
+   }
 }
 
 
 void
 NernstSim::initWorld( struct options *o )
 {
-   int rc = 0;
-
    // Test that the size of the world is a power of 2.
    if( ( o->x * o->y )  &  ( ( o->x * o->y ) - 1 ) )
    {
@@ -180,26 +563,39 @@ NernstSim::initWorld( struct options *o )
       ASSERT( !(  o->threads & ( o->threads - 1 )  ) );
    }
 
-   world   = (struct atom*)calloc( sizeof( struct atom   ) * o->x * o->y, 1 );
-   claimed = (unsigned char*)calloc( sizeof( unsigned char ) * o->x * o->y, 1 );
-
    // Lay out the memory for the direction array.
    for( direction_sz64 = get_min_array_size64() * 8; direction_sz64 < (unsigned int)( o->x * o->y ); direction_sz64 *= 2 );
 
-#ifdef BLR_USELINUX
-   rc = posix_memalign( (void**)&direction, getpagesize(), direction_sz64 );
-#else
-#ifdef BLR_USEMAC
-   direction = (unsigned char*)malloc( direction_sz64 );
-#else
-#ifdef BLR_USEWIN
-   direction = (unsigned char*)malloc( direction_sz64 + 16 );
-   direction += 16 - (long int)direction % 16;
-#endif
-#endif
-#endif
+   // Everything swept each iteration comes from one arena, on huge pages
+   // where possible (see arena.h).  The blocked engine writes each block
+   // into a second world and swaps it in.
+   // A reset to a world that fits reuses the arena rather than asking the
+   // kernel for the pages again.
+   size_t worldSz = sizeof( struct atom ) * o->x * o->y;
+   int twoWorlds = ( o->engine == ENGINE_BLOCKED );
+   size_t arenaSz = Arena::need( worldSz ) * ( twoWorlds ? 2 : 1 ) +
+                    Arena::need( o->x * o->y ) + Arena::need( direction_sz64 );
+
+   if( arena && arena->capacity() >= arenaSz )
+   {
+      arena->reset();
+   } else {
+      delete arena;
+      arena = safeNew( Arena( arenaSz, o->huge_pages ) );
+   }
+   world     = (struct atom *)arena->take( worldSz );
+   worldNext = twoWorlds ? (struct atom *)arena->take( worldSz ) : NULL;
+   claimed   = (unsigned char *)arena->take( o->x * o->y );
+   direction = (unsigned char *)arena->take( direction_sz64 );
+
+   if( poreFluxRows < o->y )
+   {
+      poreFluxRows = o->y;
+      poreFlux = (unsigned int *)realloc( poreFlux, 6 * sizeof( unsigned int ) * poreFluxRows );
+      assert( poreFlux );
+   }
+   memset( poreFlux, 0, 6 * sizeof( unsigned int ) * o->y );
 
-   assert( rc == 0 );
    assert( world && claimed && direction );
 }
 
@@ -241,15 +637,12 @@ NernstSim::ionCharge( unsigned int position )
    switch( world[ position ].color )
    {
       case ATOM_K:
-      case ATOM_K_TRACK:
          q = 1;
          break;
       case ATOM_Na:
-      case ATOM_Na_TRACK:
          q = 1;
          break;
       case ATOM_Cl:
-      case ATOM_Cl_TRACK:
          q = -1;
          break;
       default:
@@ -289,30 +682,152 @@ NernstSim::isPore( unsigned int position )
 int
 NernstSim::isAtom( unsigned int position )
 {
-   return ( world[ position ].color == ATOM_K        ||
-            world[ position ].color == ATOM_K_TRACK  ||
-            world[ position ].color == ATOM_Na       ||
-            world[ position ].color == ATOM_Na_TRACK ||
-            world[ position ].color == ATOM_Cl       ||
-            world[ position ].color == ATOM_Cl_TRACK );
+   return ( world[ position ].color == ATOM_K  ||
+            world[ position ].color == ATOM_Na ||
+            world[ position ].color == ATOM_Cl );
 }
 
 
 int
 NernstSim::isUntrackedAtom( unsigned int position )
 {
-   return ( world[ position ].color == ATOM_K        ||
-            world[ position ].color == ATOM_Na       ||
-            world[ position ].color == ATOM_Cl       );
+   return ( isAtom( position ) && !world[ position ].tracked );
 }
 
 
 int
 NernstSim::isTrackedAtom( unsigned int position )
 {
-   return ( world[ position ].color == ATOM_K_TRACK  ||
-            world[ position ].color == ATOM_Na_TRACK ||
-            world[ position ].color == ATOM_Cl_TRACK );
+   return ( isAtom( position ) && world[ position ].tracked );
+}
+
+
+// Start following the ion at position.  Returns 0 if there is no ion
+// there or it is already tracked.
+int
+NernstSim::trackAtom( unsigned int position )
+{
+   if( !isUntrackedAtom( position ) )
+   {
+      return 0;
+   }
+
+   // Entries are only ever read for tracked ions, so need no clearing,
+   // and the array is kept across resets.
+   if( trackedSlotSz < nIons )
+   {
+      trackedSlotSz = nIons;
+      trackedSlot = (int *)realloc( trackedSlot, sizeof( int ) * trackedSlotSz );
+      assert( trackedSlot );
+   }
+
+   if( nTracked == trackedSz )
+   {
+      trackedSz = trackedSz ? 2 * trackedSz : 64;
+      tracked = (struct trackedIon *)realloc( tracked, sizeof( struct trackedIon ) * trackedSz );
+      assert( tracked );
+   }
+
+   world[ position ].tracked = 1;
+   trackedGen++;
+   trackedSlot[ world[ position ].id ] = nTracked;
+   tracked[ nTracked ].id = world[ position ].id;
+   tracked[ nTracked ].position = position;
+   nTracked++;
+   return 1;
+}
+
+
+void
+NernstSim::untrackAtoms()
+{
+   for( int i = 0; i < nTracked; i++ )
+   {
+      world[ tracked[ i ].position ].tracked = 0;
+   }
+   nTracked = 0;
+   trackedGen++;
+}
+
+
+// Track every ion in the rectangle from ( x0, y0 ) to ( x1, y1 ),
+// inclusive.  Returns how many were added.
+int
+NernstSim::trackRegion( int x0, int y0, int x1, int y1 )
+{
+   int x, y, n = 0;
+
+   x0 = ( x0 < 0 ) ? 0 : x0;
+   y0 = ( y0 < 0 ) ? 0 : y0;
+   x1 = ( x1 > o->x - 1 ) ? o->x - 1 : x1;
+   y1 = ( y1 > o->y - 1 ) ? o->y - 1 : y1;
+
+   for( y = y0; y <= y1; y++ )
+   {
+      for( x = x0; x <= x1; x++ )
+      {
+         n += trackAtom( idx( x, y ) );
+      }
+   }
+   return n;
+}
+
+
+// Track up to perSpecies ions of each species, chosen uniformly from the
+// untracked ones.  This has its own generator so that it does not
+// disturb the simulation's random number sequence.
+int
+NernstSim::trackRandom( int perSpecies )
+{
+   unsigned int *chosen[ 3 ];
+   unsigned int seen[ 3 ] = { 0, 0, 0 };
+   uint32_t r = (uint32_t)o->randseed * 2654435761u + 1;
+   unsigned int position, j;
+   int species, n = 0;
+
+   if( perSpecies <= 0 )
+   {
+      return 0;
+   }
+
+   for( species = 0; species < 3; species++ )
+   {
+      chosen[ species ] = (unsigned int *)malloc( sizeof( unsigned int ) * perSpecies );
+      assert( chosen[ species ] );
+   }
+
+   // Reservoir sampling, one reservoir per species.
+   for( position = 0; position < (unsigned int)( o->x * o->y ); position++ )
+   {
+      if( !isUntrackedAtom( position ) )
+      {
+         continue;
+      }
+
+      species = world[ position ].color - ATOM_K;
+      if( seen[ species ] < (unsigned int)perSpecies )
+      {
+         chosen[ species ][ seen[ species ] ] = position;
+      } else {
+         r ^= r << 13;  r ^= r >> 17;  r ^= r << 5;   // xorshift32
+         j = r % ( seen[ species ] + 1 );
+         if( j < (unsigned int)perSpecies )
+         {
+            chosen[ species ][ j ] = position;
+         }
+      }
+      seen[ species ]++;
+   }
+
+   for( species = 0; species < 3; species++ )
+   {
+      for( j = 0; j < seen[ species ] && j < (unsigned int)perSpecies; j++ )
+      {
+         n += trackAtom( chosen[ species ][ j ] );
+      }
+      free( chosen[ species ] );
+   }
+   return n;
 }
 
 
@@ -333,13 +848,13 @@ NernstSim::isPermeable( unsigned int porePos, unsigned int ionPos )
       switch( poreType )
       {
          case PORE_K:
-            return ( ionType == ATOM_K || ionType == ATOM_K_TRACK );
+            return ( ionType == ATOM_K );
             break;
          case PORE_Na:
-            return ( ionType == ATOM_Na || ionType == ATOM_Na_TRACK );
+            return ( ionType == ATOM_Na );
             break;
          case PORE_Cl:
-            return ( ionType == ATOM_Cl || ionType == ATOM_Cl_TRACK );
+            return ( ionType == ATOM_Cl );
             break;
          default:
 #ifndef QT_NO_DEBUG
@@ -363,10 +878,187 @@ NernstSim::copyAtom( unsigned int from, unsigned int to, int dx, int dy )
    world[ to ].delta_x = world[ from ].delta_x + dx;
    world[ to ].delta_y = world[ from ].delta_y + dy;
    world[ to ].color   = world[ from ].color;
+   world[ to ].moved   = world[ from ].moved;
+   world[ to ].tracked = world[ from ].tracked;
+   world[ to ].id      = world[ from ].id;
+
+   if( world[ to ].tracked )
+   {
+      tracked[ trackedSlot[ world[ to ].id ] ].position = to;
+   }
 
    world[ from ].delta_x = SOLVENT;
    world[ from ].delta_y = SOLVENT;
    world[ from ].color   = SOLVENT;
+   world[ from ].tracked = 0;
+}
+
+
+// The membrane potential (mV) predicted by the Goldman-Hodgkin-Katz
+// voltage equation for the ions now on each side, with the same sign as
+// static.out's vm.
+double
+NernstSim::ghkPotential()
+{
+   return o->R * o->t / o->F *
+          log( ( ( o->pK * initRHS_K ) + ( o->pNa * initRHS_Na ) + ( o->pCl * initLHS_Cl ) ) /
+               ( ( o->pK * initLHS_K ) + ( o->pNa * initLHS_Na ) + ( o->pCl * initRHS_Cl ) ) ) * 1000;
+}
+
+
+// Start the membrane close to its equilibrium charge instead of at zero,
+// so that a run spends its iterations at equilibrium rather than getting
+// there.  The GHK potential gives the charge; moving one ion across
+// changes LRcharge by 2.  Each ion is drawn from the species that would
+// have carried the charge, in proportion to permeability times
+// concentration on the side it leaves, and placed in the first free
+// square next to the membrane on the other side, where the double layer
+// would have formed.  Uses a generator of its own so the simulation's
+// random numbers are the same with or without.
+int
+NernstSim::preCharge()
+{
+   unsigned int *pos[ 3 ];
+   int n[ 3 ] = { 0, 0, 0 }, sz[ 3 ] = { 0, 0, 0 };
+   double w[ 3 ], total, pick;
+   int target, moves, moved, dir, src, s, x, y, i, j, k, tmp, m = o->x / 2;
+   int *rows, col[ 2 ] = { 1, 1 }, row[ 2 ] = { 0, 0 }, side;
+   unsigned int from, to;
+   uint32_t r = (uint32_t)o->randseed * 2246822519u + 7;
+
+   if( !o->electrostatics )
+   {
+      return 0;
+   }
+
+   // LRcharge is the charge on the left less that on the right, so a
+   // negative potential wants cations moved left to right (dir 1) or
+   // anions right to left.
+   target = (int)floor( ghkPotential() / 1000 * o->c * o->a * o->y / o->e + 0.5 );
+   moves = abs( target - LRcharge ) / 2;
+   if( moves == 0 )
+   {
+      return 0;
+   }
+   dir = ( target < LRcharge ) ? 1 : -1;
+
+   // Each species' ions on the side it would leave from: cations leave
+   // the left when dir is 1, anions the right.
+   for( s = 0; s < 3; s++ )
+   {
+      src = ( ( s == 2 ) == ( dir == 1 ) ) ? 1 : -1;
+      for( x = ( src < 0 ) ? 1 : m + 1; x < ( ( src < 0 ) ? m : o->x - 1 ); x++ )
+      {
+         for( y = 0; y < o->y; y++ )
+         {
+            if( world[ idx( x, y ) ].color == ATOM_K + s )
+            {
+               sz[ s ]++;
+            }
+         }
+      }
+      pos[ s ] = (unsigned int *)malloc( sizeof( unsigned int ) * ( sz[ s ] + 1 ) );
+      assert( pos[ s ] );
+      for( x = ( src < 0 ) ? 1 : m + 1; x < ( ( src < 0 ) ? m : o->x - 1 ); x++ )
+      {
+         for( y = 0; y < o->y; y++ )
+         {
+            if( world[ idx( x, y ) ].color == ATOM_K + s )
+            {
+               pos[ s ][ n[ s ]++ ] = idx( x, y );
+            }
+         }
+      }
+   }
+
+   // Rows in a random order, so the layer does not pile up at the top.
+   rows = (int *)malloc( sizeof( int ) * o->y );
+   assert( rows );
+   for( y = 0; y < o->y; y++ )
+   {
+      rows[ y ] = y;
+   }
+   for( i = o->y - 1; i > 0; i-- )
+   {
+      r ^= r << 13;  r ^= r >> 17;  r ^= r << 5;   // xorshift32
+      j = r % ( i + 1 );
+      tmp = rows[ i ];
+      rows[ i ] = rows[ j ];
+      rows[ j ] = tmp;
+   }
+
+   for( moved = 0; moved < moves; moved++ )
+   {
+      w[ 0 ] = o->pK  * n[ 0 ];
+      w[ 1 ] = o->pNa * n[ 1 ];
+      w[ 2 ] = o->pCl * n[ 2 ];
+      total = w[ 0 ] + w[ 1 ] + w[ 2 ];
+      if( total <= 0 )
+      {
+         break;
+      }
+      r ^= r << 13;  r ^= r >> 17;  r ^= r << 5;
+      pick = ( r / 4294967296.0 ) * total;
+      for( s = 0; s < 2 && pick >= w[ s ]; s++ )
+      {
+         pick -= w[ s ];
+      }
+      while( n[ s ] == 0 )   // rounding
+      {
+         s = ( s + 2 ) % 3;
+      }
+      r ^= r << 13;  r ^= r >> 17;  r ^= r << 5;
+      k = r % n[ s ];
+      from = pos[ s ][ k ];
+      pos[ s ][ k ] = pos[ s ][ --n[ s ] ];
+
+      // The next free square next to the membrane on the other side,
+      // working outwards a column at a time.
+      src = ( getX( from ) < m ) ? -1 : 1;
+      side = ( src < 0 );
+      for( to = from; col[ side ] < m - 1 && to == from; )
+      {
+         to = idx( m - src * col[ side ], rows[ row[ side ] ] );
+         if( ++row[ side ] == o->y )
+         {
+            row[ side ] = 0;
+            col[ side ]++;
+         }
+         if( !isSolvent( to ) )
+         {
+            to = from;
+         }
+      }
+      if( to == from )
+      {
+         break;
+      }
+
+      copyAtom( from, to, 0, 0 );   // placed there, not moved
+      LRcharge += 2 * src * ( ( s == 2 ) ? -1 : 1 );
+      switch( s )
+      {
+         case 0:
+            initLHS_K  += src;
+            initRHS_K  -= src;
+            break;
+         case 1:
+            initLHS_Na += src;
+            initRHS_Na -= src;
+            break;
+         default:
+            initLHS_Cl += src;
+            initRHS_Cl -= src;
+            break;
+      }
+   }
+
+   for( s = 0; s < 3; s++ )
+   {
+      free( pos[ s ] );
+   }
+   free( rows );
+   return moved;
 }
 
 
@@ -388,7 +1080,7 @@ NernstSim::shouldTransport( unsigned int from, unsigned int to )
 
    if( !o->electrostatics )
    {
-      return ( direction[ to ] % 256 <= 127 );
+      return transportAccepted( 0, direction[ to ] );
    }
 
    int q;
@@ -397,16 +1089,12 @@ NernstSim::shouldTransport( unsigned int from, unsigned int to )
    // Moving left to right across membrane.
    if( getX( from ) == o->x / 2 - 1 && getX( to ) == o->x / 2 + 1 )
    {
-      //return ( direction[ to ] % 256 <= 16 * exp( o->cBoltz * LRcharge * q / o->y ) );
-      double ratio = exp( 2 * o->cBoltz * LRcharge * q / o->y );
-      return ( direction[ to ] % 256 <= 256*ratio/(1+ratio) );
+      return transportAccepted( q, direction[ to ] );
    } else {
       // Moving right to left across membrane.
       if( getX( from ) == o->x / 2 + 1 && getX( to ) == o->x / 2 - 1 )
       {
-         //return ( direction[ to ] % 256 <= 16 * exp( o->cBoltz * LRcharge * -q / o->y ) );
-         double ratio = exp( 2 * o->cBoltz * LRcharge * -q / o->y );
-         return ( direction[ to ] % 256 <= 256*ratio/(1+ratio) );
+         return transportAccepted( -q, direction[ to ] );
       } else {
 #ifndef QT_NO_DEBUG
          ASSERT( ( getX( from ) == o->x / 2 - 1 && getX( to ) == o->x / 2 + 1 ) || ( getX( from ) == o->x / 2 + 1 && getX( from ) == o->x / 2 - 1 ) );
@@ -417,21 +1105,37 @@ NernstSim::shouldTransport( unsigned int from, unsigned int to )
 }
 
 
+// The Boltzmann acceptance test for one pore crossing.  q is the ion's
+// charge, negated when it moves right to left; r is the random byte.
+int
+NernstSim::transportAccepted( int q, unsigned char r )
+{
+   if( !o->electrostatics )
+   {
+      return ( r % 256 <= 127 );
+   }
+
+   //return ( r % 256 <= 16 * exp( o->cBoltz * LRcharge * q / o->y ) );
+   double ratio = exp( 2 * o->cBoltz * LRcharge * q / o->y );
+   return ( r % 256 <= 256*ratio/(1+ratio) );
+}
+
+
 void
 NernstSim::shufflePositions( struct options *o )
 {
-   static int initialized = 0;
    unsigned int i, highest, lowest, range, rand, temp;
    assert( o->x <= MAX_X && o->y <= MAX_Y );
 
-   if( !initialized )
+   // Each simulation owns its own position arrays so that several can
+   // exist in one process (e.g. when benchmarking).
+   if( positionsLHS == NULL )
    {
       positionsLHS   = (unsigned int*)malloc( sizeof( unsigned int ) * ( MAX_X / 2 - 1 ) * ( MAX_Y ) );
       positionsRHS   = (unsigned int*)malloc( sizeof( unsigned int ) * ( MAX_X / 2 - 2 ) * ( MAX_Y ) );
       positionsPORES = (unsigned int*)malloc( sizeof( unsigned int ) * ( 1 )             * ( MAX_Y / 2 ) );
 
       assert( positionsLHS && positionsRHS && positionsPORES );
-      initialized = 1;
    }
 
    // Initialize the position arrays
@@ -485,6 +1189,8 @@ NernstSim::shufflePositions( struct options *o )
       positionsPORES[ i ] = positionsPORES[ rand ];
       positionsPORES[ rand ] = temp;
    }
+
+   positionsGen++;
 }
 
 
@@ -553,8 +1259,6 @@ NernstSim::initAtoms( struct options *options )
    off_se = (  o->x + 1 );
    off_sw = (  o->x - 1 );
 
-   dir2offset = (int*)malloc( sizeof( unsigned int ) * 8 );
-   assert( dir2offset );
    dir2offset[ 0 ] = off_n;
    dir2offset[ 1 ] = off_s;
    dir2offset[ 2 ] = off_e;
@@ -580,10 +1284,16 @@ NernstSim::initAtoms( struct options *options )
    initLHS_Cl = 0;
    initRHS_Cl = 0;
 
+   // Tracking does not survive a new world; ids are handed out in the
+   // order ions are placed.
+   nTracked = 0;
+
    // Set up the solvent.
    for( i = 0; i < o->x * o->y; i++ )
    {
-      world[ i ].color = SOLVENT;
+      world[ i ].color   = SOLVENT;
+      world[ i ].tracked = 0;
+      world[ i ].id      = 0;
    }
 
    // Initialize LHS atoms.
@@ -604,6 +1314,7 @@ NernstSim::initAtoms( struct options *options )
       world[ current_idx ].delta_x = 0;
       world[ current_idx ].delta_y = 0;
       world[ current_idx ].color   = ATOM_K;
+      world[ current_idx ].id      = placed;
       LRcharge++;
       initLHS_K++;
 
@@ -619,6 +1330,7 @@ NernstSim::initAtoms( struct options *options )
       world[ current_idx ].delta_x = 0;
       world[ current_idx ].delta_y = 0;
       world[ current_idx ].color   = ATOM_Na;
+      world[ current_idx ].id      = placed;
       LRcharge++;
       initLHS_Na++;
 
@@ -634,6 +1346,7 @@ NernstSim::initAtoms( struct options *options )
       world[ current_idx ].delta_x = 0;
       world[ current_idx ].delta_y = 0;
       world[ current_idx ].color   = ATOM_Cl;
+      world[ current_idx ].id      = placed;
       LRcharge--;
       initLHS_Cl++;
 
@@ -658,6 +1371,7 @@ NernstSim::initAtoms( struct options *options )
       world[ current_idx ].delta_x = 0;
       world[ current_idx ].delta_y = 0;
       world[ current_idx ].color   = ATOM_K;
+      world[ current_idx ].id      = placed;
       LRcharge--;
       initRHS_K++;
 
@@ -673,6 +1387,7 @@ NernstSim::initAtoms( struct options *options )
       world[ current_idx ].delta_x = 0;
       world[ current_idx ].delta_y = 0;
       world[ current_idx ].color   = ATOM_Na;
+      world[ current_idx ].id      = placed;
       LRcharge--;
       initRHS_Na++;
 
@@ -688,6 +1403,7 @@ NernstSim::initAtoms( struct options *options )
       world[ current_idx ].delta_x = 0;
       world[ current_idx ].delta_y = 0;
       world[ current_idx ].color   = ATOM_Cl;
+      world[ current_idx ].id      = placed;
       LRcharge++;
       initRHS_Cl++;
 
@@ -711,16 +1427,25 @@ NernstSim::initAtoms( struct options *options )
 
    // Record number of atoms placed to print out later.
    o->max_atoms = placed;
+   // Ids must not wrap: trackedSlot[] is indexed by them.
+   ASSERT( placed <= MAX_IONS );
+   nIons = placed;
 }
 
 
 void
 NernstSim::moveAtoms(unsigned int start_idx, unsigned int end_idx)
 {
+   uint64_t t = phaseStart();
+
    moveAtoms_prep();
+   phaseTick( 0, PHASE_PREP, &t );
    moveAtoms_stakeclaim();
+   phaseTick( 0, PHASE_CLAIM, &t );
    moveAtoms_move(start_idx, end_idx);
+   phaseTick( 0, PHASE_MOVE, &t );
    moveAtoms_poretransport();
+   phaseTick( 0, PHASE_TRANSPORT, &t );
 }
 
 void
@@ -820,6 +1545,176 @@ NernstSim::moveAtoms_move(unsigned int start_idx, unsigned int end_idx){
    
 }
 
+// --atomic-claims.  Cells within two rows of a slice's ends may be
+// claimed by the neighbouring thread too, so claims there are atomic.
+static inline void
+claimShared( unsigned char *c )
+{
+#ifdef __ATOMIC_RELAXED
+   __atomic_fetch_add( c, 1, __ATOMIC_RELAXED );
+#else
+   __sync_fetch_and_add( c, 1 );
+#endif
+}
+
+
+// The cells a neighbouring thread may move an ion into are read and
+// written with these while the move pass runs.  Compilers without the
+// __atomic builtins get full barriers around volatile accesses.
+static inline unsigned char
+loadClaim( unsigned char *c )
+{
+#ifdef __ATOMIC_ACQUIRE
+   return __atomic_load_n( c, __ATOMIC_ACQUIRE );
+#else
+   unsigned char v = *(volatile unsigned char *)c;
+   __sync_synchronize();
+   return v;
+#endif
+}
+
+
+static inline void
+storeClaim( unsigned char *c, unsigned char v )
+{
+#ifdef __ATOMIC_RELEASE
+   __atomic_store_n( c, v, __ATOMIC_RELEASE );
+#else
+   __sync_synchronize();
+   *(volatile unsigned char *)c = v;
+#endif
+}
+
+
+static inline uint32_t
+loadBits( struct atom *a )
+{
+#ifdef __ATOMIC_ACQUIRE
+   return __atomic_load_n( &a->bits, __ATOMIC_ACQUIRE );
+#else
+   uint32_t v = *(volatile uint32_t *)&a->bits;
+   __sync_synchronize();
+   return v;
+#endif
+}
+
+
+static inline void
+storeBits( struct atom *a, uint32_t v )
+{
+#ifdef __ATOMIC_RELEASE
+   __atomic_store_n( &a->bits, v, __ATOMIC_RELEASE );
+#else
+   __sync_synchronize();
+   *(volatile uint32_t *)&a->bits = v;
+#endif
+}
+
+
+// As moveAtoms_stakeclaim(), but safe to run on adjoining slices at the
+// same time.  An ion reaches at most o->x + 1 cells, so claims from deeper
+// than twice that inside the slice land where no other thread can, and
+// need no atomics.
+void
+NernstSim::moveAtoms_stakeclaim_atomic(unsigned int start_idx, unsigned int end_idx){
+
+   unsigned int from, to, edge0, edge1, reach = 2 * ( o->x + 1 );
+
+   if( end_idx - start_idx > 2 * reach )
+   {
+      edge0 = start_idx + reach;
+      edge1 = end_idx - reach;
+   } else {
+      edge0 = edge1 = end_idx;
+   }
+
+   for( from = start_idx; from < end_idx; from++ )
+   {
+      if( from == edge0 )
+      {
+         // The interior, exactly as moveAtoms_stakeclaim().
+         for( ; from < edge1; from++ )
+         {
+            if( isAtom( from ) )
+            {
+               claimed[ from ]++;
+               to = ( from + dir2offset[ direction[ from ] & DIR_MASK ] ) & WORLD_SZ_MASK;
+               claimed[ to ]++;
+            }
+            if( isMembrane( from ) || isPore( from ) )
+            {
+               claimed[ from ]++;
+            }
+         }
+         if( from == end_idx )
+         {
+            break;
+         }
+      }
+
+      if( isAtom( from ) )
+      {
+         claimShared( &claimed[ from ] );
+         to = ( from + dir2offset[ direction[ from ] & DIR_MASK ] ) & WORLD_SZ_MASK;
+         claimShared( &claimed[ to ] );
+      }
+      if( isMembrane( from ) || isPore( from ) )
+      {
+         claimShared( &claimed[ from ] );
+      }
+   }
+}
+
+
+// As moveAtoms_move(), but safe to run on adjoining slices at the same
+// time.  A thread moving an ion into the next slice could otherwise race
+// that slice's thread looking at the same cell and see the ion arrive
+// before the claim is cleared, and move it twice.  So the mover clears the
+// claim, then writes the ion with its color word last, as a release; the
+// scan reads each color word as an acquire before looking at the claim.
+// Whoever sees the ion therefore also sees the cleared claim.  Claims and
+// color words are only touched atomically here; the rest of a cell is
+// only read by the thread that moves its ion, which no other thread can
+// have written this pass.
+void
+NernstSim::moveAtoms_move_atomic(unsigned int start_idx, unsigned int end_idx){
+
+   unsigned int dir = 0, from = 0, to = 0;
+   static int dir2dx[] = { 0, 0, 1, -1, 1, -1, 1, -1 };   // N S E W NE NW SE SW
+   static int dir2dy[] = { -1, 1, 0, 0, -1, -1, 1, 1 };
+   struct atom a;
+
+   for( from = start_idx; from < end_idx; from++ )
+   {
+      a.bits = loadBits( &world[ from ] );
+      if( ( a.color == ATOM_K || a.color == ATOM_Na || a.color == ATOM_Cl ) &&
+          loadClaim( &claimed[ from ] ) == 1 )
+      {
+         dir = direction[ from ] & DIR_MASK;
+         to = ( from + dir2offset[ dir ] ) & WORLD_SZ_MASK;
+
+         if( loadClaim( &claimed[ to ] ) == 1 )
+         {
+            // copyAtom(), publishing the ion last.
+            storeClaim( &claimed[ to ], 0 );
+            world[ to ].delta_x = world[ from ].delta_x + dir2dx[ dir ];
+            world[ to ].delta_y = world[ from ].delta_y + dir2dy[ dir ];
+            if( a.tracked )
+            {
+               tracked[ trackedSlot[ a.id ] ].position = to;
+            }
+            storeBits( &world[ to ], a.bits );
+
+            world[ from ].delta_x = SOLVENT;
+            world[ from ].delta_y = SOLVENT;
+            world[ from ].color   = SOLVENT;
+            world[ from ].tracked = 0;
+         }
+      }
+   }
+}
+
+
 void
 NernstSim::moveAtoms_poretransport(unsigned int start_idx, unsigned int end_idx){
    // Transport atoms through pores.
@@ -847,20 +1742,18 @@ NernstSim::moveAtoms_poretransport(unsigned int start_idx, unsigned int end_idx)
             int q = ionCharge( from );
             copyAtom( from, to, 2, 0 );
             LRcharge += -2 * q;
+            countCrossing( y, world[ to ].color, 0 );
             switch( world[ to ].color )
             {
                case ATOM_K:
-               case ATOM_K_TRACK:
                   initLHS_K--;
                   initRHS_K++;
                   break;
                case ATOM_Na:
-               case ATOM_Na_TRACK:
                   initLHS_Na--;
                   initRHS_Na++;
                   break;
                case ATOM_Cl:
-               case ATOM_Cl_TRACK:
                   initLHS_Cl--;
                   initRHS_Cl++;
                   break;
@@ -882,20 +1775,18 @@ NernstSim::moveAtoms_poretransport(unsigned int start_idx, unsigned int end_idx)
                int q = ionCharge( from );
                copyAtom( from, to, -2, 0 );
                LRcharge += 2 * q;
+               countCrossing( y, world[ to ].color, 1 );
                switch( world[ to ].color )
                {
                   case ATOM_K:
-                  case ATOM_K_TRACK:
                      initLHS_K++;
                      initRHS_K--;
                      break;
                   case ATOM_Na:
-                  case ATOM_Na_TRACK:
                      initLHS_Na++;
                      initRHS_Na--;
                      break;
                   case ATOM_Cl:
-                  case ATOM_Cl_TRACK:
                      initLHS_Cl++;
                      initRHS_Cl--;
                      break;
@@ -918,90 +1809,158 @@ void
 NernstSim::takeCensus( int iter )
 {
    int x, y;
-   int K, Na, Cl;
-   static int initialized = 0;
-   static FILE *fp;
+   int counts[ 6 ];   // LHS K, Na, Cl, then RHS K, Na, Cl
 
    if( iter < 0 )
    {
-      if( fp )
-      {
-         fclose( fp );
-      }
-      initialized = 0;
+      writeCensus( iter, NULL, 0 );
       return;
    }
 
-   if( !initialized )
+   // Count atoms on LHS
+   memset( counts, 0, sizeof( counts ) );
+   for( x = 0; x < o->x / 2; x++ )
    {
-      initialized = 1;
-      fp = fopen( "static.out", "w" );
-      if( fp )
+      for( y = 0; y < o->y; y++ )
       {
-         fprintf( fp, "T LK LNa LCl RK RNa RCl q vm\n" );
+         switch( world[ idx( x, y ) ].color )
+         {
+            case ATOM_K:
+               counts[ 0 ]++;
+               break;
+            case ATOM_Na:
+               counts[ 1 ]++;
+               break;
+            case ATOM_Cl:
+               counts[ 2 ]++;
+            default:
+               break;
+         }
       }
    }
 
-   if( fp )
+   // Count atoms on RHS
+   for( x = o->x / 2 + 1; x < o->x; x++ )
    {
-      fprintf( fp, "%d ", iter );
-
-      // Count atoms on LHS
-      for( x = 0, K = 0, Na = 0, Cl = 0; x < o->x / 2; x++ )
+      for( y = 0; y < o->y; y++ )
       {
-         for( y = 0; y < o->y; y++ )
+         switch( world[ idx( x, y ) ].color )
          {
-            switch( world[ idx( x, y ) ].color )
-            {
-               case ATOM_K:
-               case ATOM_K_TRACK:
-                  K++;
-                  break;
-               case ATOM_Na:
-               case ATOM_Na_TRACK:
-                  Na++;
-                  break;
-               case ATOM_Cl:
-               case ATOM_Cl_TRACK:
-                  Cl++;
-               default:
-                  break;
-            }
+            case ATOM_K:
+               counts[ 3 ]++;
+               break;
+            case ATOM_Na:
+               counts[ 4 ]++;
+               break;
+            case ATOM_Cl:
+               counts[ 5 ]++;
+               break;
+            default:
+               break;
          }
       }
-      fprintf( fp, "%d %d %d ", K, Na, Cl );
+   }
+
+   writeCensus( iter, counts, LRcharge );
+}
 
-      // Count atoms on RHS
-      for( x = o->x / 2 + 1, K = 0, Na = 0, Cl = 0; x < o->x; x++ )
+
+// static.out, open from the first census line until takeCensus( -1 ).
+static int censusOpen = 0;
+static FILE *censusFp;
+
+
+// Append one line to static.out, opening it the first time.  iter < 0
+// closes it, cut where it was last written: a resumed run may have
+// rewritten an older, longer one.  The blocked engine calls this directly
+// for the iterations inside a block, whose world is never materialized.
+void
+NernstSim::writeCensus( int iter, const int *counts, int charge )
+{
+   FILE *fp;
+
+   if( iter < 0 )
+   {
+      if( censusFp )
       {
-         for( y = 0; y < o->y; y++ )
+         fflush( censusFp );
+         if( ftruncate( fileno( censusFp ), ftell( censusFp ) ) != 0 )
          {
-            switch( world[ idx( x, y ) ].color )
-            {
-               case ATOM_K:
-               case ATOM_K_TRACK:
-                  K++;
-                  break;
-               case ATOM_Na:
-               case ATOM_Na_TRACK:
-                  Na++;
-                  break;
-               case ATOM_Cl:
-               case ATOM_Cl_TRACK:
-                  Cl++;
-                  break;
-               default:
-                  break;
-            }
+            perror( "static.out" );
          }
+         fclose( censusFp );
+         censusFp = NULL;
       }
-      fprintf( fp, "%d %d %d ", K, Na, Cl );
+      censusOpen = 0;
+      return;
+   }
+
+   if( !censusOpen )
+   {
+      censusOpen = 1;
+      censusFp = fopen( "static.out", "w" );
+      if( censusFp )
+      {
+         fprintf( censusFp, "T LK LNa LCl RK RNa RCl q vm\n" );
+      }
+   }
+
+   fp = censusFp;
+   if( fp )
+   {
+      fprintf( fp, "%d ", iter );
+      fprintf( fp, "%d %d %d ", counts[ 0 ], counts[ 1 ], counts[ 2 ] );
+      fprintf( fp, "%d %d %d ", counts[ 3 ], counts[ 4 ], counts[ 5 ] );
 
       // Output net charge across membrane
-      fprintf( fp, "%d ", LRcharge );
+      fprintf( fp, "%d ", charge );
 
       // Output membrane potential in mV
-      fprintf( fp, "%f\n", LRcharge * o->e / ( o->c * o->a * o->y ) * 1000 );
+      fprintf( fp, "%f\n", charge * o->e / ( o->c * o->a * o->y ) * 1000 );
+   }
+}
+
+
+// How much of static.out has been written, with all of it flushed, or -1
+// if it is not open.  For checkpoints.
+long
+NernstSim::censusBytes()
+{
+   if( !censusOpen || !censusFp )
+   {
+      return -1;
+   }
+   fflush( censusFp );
+   return ftell( censusFp );
+}
+
+
+// Carry on writing static.out after its first offset bytes, as they were
+// when a checkpoint was taken.  If it is gone, start it again.
+void
+NernstSim::resumeCensus( long offset )
+{
+   if( censusOpen && censusFp )
+   {
+      fclose( censusFp );
+   }
+   censusOpen = 1;
+   censusFp = fopen( "static.out", "r+" );
+   if( censusFp && fseek( censusFp, 0, SEEK_END ) == 0 && ftell( censusFp ) >= offset &&
+       fseek( censusFp, offset, SEEK_SET ) == 0 )
+   {
+      return;
+   }
+   fprintf( stderr, "static.out is missing or shorter than the checkpoint; "
+                    "it will only have the resumed iterations.\n" );
+   if( censusFp )
+   {
+      fclose( censusFp );
+   }
+   censusFp = fopen( "static.out", "w" );
+   if( censusFp )
+   {
+      fprintf( censusFp, "T LK LNa LCl RK RNa RCl q vm\n" );
    }
 }
 
@@ -1026,15 +1985,12 @@ NernstSim::finalizeAtoms()
                switch( world[ idx( x, y ) ].color )
                {
                   case ATOM_K:
-                  case ATOM_K_TRACK:
                      type = 1;
                      break;
                   case ATOM_Na:
-                  case ATOM_Na_TRACK:
                      type = 2;
                      break;
                   case ATOM_Cl:
-                  case ATOM_Cl_TRACK:
                      type = 3;
                      break;
                   default:
@@ -1051,3 +2007,72 @@ NernstSim::finalizeAtoms()
    }
 }
 
+
+// One iteration's potential into vmStats, once past --burn-in.
+void
+NernstSim::sampleCharge( int iter, int charge )
+{
+   if( iter > o->burn_in )
+   {
+      vmStats->add( charge * o->e / ( o->c * o->a * o->y ) * 1000 );
+   }
+}
+
+
+// The mean potential after --burn-in, its standard error (mV) and the
+// integrated autocorrelation time (iterations), with what they rest on:
+// the number of samples, and of batches and their size.  settled is 0 if
+// the batches are too short for the estimates to be trusted.
+void
+NernstSim::writeStats()
+{
+   FILE *fp;
+
+   fp = fopen( "stats.out", "w" );
+   if( !fp )
+   {
+      perror( "stats.out" );
+      return;
+   }
+   fprintf( fp, "n burn_in mean se tau_int batches batch_size settled\n" );
+   fprintf( fp, "%ld %d %f %f %f %d %ld %d\n", vmStats->count(), o->burn_in,
+            vmStats->mean(), vmStats->stdErr(), vmStats->tau(), vmStats->batches(),
+            vmStats->batchSize(), vmStats->settled() );
+   fclose( fp );
+}
+
+
+// One line per pore: its row and kind, its crossings by species and
+// direction (lr is left to right), and the net charge it carried left to
+// right over the run.
+void
+NernstSim::writePoreSummary()
+{
+   static const char *kinds[] = { "K", "Na", "Cl" };
+   const unsigned int *f;
+   unsigned int pore;
+   FILE *fp;
+   int y;
+
+   fp = fopen( o->pore_summary, "w" );
+   if( !fp )
+   {
+      perror( o->pore_summary );
+      return;
+   }
+   fprintf( fp, "y pore K_lr K_rl Na_lr Na_rl Cl_lr Cl_rl q_net\n" );
+   for( y = 0; y < o->y; y++ )
+   {
+      pore = world[ idx( o->x / 2, y ) ].color;
+      if( !isPore( idx( o->x / 2, y ) ) )
+      {
+         continue;
+      }
+      f = poreFlux + 6 * y;
+      fprintf( fp, "%d %s %u %u %u %u %u %u %d\n", y, kinds[ pore - PORE_K ],
+               f[ 0 ], f[ 1 ], f[ 2 ], f[ 3 ], f[ 4 ], f[ 5 ],
+               (int)( f[ 0 ] - f[ 1 ] ) + (int)( f[ 2 ] - f[ 3 ] ) - (int)( f[ 4 ] - f[ 5 ] ) );
+   }
+   fclose( fp );
+}
+
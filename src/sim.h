@@ -26,6 +26,17 @@
 
 #include <QTime>
 #include <stdint.h>
+#include "timing.h"
+
+class TrajectoryWriter;
+class FrameWriter;
+class BlockedEngine;
+class SublatticeEngine;
+class Arena;
+class AnalysisPipeline;
+class StateCache;
+class Checkpointer;
+class BatchMeans;
 
 enum
 {
@@ -36,17 +47,17 @@ enum
    //MAX_X = 65536,
    //MAX_Y = 65536,
    MIN_ITERS = 1,
-   MAX_ITERS = 100000,
+   MAX_ITERS = 100000,  // top of the GUI's slider; longer runs are fine
    MIN_CONC = 0,     // Minimum ion concentration (mM)
    MAX_CONC = 2000,  // Maximum ion concentration (mM)
+   MAX_IONS = 1 << 23,  // so ids fit struct atom's 23 bits.  A MAX_X x MAX_Y
+                        // world holds at most about 4M ions; 8192 x 8192 could
+                        // hold too many.
    // Things that need colors
    SOLVENT=0,
    ATOM_K,
-   ATOM_K_TRACK,
    ATOM_Na,
-   ATOM_Na_TRACK,
    ATOM_Cl,
-   ATOM_Cl_TRACK,
    MEMBRANE,
    PORE_K,
    PORE_Na,
@@ -55,23 +66,71 @@ enum
 };
 
 
+// Where the time goes in one iteration.  Accumulated per thread when
+// profiling; see phaseTick().
+enum
+{
+   PHASE_PREP = 0,
+   PHASE_CLAIM,
+   PHASE_MOVE,
+   PHASE_TRANSPORT,
+   PHASE_CENSUS,
+   PHASE_BARRIER,
+   NUM_PHASES
+};
+
+struct phaseTimes
+{
+   uint64_t nsec[ NUM_PHASES ];
+   uint64_t calls[ NUM_PHASES ];
+   char pad[ 128 - 2 * NUM_PHASES * sizeof( uint64_t ) ];   // keep threads off each other's cache lines
+};
+
+
 struct atom
 {
-   int delta_x, delta_y;   // 4 bytes, 4 bytes
-   uint8_t color;          // 1 byte
-                           // ----------------
-                           // 17 bytes
+   int delta_x, delta_y;      // 4 bytes, 4 bytes
+   union
+   {
+      struct
+      {
+         uint32_t color   : 7;   // 4 bytes, shared
+         uint32_t moved   : 1;   //   by these four
+         uint32_t tracked : 1;   //   (moved is the sublattice engine's;
+         uint32_t id      : 23;  //   id is stable for the life of an ion;
+                                 //   under MAX_IONS, see initAtoms())
+      };
+      uint32_t bits;          // all four at once, for --atomic-claims
+   };
+                              // ----------------
+                              // 12 bytes
+};
+
+
+// An ion being followed, and where it is now.
+struct trackedIon
+{
+   uint32_t id;
+   unsigned int position;
 };
 
 class NernstSim 
 {
+   friend class WorkerThread;
+   friend class BlockedEngine;
+   friend class SublatticeEngine;
+   friend class Checkpointer;
+
    public:
       NernstSim( struct options *options );
+      virtual ~NernstSim();
       void runSim();
+      void stepSim();
       struct atom *world;
       unsigned long int direction_sz64;
       unsigned char *claimed;
       unsigned char *direction;
+      struct atom *worldNext;        // the blocked engine's second world, or NULL
       struct options *o;
       int LRcharge;           // (publicRO) Net charge on left minus net charge on right
       int initLHS_K,  initRHS_K;	 //publicRO
@@ -80,13 +139,38 @@ class NernstSim
       unsigned int *positionsLHS;
       unsigned int *positionsRHS;
       unsigned int *positionsPORES;
+      int positionsGen;       // bumped each time shufflePositions() reorders them
+
+      // Pore crossings since initNernstSim(), six counters per row:
+      // poreFlux[ 6 * y + 2 * ( color - ATOM_K ) + dir ], where dir is 0
+      // for left to right and 1 for right to left.  Only rows with a pore
+      // ever count.
+      unsigned int *poreFlux;
+      void countCrossing( int y, int color, int dir );
       unsigned long int idx( int x, int y );
       int ionCharge( unsigned int position );
       int isUntrackedAtom( unsigned int position );
       int isTrackedAtom( unsigned int position );
+
+      // Tracked ions.  copyAtom() keeps their positions current, so
+      // finding or releasing them costs O(tracked), not O(world).
+      struct trackedIon *tracked;
+      int nTracked;
+      int trackedGen;         // bumped whenever the set of tracked ions changes
+      int trackAtom( unsigned int position );
+      void untrackAtoms();
+      int trackRegion( int x0, int y0, int x1, int y1 );
+      int trackRandom( int perSpecies );
       void shufflePositions( struct options *o );
       void distributePores( struct options *o );
       void initAtoms( struct options *options );
+      double ghkPotential();  // mV, from the current counts on each side
+      int preCharge();        // see --equilibrium-init; returns ions moved
+
+      // The potential (mV) of every iteration after --burn-in, for its
+      // mean, standard error and autocorrelation time (stats.h).
+      BatchMeans *vmStats;
+      void sampleCharge( int iter, int charge );
       QTime *qtime;
       int rpt;	//cells per thread.
       void initNernstSim();
@@ -95,22 +179,42 @@ class NernstSim
       void moveAtoms_prep(unsigned int start_idx=0, unsigned int end_idx=0);
       void moveAtoms_stakeclaim(unsigned int start_idx=0, unsigned int end_idx=0);
       void moveAtoms_move(unsigned int start_idx=0, unsigned int end_idx=0);
+      void moveAtoms_stakeclaim_atomic(unsigned int start_idx, unsigned int end_idx);
+      void moveAtoms_move_atomic(unsigned int start_idx, unsigned int end_idx);
       void moveAtoms_poretransport(unsigned int start_idx=0, unsigned int end_idx=0);
       int currentIter;
 
+      // Per-thread phase timers, NULL unless profiling.
+      struct phaseTimes *phaseTimes;
+      int nPhaseThreads;
+      uint64_t phaseStart( void );
+      void phaseTick( int thread, int phase, uint64_t *t );
 
    protected:
       long maxatomsDefault;
 
-      int preIter();
-      void Iter();
-      void postIter();
+      virtual int preIter();
+      virtual void Iter();
+      virtual void postIter();
    private:
       void initWorld( struct options *o );
+      Arena *arena;           // world, worldNext, claimed and direction
       int WORLD_SZ_MASK;
       unsigned int WORLD_SZ;
       int off_n, off_s, off_e, off_w, off_ne, off_nw, off_se, off_sw;
-      int *dir2offset;
+      int dir2offset[ 8 ];    // off_n .. off_sw, in direction order
+      int nIons;              // ids run from 0 to nIons - 1
+      int trackedSz;
+      int *trackedSlot;       // by id: index into tracked, valid only if tracked
+      int trackedSlotSz;
+      int poreFluxRows;       // rows poreFlux has room for
+      TrajectoryWriter *trajectory;   // NULL unless --trajectory
+      FrameWriter *frames;            // NULL unless --frame-every
+      AnalysisPipeline *analysis;     // NULL unless --analysis
+      StateCache *cache;              // NULL unless --state-cache
+      Checkpointer *checkpoints;      // NULL unless --checkpoint
+      BlockedEngine *blocked;         // NULL unless --engine=blocked
+      SublatticeEngine *sublattice;   // NULL unless --engine=sublattice
       int getX( unsigned int position );
       int getY( unsigned int position );
       int isMembrane( unsigned int position );
@@ -120,9 +224,47 @@ class NernstSim
       int isPermeable( unsigned int porePos, unsigned int ionPos );
       void copyAtom( unsigned int from, unsigned int to, int dx, int dy );
       int shouldTransport( unsigned int from, unsigned int to );
+      int transportAccepted( int q, unsigned char r );
       void takeCensus( int iter );
+      void writeCensus( int iter, const int *counts, int charge );
+      long censusBytes(void);
+      void resumeCensus( long offset );
+      void stepBlocked(void);
       void finalizeAtoms(void);
+      void writePoreSummary(void);
+      void writeStats(void);
+      void reportPhaseTimes(void);
       void moveAtoms(unsigned int start_idx=0, unsigned int end_idx=0);
 };
 
+
+// Both are no-ops unless profiling, so the hot path pays one branch.
+inline uint64_t
+NernstSim::phaseStart( void )
+{
+   return phaseTimes ? nowNsec() : 0;
+}
+
+
+// One ion through the pore in row y; see poreFlux.
+inline void
+NernstSim::countCrossing( int y, int color, int dir )
+{
+   poreFlux[ 6 * y + 2 * ( color - ATOM_K ) + dir ]++;
+}
+
+
+// Charge the time since *t to the given phase and restart the clock.
+inline void
+NernstSim::phaseTick( int thread, int phase, uint64_t *t )
+{
+   if( phaseTimes )
+   {
+      uint64_t now = nowNsec();
+      phaseTimes[ thread ].nsec[ phase ] += now - *t;
+      phaseTimes[ thread ].calls[ phase ]++;
+      *t = now;
+   }
+}
+
 #endif /* SIM_H */
@@ -0,0 +1,521 @@
+/* statecache.cpp
+ *
+ * On-disk cache of equilibrated worlds.  See statecache.h.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#ifdef BLR_USEWIN
+#include <direct.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#include "statecache.h"
+#include "hash.h"
+#include "options.h"
+#include "sim.h"
+
+
+enum
+{
+   STATE_MAGIC   = 0x4e535443,   // "NSTC"
+   STATE_VERSION = 1
+};
+
+// An entry file is this header, then nIons pairs of 32-bit words: the
+// square, and the color plus id << 8.  Native byte order; the cache is
+// local to the machine.
+struct stateHeader
+{
+   uint32_t magic, version;
+   int32_t x, y, nIons, pad;
+   int64_t age;
+};
+
+
+static int
+charge( const struct atom *a )
+{
+   switch( a->color )
+   {
+      case ATOM_K:
+      case ATOM_Na:
+         return 1;
+      case ATOM_Cl:
+         return -1;
+      default:
+         return 0;
+   }
+}
+
+
+StateCache::StateCache( struct options *options )
+{
+   o = options;
+   dir = o->state_cache;
+   entries = NULL;
+   nEntries = szEntries = 0;
+   hits = misses = clock = 0;
+   loadedAge = 0;
+
+   // Fails harmlessly if it is already there; if it cannot be made, every
+   // lookup misses and every store says why.
+#ifdef BLR_USEWIN
+   _mkdir( dir );
+#else
+   mkdir( dir, 0777 );
+#endif
+}
+
+
+StateCache::~StateCache()
+{
+   free( entries );
+}
+
+
+// Everything that decides which ions a fresh world has.  o->max_atoms is
+// the number actually placed once initAtoms() has run.
+uint64_t
+StateCache::worldKey()
+{
+   int32_t k[ 12 ] = { STATE_VERSION, o->x, o->y, o->lK, o->lNa, o->lCl,
+                       o->rK, o->rNa, o->rCl, (int32_t)o->max_atoms,
+                       o->randseed, o->electrostatics };
+
+   return fnv( FNV_BASIS, k, sizeof( k ) );
+}
+
+
+void
+StateCache::path( const char *name, char *buf, int sz )
+{
+   snprintf( buf, sz, "%s/%s", dir, name );
+}
+
+
+void
+StateCache::readIndex()
+{
+   char file[ 1024 ], line[ 512 ];
+   struct entry e;
+   unsigned long long key;
+   FILE *fp;
+
+   nEntries = 0;
+   path( "index", file, sizeof( file ) );
+   if( ( fp = fopen( file, "r" ) ) == NULL )
+   {
+      return;
+   }
+   while( fgets( line, sizeof( line ), fp ) )
+   {
+      if( sscanf( line, "stats %ld %ld %ld", &hits, &misses, &clock ) == 3 )
+      {
+         continue;
+      }
+      if( sscanf( line, "%23s %llx %lf %lf %lf %d %ld %ld %ld", e.name, &key,
+                  &e.pK, &e.pNa, &e.pCl, &e.selectivity, &e.age, &e.bytes, &e.used ) != 9 ||
+          e.name[ 0 ] == '#' )
+      {
+         continue;
+      }
+      e.key = key;
+      if( nEntries == szEntries )
+      {
+         szEntries = szEntries ? 2 * szEntries : 16;
+         entries = (struct entry *)realloc( entries, szEntries * sizeof( struct entry ) );
+         assert( entries );
+      }
+      entries[ nEntries++ ] = e;
+   }
+   fclose( fp );
+}
+
+
+void
+StateCache::writeIndex()
+{
+   char file[ 1024 ], tmp[ 1024 ];
+   FILE *fp;
+   int i;
+
+   path( "index", file, sizeof( file ) );
+   path( "index.tmp", tmp, sizeof( tmp ) );
+   if( ( fp = fopen( tmp, "w" ) ) == NULL )
+   {
+      perror( tmp );
+      return;
+   }
+   fprintf( fp, "stats %ld %ld %ld\n", hits, misses, clock );
+   fprintf( fp, "# name key pK pNa pCl selectivity age bytes used\n" );
+   for( i = 0; i < nEntries; i++ )
+   {
+      fprintf( fp, "%s %016llx %.17g %.17g %.17g %d %ld %ld %ld\n", entries[ i ].name,
+               (unsigned long long)entries[ i ].key, entries[ i ].pK, entries[ i ].pNa,
+               entries[ i ].pCl, entries[ i ].selectivity, entries[ i ].age,
+               entries[ i ].bytes, entries[ i ].used );
+   }
+   fclose( fp );
+#ifdef BLR_USEWIN
+   remove( file );
+#endif
+   rename( tmp, file );
+}
+
+
+struct StateCache::entry *
+StateCache::find( const char *name )
+{
+   int i;
+
+   for( i = 0; i < nEntries; i++ )
+   {
+      if( !strcmp( entries[ i ].name, name ) )
+      {
+         return &entries[ i ];
+      }
+   }
+   return NULL;
+}
+
+
+// Replace s's ions with those of e.  Nothing changes unless the whole file
+// checks out.
+int
+StateCache::load( NernstSim *s, struct entry *e )
+{
+   char file[ 1024 ];
+   struct stateHeader h;
+   uint32_t *recs = NULL;
+   unsigned char *seen = NULL, *seenId = NULL;
+   int X = o->x, m = o->x / 2, n = (int)o->max_atoms, ok = 0, i, px, color, id;
+   int q[ 2 ] = { 0, 0 }, qFresh[ 2 ] = { 0, 0 };
+   unsigned int pos, sz = o->x * o->y;
+   FILE *fp;
+
+   path( e->name, file, sizeof( file ) );
+   if( ( fp = fopen( file, "rb" ) ) == NULL )
+   {
+      return 0;
+   }
+   if( fread( &h, sizeof( h ), 1, fp ) == 1 && h.magic == STATE_MAGIC &&
+       h.version == STATE_VERSION && h.x == o->x && h.y == o->y && h.nIons == n )
+   {
+      recs   = (uint32_t *)malloc( 2 * sizeof( uint32_t ) * n );
+      seen   = (unsigned char *)calloc( sz, 1 );
+      seenId = (unsigned char *)calloc( n, 1 );
+      assert( recs && seen && seenId );
+      ok = ( fread( recs, 2 * sizeof( uint32_t ), n, fp ) == (size_t)n );
+      for( i = 0; ok && i < n; i++ )
+      {
+         pos = recs[ 2 * i ];
+         color = recs[ 2 * i + 1 ] & 0x7f;
+         id = recs[ 2 * i + 1 ] >> 8;
+         px = pos % X;
+         ok = pos < sz && px != 0 && px != m && px != X - 1 && !seen[ pos ] &&
+              ( color == ATOM_K || color == ATOM_Na || color == ATOM_Cl ) &&
+              id < n && !seenId[ id ];
+         if( ok )
+         {
+            seen[ pos ] = seenId[ id ] = 1;
+         }
+      }
+   }
+   fclose( fp );
+   if( !ok )
+   {
+      fprintf( stderr, "state cache: %s is damaged or stale; dropping it.\n", file );
+      free( recs );
+      free( seen );
+      free( seenId );
+      return 0;
+   }
+
+   // The fresh world's net charge on each side, which LRcharge counts from.
+   for( pos = 0; pos < sz; pos++ )
+   {
+      px = pos % X;
+      if( px != 0 && px != m && px != X - 1 )
+      {
+         qFresh[ px > m ] += charge( &s->world[ pos ] );
+         s->world[ pos ].delta_x = 0;
+         s->world[ pos ].delta_y = 0;
+         s->world[ pos ].color   = SOLVENT;
+         s->world[ pos ].moved   = 0;
+         s->world[ pos ].tracked = 0;
+         s->world[ pos ].id      = 0;
+      }
+   }
+
+   s->initLHS_K = s->initRHS_K = 0;
+   s->initLHS_Na = s->initRHS_Na = 0;
+   s->initLHS_Cl = s->initRHS_Cl = 0;
+   for( i = 0; i < n; i++ )
+   {
+      pos = recs[ 2 * i ];
+      s->world[ pos ].color = recs[ 2 * i + 1 ] & 0x7f;
+      s->world[ pos ].id    = recs[ 2 * i + 1 ] >> 8;
+      q[ (int)( pos % X ) > m ] += charge( &s->world[ pos ] );
+      switch( s->world[ pos ].color )
+      {
+         case ATOM_K:
+            ( ( (int)( pos % X ) < m ) ? s->initLHS_K : s->initRHS_K )++;
+            break;
+         case ATOM_Na:
+            ( ( (int)( pos % X ) < m ) ? s->initLHS_Na : s->initRHS_Na )++;
+            break;
+         default:
+            ( ( (int)( pos % X ) < m ) ? s->initLHS_Cl : s->initRHS_Cl )++;
+            break;
+      }
+   }
+   s->LRcharge += ( q[ 0 ] - q[ 1 ] ) - ( qFresh[ 0 ] - qFresh[ 1 ] );
+
+   free( recs );
+   free( seen );
+   free( seenId );
+   return 1;
+}
+
+
+int
+StateCache::warmStart( NernstSim *s )
+{
+   char file[ 1024 ];
+   struct entry *e, *best;
+   uint64_t key = worldKey();
+   double d, bestD = 0;
+   int i;
+
+   loadedAge = 0;
+   readIndex();
+   for( ;; )
+   {
+      best = NULL;
+      for( i = 0; i < nEntries; i++ )
+      {
+         e = &entries[ i ];
+         if( e->key != key )
+         {
+            continue;
+         }
+         d = fabs( e->pK - o->pK ) + fabs( e->pNa - o->pNa ) + fabs( e->pCl - o->pCl ) +
+             ( e->selectivity != o->selectivity );
+         if( best == NULL || d < bestD || ( d == bestD && e->age > best->age ) )
+         {
+            best = e;
+            bestD = d;
+         }
+      }
+      if( best == NULL || load( s, best ) )
+      {
+         break;
+      }
+      path( best->name, file, sizeof( file ) );   // load() said why
+      remove( file );
+      *best = entries[ --nEntries ];
+   }
+
+   if( best == NULL )
+   {
+      misses++;
+      writeIndex();
+      if( o->verbose )
+      {
+         fprintf( stderr, "state cache: miss; starting from a fresh world\n" );
+      }
+      return 0;
+   }
+
+   hits++;
+   best->used = ++clock;
+   loadedAge = best->age;
+   if( o->verbose )
+   {
+      fprintf( stderr, "state cache: hit; starting from %s, %ld iterations in, "
+               "pK %g pNa %g pCl %g selectivity %d\n",
+               best->name, best->age, best->pK, best->pNa, best->pCl, best->selectivity );
+   }
+   writeIndex();
+   return 1;
+}
+
+
+void
+StateCache::store( NernstSim *s, int iters )
+{
+   char name[ 24 ], file[ 1024 ], tmp[ 1030 ];
+   struct stateHeader h;
+   struct entry *e;
+   uint64_t key = worldKey(), id;
+   uint32_t rec[ 2 ];
+   int n = 0;
+   unsigned int pos, sz = o->x * o->y;
+   long age = loadedAge + iters;
+   FILE *fp;
+
+   if( iters <= 0 )
+   {
+      return;
+   }
+
+   id = fnv( key, &o->pK, sizeof( o->pK ) );
+   id = fnv( id, &o->pNa, sizeof( o->pNa ) );
+   id = fnv( id, &o->pCl, sizeof( o->pCl ) );
+   id = fnv( id, &o->selectivity, sizeof( o->selectivity ) );
+   snprintf( name, sizeof( name ), "%016llx", (unsigned long long)id );
+
+   // Another job may have been here since warmStart().
+   readIndex();
+   e = find( name );
+   if( e && e->age >= age )
+   {
+      return;      // already has a longer run of the same thing
+   }
+
+   path( name, file, sizeof( file ) );
+   snprintf( tmp, sizeof( tmp ), "%s.tmp", file );
+   if( ( fp = fopen( tmp, "wb" ) ) == NULL )
+   {
+      perror( tmp );
+      return;
+   }
+   memset( &h, 0, sizeof( h ) );
+   h.magic   = STATE_MAGIC;
+   h.version = STATE_VERSION;
+   h.x       = o->x;
+   h.y       = o->y;
+   h.nIons   = (int32_t)o->max_atoms;
+   h.age     = age;
+   fwrite( &h, sizeof( h ), 1, fp );
+   for( pos = 0; pos < sz; pos++ )
+   {
+      if( charge( &s->world[ pos ] ) != 0 )
+      {
+         rec[ 0 ] = pos;
+         rec[ 1 ] = s->world[ pos ].color | ( s->world[ pos ].id << 8 );
+         fwrite( rec, sizeof( rec ), 1, fp );
+         n++;
+      }
+   }
+   assert( n == o->max_atoms );
+   if( ferror( fp ) | fclose( fp ) )
+   {
+      perror( tmp );
+      remove( tmp );
+      return;
+   }
+#ifdef BLR_USEWIN
+   remove( file );
+#endif
+   rename( tmp, file );
+
+   if( e == NULL )
+   {
+      if( nEntries == szEntries )
+      {
+         szEntries = szEntries ? 2 * szEntries : 16;
+         entries = (struct entry *)realloc( entries, szEntries * sizeof( struct entry ) );
+         assert( entries );
+      }
+      e = &entries[ nEntries++ ];
+      strcpy( e->name, name );
+   }
+   e->key         = key;
+   e->pK          = o->pK;
+   e->pNa         = o->pNa;
+   e->pCl         = o->pCl;
+   e->selectivity = o->selectivity;
+   e->age         = age;
+   e->bytes       = sizeof( h ) + (long)n * sizeof( rec );
+   e->used        = ++clock;
+
+   evict( e );
+   writeIndex();
+   if( o->verbose )
+   {
+      fprintf( stderr, "state cache: stored %s, %ld iterations in\n", name, age );
+   }
+}
+
+
+// Least recently used first, until the entries fit in --state-cache-size.
+// Never evicts `keep`.
+void
+StateCache::evict( struct entry *keep )
+{
+   char file[ 1024 ], name[ 24 ];
+   long total = 0, limit = (long)o->state_cache_mb * 1024 * 1024;
+   int i, lru;
+
+   strcpy( name, keep->name );
+   for( i = 0; i < nEntries; i++ )
+   {
+      total += entries[ i ].bytes;
+   }
+   while( total > limit )
+   {
+      lru = -1;
+      for( i = 0; i < nEntries; i++ )
+      {
+         if( strcmp( entries[ i ].name, name ) &&
+             ( lru < 0 || entries[ i ].used < entries[ lru ].used ) )
+         {
+            lru = i;
+         }
+      }
+      if( lru < 0 )
+      {
+         break;
+      }
+      if( o->verbose )
+      {
+         fprintf( stderr, "state cache: evicting %s\n", entries[ lru ].name );
+      }
+      path( entries[ lru ].name, file, sizeof( file ) );
+      remove( file );
+      total -= entries[ lru ].bytes;
+      entries[ lru ] = entries[ --nEntries ];
+   }
+}
+
+
+void
+StateCache::report()
+{
+   long total = 0;
+   int i;
+
+   for( i = 0; i < nEntries; i++ )
+   {
+      total += entries[ i ].bytes;
+   }
+   fprintf( stderr, "state cache: %ld hits, %ld misses, %d entries, %ld kB of %d MB in %s\n",
+            hits, misses, nEntries, ( total + 1023 ) / 1024, o->state_cache_mb, dir );
+}
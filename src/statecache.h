@@ -0,0 +1,93 @@
+/* statecache.h
+ *
+ * On-disk cache of equilibrated worlds (--state-cache).
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATECACHE_H
+#define STATECACHE_H
+
+#include <stdint.h>
+
+class NernstSim;
+
+// A directory of worlds left behind by earlier runs, so that a run which
+// differs from an earlier one only in its permeabilities, selectivity or
+// length can start where that one finished instead of from scratch.
+//
+// Entries are grouped by a key made of everything that fixes which ions
+// there are: world size, concentrations, the number of ions placed, the
+// seed and whether electrostatics is on.  Only an entry with the same key
+// is compatible; of those, warmStart() takes the nearest in permeability
+// and selectivity, preferring the longest run on ties.  Only the ions are
+// restored; the membrane and its pores are the new run's own.
+//
+// The index file in the directory lists the entries, when each was last
+// used, and hit and miss totals.  store() evicts the least recently used
+// entries once the directory holds more than --state-cache-size
+// megabytes.  Entries are written to a temporary file and renamed, so a
+// reader never sees half of one; jobs sharing a directory at the same time
+// may lose each other's index updates, which costs only cache hits.
+class StateCache
+{
+   public:
+      StateCache( struct options *o );
+      ~StateCache();
+
+      // After initAtoms(): replace the ions with the nearest cached ones.
+      // Returns 1 on a hit.
+      int warmStart( NernstSim *s );
+
+      // At the end of a run of iters iterations: save the world.
+      void store( NernstSim *s, int iters );
+
+      // One line of totals on stderr.
+      void report();
+
+   private:
+      struct entry
+      {
+         char name[ 24 ];      // file in the directory
+         uint64_t key;
+         double pK, pNa, pCl;
+         int selectivity;
+         long age;             // iterations since a fresh world
+         long bytes;
+         long used;            // clock when last stored or loaded
+      };
+
+      struct options *o;
+      char *dir;
+      struct entry *entries;
+      int nEntries, szEntries;
+      long hits, misses, clock;   // kept in the index across runs
+      long loadedAge;             // age of the world warmStart() loaded, or 0
+
+      uint64_t worldKey();
+      void path( const char *name, char *buf, int sz );
+      void readIndex();
+      void writeIndex();
+      struct entry *find( const char *name );
+      int load( NernstSim *s, struct entry *e );
+      void evict( struct entry *keep );
+};
+
+#endif /* STATECACHE_H */
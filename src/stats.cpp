@@ -0,0 +1,156 @@
+/* stats.cpp
+ *
+ * Running error estimates for a time series.  See stats.h.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <math.h>
+
+#include "stats.h"
+
+
+BatchMeans::BatchMeans()
+{
+   clear();
+}
+
+
+void
+BatchMeans::clear()
+{
+   nBatches = 0;
+   size = 1;
+   partial = 0;
+   inPartial = 0;
+   n = 0;
+   m = m2 = 0;
+}
+
+
+void
+BatchMeans::add( double x )
+{
+   double d = x - m;
+   int i;
+
+   n++;
+   m += d / n;
+   m2 += d * ( x - m );
+
+   partial += x;
+   if( ++inPartial < size )
+   {
+      return;
+   }
+   sums[ nBatches++ ] = partial;
+   partial = 0;
+   inPartial = 0;
+   if( nBatches == MAX_BATCHES )
+   {
+      for( i = 0; i < MAX_BATCHES / 2; i++ )
+      {
+         sums[ i ] = sums[ 2 * i ] + sums[ 2 * i + 1 ];
+      }
+      nBatches = MAX_BATCHES / 2;
+      size *= 2;
+   }
+}
+
+
+long
+BatchMeans::count()
+{
+   return n;
+}
+
+
+double
+BatchMeans::mean()
+{
+   return m;
+}
+
+
+int
+BatchMeans::batches()
+{
+   return nBatches;
+}
+
+
+long
+BatchMeans::batchSize()
+{
+   return size;
+}
+
+
+// Sample variance of the complete batches' means.
+double
+BatchMeans::batchVariance()
+{
+   double bm = 0, v = 0, d;
+   int i;
+
+   for( i = 0; i < nBatches; i++ )
+   {
+      bm += sums[ i ] / size;
+   }
+   bm /= nBatches;
+   for( i = 0; i < nBatches; i++ )
+   {
+      d = sums[ i ] / size - bm;
+      v += d * d;
+   }
+   return v / ( nBatches - 1 );
+}
+
+
+double
+BatchMeans::stdErr()
+{
+   if( nBatches < 2 )
+   {
+      return 0;
+   }
+   return sqrt( size * batchVariance() / n );
+}
+
+
+double
+BatchMeans::tau()
+{
+   double var = ( n > 1 ) ? m2 / ( n - 1 ) : 0;
+
+   if( nBatches < 2 || var <= 0 )
+   {
+      return 0.5;
+   }
+   return size * batchVariance() / ( 2 * var );
+}
+
+
+int
+BatchMeans::settled()
+{
+   return nBatches >= 2 && size >= 10 * tau();
+}
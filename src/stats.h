@@ -0,0 +1,76 @@
+/* stats.h
+ *
+ * Running error estimates for a time series (the membrane potential).
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+// The mean of a correlated series, with its standard error and integrated
+// autocorrelation time, by the method of batch means.  Consecutive samples
+// are summed into batches; once there are MAX_BATCHES of them, neighbours
+// are merged and the batch size doubles, so memory stays fixed however long
+// the run while there are always between MAX_BATCHES / 2 and MAX_BATCHES
+// batches to estimate from.
+//
+// Once batches are much longer than the correlation time their means are
+// nearly independent, and with b samples per batch
+//
+//    Var( mean )  ~  b Var( batch mean ) / n
+//    tau_int      ~  b Var( batch mean ) / ( 2 Var( sample ) )
+//
+// in the convention Var( mean ) = 2 tau_int Var( sample ) / n, so that
+// uncorrelated samples have tau_int = 1/2.  Batches shorter than about ten
+// tau_int make both estimates too small; settled() says whether they are
+// long enough.
+class BatchMeans
+{
+   public:
+      BatchMeans();
+
+      void clear();
+      void add( double x );
+
+      long count();          // samples so far
+      double mean();
+      double stdErr();       // of mean(); 0 until there are two batches
+      double tau();          // integrated autocorrelation time, in samples
+      int batches();         // complete batches
+      long batchSize();
+      int settled();         // batches are at least ten tau_int long
+
+   private:
+      enum { MAX_BATCHES = 64 };
+
+      double sums[ MAX_BATCHES ];   // of each complete batch
+      int nBatches;
+      long size;                    // samples per batch
+      double partial;               // the batch being filled
+      long inPartial;
+
+      long n;                       // every sample, by Welford's method
+      double m, m2;
+
+      double batchVariance();
+};
+
+#endif /* STATS_H */
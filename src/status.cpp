@@ -28,6 +28,7 @@
 #include "status.h"
 #include "gui.h"
 #include "options.h"
+#include "timeseries.h"
 #include "safecalls.h"
 using namespace SafeCalls;
 
@@ -120,12 +121,12 @@ NernstStatusBar::setVoltsLbl( int currentIter, int avg )
       double avgVolt = 0;
       for( i = currentIter - 128; i < currentIter; i++ )
       {
-         avgVolt += y_volts[ i ];
+         avgVolt += voltsSeries.at( i );
       }
       avgVolt /= 128.0;
       voltsLbl->setText( QString::number( avgVolt, 'g', 4 ) + " mV" );
    } else {
-      voltsLbl->setText( QString::number( y_volts[ currentIter ], 'g', 4 ) + " mV" );
+      voltsLbl->setText( QString::number( voltsSeries.at( currentIter ), 'g', 4 ) + " mV" );
    }
 }
 
@@ -0,0 +1,125 @@
+/* sublattice.cpp
+ *
+ * Sublattice stepping engine.  See sublattice.h.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <assert.h>
+#include <SFMT.h>
+
+#include "sublattice.h"
+#include "options.h"
+#include "sim.h"
+
+
+// Same order as NernstSim::moveAtoms_move().
+static const int dir2dx[] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+static const int dir2dy[] = { -1, 1, 0, 0, -1, -1, 1, 1 };
+
+
+SublatticeEngine::SublatticeEngine( NernstSim *sim )
+{
+   int i;
+
+   s = sim;
+   o = sim->o;
+   assert( o->y % PERIOD_Y == 0 );
+
+   // The moved bits start out clear, so the first sweep has parity 1.
+   sweep = 0;
+   r = (uint32_t)o->randseed * 2654435761u + 1;
+   for( i = 0; i < NUM_CLASSES; i++ )
+   {
+      order[ i ] = i;
+   }
+}
+
+
+void
+SublatticeEngine::step()
+{
+   uint64_t t = s->phaseStart();
+   unsigned int parity;
+   int i, j, tmp;
+
+   // One random byte per square, as moveAtoms_prep(), though nothing
+   // needs clearing.
+   fill_array64( (uint64_t *)( s->direction ), s->direction_sz64 / 8 );
+   s->phaseTick( 0, PHASE_PREP, &t );
+
+   parity = ++sweep & 1;
+   for( i = NUM_CLASSES - 1; i > 0; i-- )
+   {
+      r ^= r << 13;  r ^= r >> 17;  r ^= r << 5;   // xorshift32
+      j = r % ( i + 1 );
+      tmp = order[ i ];
+      order[ i ] = order[ j ];
+      order[ j ] = tmp;
+   }
+   for( i = 0; i < NUM_CLASSES; i++ )
+   {
+      moveClass( order[ i ] % PERIOD_X, order[ i ] / PERIOD_X, parity );
+   }
+   s->phaseTick( 0, PHASE_MOVE, &t );
+
+   s->moveAtoms_poretransport();
+   s->phaseTick( 0, PHASE_TRANSPORT, &t );
+}
+
+
+// Every ion on squares x % PERIOD_X == cx, y % PERIOD_Y == cy that has not
+// yet tried this sweep moves, if its target is solvent.  The moves are
+// independent of each other, so the order of the loops does not matter.
+// Plain scalar code; see sublattice.h.
+void
+SublatticeEngine::moveClass( int cx, int cy, unsigned int parity )
+{
+   struct atom *world = s->world, *a;
+   const unsigned char *dir;
+   int X = o->x, ymask = o->y - 1;
+   int x, y, d, ty;
+   unsigned int from, to;
+
+   for( y = cy; y < o->y; y += PERIOD_Y )
+   {
+      dir = s->direction + y * X;
+      for( x = cx; x < X; x += PERIOD_X )
+      {
+         from = y * X + x;
+         a = &world[ from ];
+         if( ( a->color != ATOM_K && a->color != ATOM_Na && a->color != ATOM_Cl ) ||
+             a->moved == parity )
+         {
+            continue;
+         }
+         a->moved = parity;
+
+         d  = dir[ x ] & DIR_MASK;
+         ty = ( y + dir2dy[ d ] ) & ymask;
+         to = ty * X + x + dir2dx[ d ];
+         if( world[ to ].color == SOLVENT )
+         {
+            s->copyAtom( from, to, dir2dx[ d ], dir2dy[ d ] );
+         }
+      }
+   }
+}
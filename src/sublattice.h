@@ -0,0 +1,80 @@
+/* sublattice.h
+ *
+ * Sublattice stepping engine (--engine=sublattice).
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUBLATTICE_H
+#define SUBLATTICE_H
+
+#include <stdint.h>
+
+class NernstSim;
+
+// Moves ions without a claim pass.  The lattice is colored with
+// PERIOD_X * PERIOD_Y interleaved sublattices; two squares of the same
+// color are at least PERIOD_X apart in x or PERIOD_Y apart in y, so no
+// two ions of one color can reach the same square, and no ion can reach
+// a square another ion of its color is leaving.  Each color's moves are
+// therefore independent: an ion simply moves if its target is solvent.
+//
+// PERIOD_Y is 4 rather than 3 so that it divides the (power of 2) height
+// of the torus; x needs no such care, as the walls stop it wrapping.
+//
+// The colors are visited in a fresh random order each iteration, and an
+// ion that moves into a color still to come is not moved again.  Ions
+// therefore still try one move per iteration, but their moves no longer
+// fail just because a neighbor wanted the same square, so the dynamics
+// (not the equilibrium) differ from the claim engine's.  --validate
+// checks the equilibrium potentials agree.
+//
+// The update is scalar, on one thread.  The moves of a color could be
+// applied in any order, but the squares of one color are 12-byte atoms
+// PERIOD_X apart, so gathering them into vectors would cost more than
+// the moves; nothing here is SIMD.
+class SublatticeEngine
+{
+   friend class Checkpointer;
+
+   public:
+      SublatticeEngine( NernstSim *sim );
+
+      // One iteration: moves, then pore transport.
+      void step();
+
+   private:
+      enum
+      {
+         PERIOD_X    = 3,
+         PERIOD_Y    = 4,
+         NUM_CLASSES = PERIOD_X * PERIOD_Y
+      };
+
+      NernstSim *s;
+      struct options *o;
+      unsigned int sweep;        // parity is kept in struct atom's moved bit
+      uint32_t r;                // xorshift32 state for the color order
+      int order[ NUM_CLASSES ];
+
+      void moveClass( int cx, int cy, unsigned int parity );
+};
+
+#endif /* SUBLATTICE_H */
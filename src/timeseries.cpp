@@ -0,0 +1,246 @@
+/* timeseries.cpp
+ *
+ * Growable time series with min/max decimation for plotting.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "timeseries.h"
+
+
+TimeSeries::TimeSeries()
+{
+   memset( &samples, 0, sizeof( samples ) );
+   memset( mins, 0, sizeof( mins ) );
+   memset( maxs, 0, sizeof( maxs ) );
+   outX = outY = NULL;
+   outSz = 0;
+   firstX = 0;
+   n = 0;
+   nLevels = 1;
+}
+
+
+TimeSeries::~TimeSeries()
+{
+   clear();
+   free( outX );
+   free( outY );
+}
+
+
+void
+TimeSeries::release( struct chunkedArray *a )
+{
+   for( long i = 0; i < a->nChunks; i++ )
+   {
+      free( a->chunks[ i ] );
+   }
+   free( a->chunks );
+   a->chunks = NULL;
+   a->nChunks = 0;
+}
+
+
+void
+TimeSeries::clear( double x )
+{
+   release( &samples );
+   for( int l = 1; l < nLevels; l++ )
+   {
+      release( &mins[ l ] );
+      release( &maxs[ l ] );
+   }
+   firstX = x;
+   n = 0;
+   nLevels = 1;
+}
+
+
+double
+TimeSeries::get( struct chunkedArray *a, long i )
+{
+   return a->chunks[ i >> CHUNK_SHIFT ][ i & ( CHUNK_SZ - 1 ) ];
+}
+
+
+void
+TimeSeries::set( struct chunkedArray *a, long i, double v )
+{
+   long c = i >> CHUNK_SHIFT;
+
+   if( c >= a->nChunks )
+   {
+      a->chunks = (double **)realloc( a->chunks, ( c + 1 ) * sizeof( double * ) );
+      assert( a->chunks );
+      while( a->nChunks <= c )
+      {
+         a->chunks[ a->nChunks ] = (double *)malloc( CHUNK_SZ * sizeof( double ) );
+         assert( a->chunks[ a->nChunks ] );
+         a->nChunks++;
+      }
+   }
+   a->chunks[ c ][ i & ( CHUNK_SZ - 1 ) ] = v;
+}
+
+
+double
+TimeSeries::levelMin( int level, long block )
+{
+   return level ? get( &mins[ level ], block ) : get( &samples, block );
+}
+
+
+double
+TimeSeries::levelMax( int level, long block )
+{
+   return level ? get( &maxs[ level ], block ) : get( &samples, block );
+}
+
+
+void
+TimeSeries::append( double y )
+{
+   long i = n;
+
+   set( &samples, i, y );
+   n++;
+
+   // Sample i completes the level-l block ending at it whenever the low
+   // l bits of i are all ones.
+   for( int l = 1; l < MAX_LEVELS && ( ( i + 1 ) & ( ( 1L << l ) - 1 ) ) == 0; l++ )
+   {
+      long b = ( ( i + 1 ) >> l ) - 1;
+      double lo0 = levelMin( l - 1, 2 * b ), lo1 = levelMin( l - 1, 2 * b + 1 );
+      double hi0 = levelMax( l - 1, 2 * b ), hi1 = levelMax( l - 1, 2 * b + 1 );
+
+      set( &mins[ l ], b, lo0 < lo1 ? lo0 : lo1 );
+      set( &maxs[ l ], b, hi0 > hi1 ? hi0 : hi1 );
+      if( l >= nLevels )
+      {
+         nLevels = l + 1;
+      }
+   }
+}
+
+
+long
+TimeSeries::size()
+{
+   return n;
+}
+
+
+double
+TimeSeries::at( long i )
+{
+   if( i < 0 || i >= n )
+   {
+      return 0;
+   }
+   return get( &samples, i );
+}
+
+
+int
+TimeSeries::decimate( int maxPoints, const double **x, const double **y )
+{
+   int level = 0, count = 0;
+   long blocks, b;
+
+   if( maxPoints < 2 )
+   {
+      maxPoints = 2;
+   }
+   if( maxPoints > outSz )
+   {
+      outSz = maxPoints;
+      outX = (double *)realloc( outX, outSz * sizeof( double ) );
+      outY = (double *)realloc( outY, outSz * sizeof( double ) );
+      assert( outX && outY );
+   }
+
+   if( n <= maxPoints )
+   {
+      for( b = 0; b < n; b++ )
+      {
+         outX[ b ] = firstX + b;
+         outY[ b ] = get( &samples, b );
+      }
+      *x = outX;
+      *y = outY;
+      return (int)n;
+   }
+
+   // Coarsest detail that still fits: two points per block.
+   do
+   {
+      level++;
+      blocks = ( n + ( 1L << level ) - 1 ) >> level;
+   } while( 2 * blocks > maxPoints );
+
+   for( b = 0; b < blocks; b++ )
+   {
+      long start = b << level;
+      long len = ( 1L << level );
+      double lo, hi;
+
+      if( start + len <= n )
+      {
+         lo = levelMin( level, b );
+         hi = levelMax( level, b );
+      } else {
+         // The last block is still filling; combine the finer blocks
+         // that are complete, then the loose samples.
+         long i = start;
+         int l;
+
+         len = n - start;
+         lo = hi = get( &samples, i );
+         for( l = level - 1; l >= 0; l-- )
+         {
+            while( i + ( 1L << l ) <= n )
+            {
+               double blo = levelMin( l, i >> l ), bhi = levelMax( l, i >> l );
+               lo = blo < lo ? blo : lo;
+               hi = bhi > hi ? bhi : hi;
+               i += 1L << l;
+            }
+         }
+      }
+
+      outX[ count ] = firstX + start;
+      outY[ count ] = lo;
+      count++;
+      outX[ count ] = firstX + start + len - 1;
+      outY[ count ] = hi;
+      count++;
+   }
+
+   *x = outX;
+   *y = outY;
+   return count;
+}
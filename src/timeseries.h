@@ -0,0 +1,82 @@
+/* timeseries.h
+ *
+ * Growable time series with min/max decimation for plotting.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+// Samples y[ 0 .. size-1 ] taken at x = firstX, firstX+1, ...  Storage
+// grows in fixed-size chunks, so appending never copies old samples.
+//
+// Alongside the samples, level L of a pyramid holds the minimum and
+// maximum of each aligned block of 2^L samples, built as samples arrive.
+// decimate() uses it to reduce any length of history to a bounded number
+// of points (two per block, the block's minimum and maximum) in time
+// proportional to the number of points, not the number of samples.
+class TimeSeries
+{
+   public:
+      TimeSeries();
+      ~TimeSeries();
+
+      void clear( double firstX = 0 );
+      void append( double y );
+      long size();
+      double at( long i );    // 0 if i is out of range
+
+      // Points to draw in at most maxPoints (at least 2); returns how many.
+      // *x and *y belong to the series and are valid until the next call.
+      int decimate( int maxPoints, const double **x, const double **y );
+
+   private:
+      enum
+      {
+         CHUNK_SHIFT = 12,
+         CHUNK_SZ    = 1 << CHUNK_SHIFT,
+         MAX_LEVELS  = 48
+      };
+
+      struct chunkedArray
+      {
+         double **chunks;
+         long nChunks;
+      };
+
+      double firstX;
+      long n;
+      int nLevels;
+      struct chunkedArray samples;
+      struct chunkedArray mins[ MAX_LEVELS ];   // level 0 is unused; samples
+      struct chunkedArray maxs[ MAX_LEVELS ];   // stand in for it
+
+      double *outX, *outY;
+      int outSz;
+
+      static double get( struct chunkedArray *a, long i );
+      static void set( struct chunkedArray *a, long i, double v );
+      static void release( struct chunkedArray *a );
+      double levelMin( int level, long block );
+      double levelMax( int level, long block );
+};
+
+#endif /* TIMESERIES_H */
@@ -0,0 +1,72 @@
+/* timing.h
+ *
+ * High resolution monotonic clock for profiling and benchmarking.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+
+#ifdef BLR_USEWIN
+#include <windows.h>
+#else
+#ifdef BLR_USEMAC
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+#endif
+
+
+// Nanoseconds since some arbitrary, fixed point in the past.  Only the
+// difference between two calls is meaningful.
+static inline uint64_t
+nowNsec( void )
+{
+#ifdef BLR_USEWIN
+   static LARGE_INTEGER freq;
+   LARGE_INTEGER now;
+   if( freq.QuadPart == 0 )
+   {
+      QueryPerformanceFrequency( &freq );
+   }
+   QueryPerformanceCounter( &now );
+   return (uint64_t)( (double)now.QuadPart * 1.0e9 / (double)freq.QuadPart );
+#else
+#ifdef BLR_USEMAC
+   static mach_timebase_info_data_t tb;
+   if( tb.denom == 0 )
+   {
+      mach_timebase_info( &tb );
+   }
+   return mach_absolute_time() * tb.numer / tb.denom;
+#else
+   struct timespec ts;
+   clock_gettime( CLOCK_MONOTONIC, &ts );
+   return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+#endif
+}
+
+#endif /* TIMING_H */
@@ -0,0 +1,253 @@
+/* trajectory.cpp
+ *
+ * Compact recording of the paths of tracked ions.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "trajectory.h"
+#include "options.h"
+#include "sim.h"
+
+
+TrajectoryWriter::TrajectoryWriter()
+{
+   fp = NULL;
+   buf = NULL;
+   len = 0;
+   lastDx = lastDy = NULL;
+   lastSz = 0;
+   nIons = 0;
+   lastGen = -1;
+}
+
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+   close();
+   free( buf );
+   free( lastDx );
+   free( lastDy );
+}
+
+
+int
+TrajectoryWriter::open( const char *path, int x, int y )
+{
+   close();
+
+   fp = fopen( path, "wb" );
+   if( !fp )
+   {
+      perror( path );
+      return 0;
+   }
+
+   if( buf == NULL )
+   {
+      buf = (unsigned char *)malloc( BUF_SZ );
+      assert( buf );
+   }
+   len = 0;
+   nIons = 0;
+   lastGen = -1;
+
+   put8( 'N' ); put8( 'T' ); put8( 'R' ); put8( 'J' );
+   put32( 1 );
+   put32( x );
+   put32( y );
+   return 1;
+}
+
+
+void
+TrajectoryWriter::close()
+{
+   if( fp )
+   {
+      flush();
+      fclose( fp );
+      fp = NULL;
+   }
+}
+
+
+void
+TrajectoryWriter::flush()
+{
+   if( len )
+   {
+      fwrite( buf, 1, len, fp );
+      len = 0;
+   }
+}
+
+
+// Make room for n more bytes.  Records larger than the buffer are written
+// a piece at a time by the put*() calls that follow.
+void
+TrajectoryWriter::reserve( int n )
+{
+   if( len + n > BUF_SZ )
+   {
+      flush();
+   }
+}
+
+
+void
+TrajectoryWriter::put8( uint8_t v )
+{
+   reserve( 1 );
+   buf[ len++ ] = v;
+}
+
+
+void
+TrajectoryWriter::put16( uint16_t v )
+{
+   reserve( 2 );
+   memcpy( buf + len, &v, 2 );
+   len += 2;
+}
+
+
+void
+TrajectoryWriter::put32( uint32_t v )
+{
+   reserve( 4 );
+   memcpy( buf + len, &v, 4 );
+   len += 4;
+}
+
+
+void
+TrajectoryWriter::keyframe( NernstSim *s, int iter )
+{
+   int i;
+
+   if( s->nTracked > lastSz )
+   {
+      lastSz = s->nTracked;
+      lastDx = (int *)realloc( lastDx, sizeof( int ) * lastSz );
+      lastDy = (int *)realloc( lastDy, sizeof( int ) * lastSz );
+      assert( lastDx && lastDy );
+   }
+
+   nIons = s->nTracked;
+   lastGen = s->trackedGen;
+
+   put8( 'K' );
+   put32( iter );
+   put32( nIons );
+   for( i = 0; i < nIons; i++ )
+   {
+      unsigned int pos = s->tracked[ i ].position;
+      struct atom *a = &s->world[ pos ];
+
+      put32( s->tracked[ i ].id );
+      put16( pos % s->o->x );
+      put16( pos / s->o->x );
+      put8( a->color );
+      lastDx[ i ] = a->delta_x;
+      lastDy[ i ] = a->delta_y;
+   }
+}
+
+
+// Called once the world is in its state for iteration iter.
+void
+TrajectoryWriter::record( NernstSim *s, int iter )
+{
+   int i, code, nEscapes = 0;
+   uint8_t packed = 0;
+
+   if( !fp )
+   {
+      return;
+   }
+
+   if( s->trackedGen != lastGen )
+   {
+      keyframe( s, iter );
+      return;
+   }
+
+   if( nIons == 0 )
+   {
+      return;
+   }
+
+   put8( 'S' );
+   put32( iter );
+   for( i = 0; i < nIons; i++ )
+   {
+      struct atom *a = &s->world[ s->tracked[ i ].position ];
+      int dx = a->delta_x - lastDx[ i ];
+      int dy = a->delta_y - lastDy[ i ];
+
+      if( dx >= -2 && dx <= 2 && dy >= -1 && dy <= 1 )
+      {
+         code = ( dx + 2 ) * 3 + ( dy + 1 );
+      } else {
+         code = ESCAPE;
+         nEscapes++;
+      }
+
+      if( i & 1 )
+      {
+         put8( packed | ( code << 4 ) );
+      } else {
+         packed = code;
+      }
+   }
+   if( nIons & 1 )
+   {
+      put8( packed );
+   }
+
+   // Moves too big for a code: an ion that stepped up to the membrane and
+   // went through a pore in the same iteration.
+   for( i = 0; i < nIons && nEscapes; i++ )
+   {
+      struct atom *a = &s->world[ s->tracked[ i ].position ];
+      int dx = a->delta_x - lastDx[ i ];
+      int dy = a->delta_y - lastDy[ i ];
+
+      if( !( dx >= -2 && dx <= 2 && dy >= -1 && dy <= 1 ) )
+      {
+         put8( (uint8_t)(int8_t)dx );
+         put8( (uint8_t)(int8_t)dy );
+         nEscapes--;
+      }
+   }
+
+   for( i = 0; i < nIons; i++ )
+   {
+      struct atom *a = &s->world[ s->tracked[ i ].position ];
+      lastDx[ i ] = a->delta_x;
+      lastDy[ i ] = a->delta_y;
+   }
+}
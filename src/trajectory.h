@@ -0,0 +1,86 @@
+/* trajectory.h
+ *
+ * Compact recording of the paths of tracked ions.
+ *
+ * Copyright (c) 2008, Jeffrey Gill, Barry Rountree, Kendrick Shaw, 
+ *    Catherine Kehl, Jocelyn Eckert, and Dr. Hillel J. Chiel
+ *
+ * This file is part of Nernst Potential Simulator.
+ * 
+ * Nernst Potential Simulator is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ * 
+ * Nernst Potential Simulator is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Nernst Potential Simulator.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+class NernstSim;
+
+// Writes the tracked ions' positions after every iteration, in time
+// proportional to the number of tracked ions.  Records are built in a
+// memory buffer that is written out whenever it fills.
+//
+// The file, in host byte order:
+//
+//    header    "NTRJ", uint32 version (1), uint32 x, uint32 y
+//    keyframe  'K', uint32 iter, uint32 n,
+//              n x { uint32 id, uint16 x, uint16 y, uint8 color }
+//    step      'S', uint32 iter, (n+1)/2 bytes of 4-bit codes, low
+//              nibble first, then an int8 dx, dy pair for each code 15
+//
+// A keyframe is written whenever the set of tracked ions changes, and
+// gives their lattice positions in registry order.  Each step gives every
+// ion's move since the previous record, in the same order, as code
+// ( dx + 2 ) * 3 + ( dy + 1 ) when |dx| <= 2 and |dy| <= 1.  Moves are
+// not wrapped, so summing them follows an ion around the torus and
+// through the pores.  Steps are omitted while nothing is tracked.
+class TrajectoryWriter
+{
+   public:
+      TrajectoryWriter();
+      ~TrajectoryWriter();
+
+      int open( const char *path, int x, int y );   // 0 on failure
+      void record( NernstSim *s, int iter );
+      void close();
+
+   private:
+      enum
+      {
+         BUF_SZ = 1 << 20,
+         ESCAPE = 15
+      };
+
+      FILE *fp;
+      unsigned char *buf;
+      int len;
+
+      // Where each tracked ion's displacement stood at the last record.
+      int *lastDx, *lastDy;
+      int lastSz;
+      int nIons;          // ions in the last keyframe
+      int lastGen;        // NernstSim::trackedGen at the last keyframe
+
+      void flush();
+      void reserve( int n );
+      void put8( uint8_t v );
+      void put16( uint16_t v );
+      void put32( uint32_t v );
+      void keyframe( NernstSim *s, int iter );
+};
+
+#endif /* TRAJECTORY_H */
@@ -23,15 +23,42 @@
  */
 
 
+
 #include <QApplication>
-#include <QTimer>
 #include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
 #include <unistd.h>
 
 #include "xsim.h"
+#include "main.h"
 #include "options.h"
+#include "timing.h"
 #include "util.h"
+#include "safecalls.h"
+using namespace SafeCalls;
+
+
+//===========================================================================
+// SimThread
+//===========================================================================
 
+void
+SimThread::run()
+{
+   sim->runLoop();
+}
+
+
+//===========================================================================
+// XNernstSim
+//
+// The simulation runs on its own thread (and, with --threads, on the
+// worker pool as well).  Everything the GUI sees goes through a snapshot
+// published at the refresh rate; everything the GUI asks for is either
+// done while the thread is stopped or queued until the next iteration.
+//===========================================================================
 
 XNernstSim::XNernstSim( struct options *options, QWidget *parent )
    : QWidget( parent ), NernstSim( options )
@@ -40,6 +67,36 @@ XNernstSim::XNernstSim( struct options *options, QWidget *parent )
    paused      = 0;
    resetting   = 0;
    quitting    = 0;
+   lastFrame   = 0;
+
+   memset( snap, 0, sizeof( snap ) );
+   snap[ 0 ].iter = snap[ 1 ].iter = -1;
+   front = 0;
+   lastDelivered = -1;
+
+   chargeHistory = NULL;
+   historySz = 0;
+
+   nPendingTracks = 0;
+   pendingClear = 0;
+
+   thread = safeNew( SimThread( this ) );
+   connect( this, SIGNAL( frameReady() ), this, SLOT( deliverFrame() ), Qt::QueuedConnection );
+   connect( thread, SIGNAL( finished() ), this, SLOT( runFinished() ), Qt::QueuedConnection );
+}
+
+
+XNernstSim::~XNernstSim()
+{
+   quitting = 1;
+   thread->wait();
+   delete thread;
+   for( int i = 0; i < 2; i++ )
+   {
+      free( snap[ i ].colors );
+      free( snap[ i ].tracked );
+   }
+   free( chargeHistory );
 }
 
 
@@ -50,6 +107,28 @@ XNernstSim::getCurrentIter()
 }
 
 
+const struct simSnapshot *
+XNernstSim::lockSnapshot()
+{
+   snapMutex.lock();
+   return &snap[ front ];
+}
+
+
+void
+XNernstSim::unlockSnapshot()
+{
+   snapMutex.unlock();
+}
+
+
+int
+XNernstSim::chargeAt( int iter )
+{
+   return chargeHistory[ iter ];
+}
+
+
 void
 XNernstSim::loadWorld( int iter )
 {
@@ -64,22 +143,113 @@ XNernstSim::initNernstSim()
    paused = 0;
    resetting = 0;
    NernstSim::initNernstSim();
+
+   for( int i = 0; i < 2; i++ )
+   {
+      snap[ i ].colors = (unsigned char *)realloc( snap[ i ].colors, o->x * o->y );
+      assert( snap[ i ].colors );
+   }
+
    emit calcEquilibrium();
-   emit moveCompleted( 0 );
+   growHistory();
+   chargeHistory[ 0 ] = LRcharge;
+   publish( 0 );
    initialized = 1;
 }
 
 
+// Copy the world into the snapshot the GUI isn't reading, swap, and tell
+// the GUI thread there is a new frame.
+void
+XNernstSim::publish( int iter )
+{
+   struct simSnapshot *back = &snap[ 1 - front ];
+   int i, n = o->x * o->y;
+
+   for( i = 0; i < n; i++ )
+   {
+      back->colors[ i ] = world[ i ].color;
+   }
+
+   if( nTracked > back->trackedSz )
+   {
+      back->trackedSz = nTracked;
+      back->tracked = (unsigned int *)realloc( back->tracked, sizeof( unsigned int ) * nTracked );
+      assert( back->tracked );
+   }
+   for( i = 0; i < nTracked; i++ )
+   {
+      back->tracked[ i ] = tracked[ i ].position;
+   }
+   back->nTracked   = nTracked;
+   back->iter       = iter;
+   back->LRcharge   = LRcharge;
+   back->initLHS_K  = initLHS_K;
+   back->initRHS_K  = initRHS_K;
+   back->initLHS_Na = initLHS_Na;
+   back->initRHS_Na = initRHS_Na;
+   back->initLHS_Cl = initLHS_Cl;
+   back->initRHS_Cl = initRHS_Cl;
+
+   snapMutex.lock();
+   front = 1 - front;
+   snapMutex.unlock();
+
+   lastFrame = nowNsec();
+   emit frameReady();
+}
+
+
+// GUI thread: pass the latest frame on to the widgets.  Frames queued
+// before a reset find an empty snapshot and are dropped.
+void
+XNernstSim::deliverFrame()
+{
+   int iter;
+
+   snapMutex.lock();
+   iter = snap[ front ].iter;
+   snapMutex.unlock();
+
+   if( iter < 0 )
+   {
+      return;
+   }
+
+   emit moveCompleted( iter );
+   emit updateStatus( "Iteration: " + QString::number( iter ) + " of " + QString::number( o->iters )
+         + " | " + QString::number( (int)( 100 * (double)iter / (double)o->iters ) ) + "\% complete" );
+
+   if( iter / 128 > lastDelivered / 128 && iter >= 128 )
+   {
+      emit updateVoltsStatus( iter / 128 * 128, 1 );
+   }
+   lastDelivered = iter;
+}
+
+
+// Is it time to publish?  The GUI samples the simulation at the refresh
+// rate rather than after every iteration.
+int
+XNernstSim::frameDue()
+{
+   if( o->refresh_rate <= 0 )
+   {
+      return 1;
+   }
+
+   return nowNsec() - lastFrame >= 1000000000ULL / o->refresh_rate;
+}
+
+
 int
 XNernstSim::preIter()
 {
    NernstSim::preIter();
-   QCoreApplication::processEvents();
+   applyCommands();
 
    if( paused )
    {
-      emit updateStatus( "Iteration: " + QString::number( currentIter ) + " of " + QString::number( o->iters )
-            + " | " + QString::number( (int)( 100 * (double)currentIter / (double)o->iters ) ) + "\% complete" );
       return 1;
    } else {
       if( resetting || quitting )
@@ -104,29 +274,20 @@ void
 XNernstSim::postIter()
 {
    NernstSim::postIter();
-   emit moveCompleted( currentIter );
 
-   if( currentIter % 8 == 0 )
+   if( currentIter < historySz )
    {
-      emit updateStatus( "Iteration: " + QString::number( currentIter ) + " of " + QString::number( o->iters )
-            + " | " + QString::number( (int)( 100 * (double)currentIter / (double)o->iters ) ) + "\% complete" );
+      chargeHistory[ currentIter ] = LRcharge;
    }
 
-   if( currentIter % 128 == 0 )
+   if( frameDue() )
    {
-      emit updateVoltsStatus( currentIter, 1 );
+      publish( currentIter );
    }
 
-   //sleep( o->sleep );
    if( o->sleep > 0 )
    {
-      QTimer *snooze = new QTimer( this );
-      snooze->setSingleShot( 1 );
-      snooze->start( 100 );
-      while( snooze->isActive() )
-      {
-         QCoreApplication::processEvents();
-      }
+      usleep( 100000 );
    }
 }
 
@@ -138,31 +299,52 @@ XNernstSim::completeNernstSim()
 }
 
 
+// Simulation thread: run until done, paused, reset or quit.
 void
-XNernstSim::runSim()
+XNernstSim::runLoop()
 {
-   if( !initialized )
+   uint64_t start = nowNsec();
+
+   if( o->threads > 1 && o->engine != ENGINE_SUBLATTICE )
    {
-      initNernstSim();
+      runWorkers( this, o );
+   } else {
+      for( ; currentIter <= o->iters; currentIter++ )
+      {
+         if( preIter() )
+         {
+            break;
+         }
+         Iter();
+         postIter();
+      }
    }
 
-   qtime->start();
+   elapsed += ( nowNsec() - start ) * 1.0e-9;
 
-   for( ; currentIter <= o->iters; currentIter++ )
+   // Always show the last iteration run, whether finished or paused.
+   if( !resetting && !quitting )
    {
-      if( preIter() )
-      {
-         break;
-      }
-      Iter();
-      postIter();
+      publish( currentIter - 1 );
    }
+}
 
-   elapsed += qtime->elapsed() / 1000.0;
 
-   if( !resetting )
+// GUI thread, once the simulation thread has stopped.
+void
+XNernstSim::runFinished()
+{
+   if( resetting || quitting )
    {
-      emit updateVoltsStatus( currentIter - 1, 0 );
+      return;
+   }
+
+   emit updateVoltsStatus( currentIter - 1, 0 );
+
+   if( paused )
+   {
+      emit updateStatus( "Iteration: " + QString::number( currentIter ) + " of " + QString::number( o->iters )
+            + " | " + QString::number( (int)( 100 * (double)currentIter / (double)o->iters ) ) + "\% complete" );
    }
 
    if( currentIter > o->iters )
@@ -174,10 +356,50 @@ XNernstSim::runSim()
 }
 
 
+void
+XNernstSim::runSim()
+{
+   if( !initialized )
+   {
+      initNernstSim();
+   }
+
+   if( !thread->isRunning() )
+   {
+      growHistory();
+      thread->start();
+   }
+}
+
+
+// Make room for a charge per iteration up to o->iters, which may have
+// been raised while paused.  Only while the simulation thread is stopped.
+void
+XNernstSim::growHistory()
+{
+   if( o->iters + 1 > historySz )
+   {
+      historySz = o->iters + 1;
+      chargeHistory = (int *)realloc( chargeHistory, historySz * sizeof( int ) );
+      assert( chargeHistory );
+   }
+}
+
+
+// Wait for the simulation thread to notice a command and stop.  It checks
+// once per iteration.
+void
+XNernstSim::stopThread()
+{
+   thread->wait();
+}
+
+
 void
 XNernstSim::pauseSim()
 {
    paused = 1;
+   stopThread();
 }
 
 
@@ -185,7 +407,6 @@ void
 XNernstSim::unpauseSim()
 {
    paused = 0;
-   qtime->restart();
    runSim();
 }
 
@@ -194,11 +415,18 @@ void
 XNernstSim::resetSim()
 {
    resetting = 1;
+   stopThread();
    if( initialized )
    {
       completeNernstSim();
       initialized = 0;
    }
+
+   snapMutex.lock();
+   snap[ 0 ].iter = snap[ 1 ].iter = -1;
+   snapMutex.unlock();
+   lastDelivered = -1;
+
    o->max_atoms = maxatomsDefault;
    shufflePositions( o );
    emit updateStatus( "Ready" );
@@ -210,9 +438,103 @@ void
 XNernstSim::quitSim()
 {
    quitting = 1;
+   stopThread();
    if( initialized )
    {
       completeNernstSim();
       initialized = 0;
    }
 }
+
+
+// Mark the untracked ion nearest ( x, y ), searching no further than
+// searchRadius squares.  Queued if the simulation is running.
+void
+XNernstSim::trackIon( int x, int y, double searchRadius )
+{
+   if( thread->isRunning() )
+   {
+      cmdMutex.lock();
+      if( nPendingTracks < MAX_PENDING_TRACKS )
+      {
+         pendingTracks[ nPendingTracks ].x = x;
+         pendingTracks[ nPendingTracks ].y = y;
+         pendingTracks[ nPendingTracks ].searchRadius = searchRadius;
+         nPendingTracks++;
+      }
+      cmdMutex.unlock();
+   } else {
+      markIon( x, y, searchRadius );
+      publish( currentIter - 1 );
+   }
+}
+
+
+void
+XNernstSim::clearTrackedIons()
+{
+   if( world == NULL )
+   {
+      return;
+   }
+
+   if( thread->isRunning() )
+   {
+      cmdMutex.lock();
+      pendingClear = 1;
+      cmdMutex.unlock();
+   } else {
+      untrackAtoms();
+      publish( currentIter - 1 );
+   }
+}
+
+
+// Simulation thread, between iterations.
+void
+XNernstSim::applyCommands()
+{
+   cmdMutex.lock();
+   if( pendingClear )
+   {
+      untrackAtoms();
+      pendingClear = 0;
+   }
+   for( int i = 0; i < nPendingTracks; i++ )
+   {
+      markIon( pendingTracks[ i ].x, pendingTracks[ i ].y, pendingTracks[ i ].searchRadius );
+   }
+   nPendingTracks = 0;
+   cmdMutex.unlock();
+}
+
+
+void
+XNernstSim::markIon( int mouseX, int mouseY, double offsetMax )
+{
+   int x = mouseX, y = mouseY;
+
+   if( !isUntrackedAtom( idx( x, y ) ) )
+   {
+      int offset = 1, done = 0;
+
+      while( !done && offset < offsetMax )
+      {
+         for( x = mouseX - offset; x <= mouseX + offset && !done; x++ )
+         {
+            for( y = mouseY - offset; y <= mouseY + offset && !done; y++ )
+            {
+               if( isUntrackedAtom( idx( x, y ) ) )
+               {
+                  done = 1;
+               }
+            }
+         }
+         offset++;
+      }
+      x--;
+      y--;
+   }
+
+   trackAtom( idx( x, y ) );
+}
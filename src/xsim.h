@@ -30,18 +30,63 @@
 
 #include <QWidget>
 #include <QTime>
+#include <QThread>
+#include <QMutex>
+#include <stdint.h>
 #include "sim.h"
 
 class NernstGUI;
+class XNernstSim;
+
+
+// Runs the simulation loop off the GUI thread.
+class SimThread : public QThread
+{
+   public:
+      SimThread( XNernstSim *param_sim ) : sim( param_sim ) {}
+
+   protected:
+      virtual void run();
+
+   private:
+      XNernstSim *sim;
+};
+
+
+// What the GUI draws: a copy of the world's colors and counters as of
+// one iteration.  Two of these are kept; the simulation fills one while
+// the GUI reads the other.
+struct simSnapshot
+{
+   unsigned char *colors;     // indexed like world
+   unsigned int *tracked;     // positions of the tracked ions
+   int nTracked, trackedSz;
+   int iter;                  // -1 if nothing has been published
+   int LRcharge;
+   int initLHS_K,  initRHS_K;
+   int initLHS_Na, initRHS_Na;
+   int initLHS_Cl, initRHS_Cl;
+};
 
 
 class XNernstSim : public QWidget, public NernstSim
 {
    Q_OBJECT
 
+   friend class SimThread;
+
    public:
       XNernstSim( struct options *options, QWidget *parent = 0 );
+      ~XNernstSim();
       int getCurrentIter();
+
+      // The GUI must hold the lock while it reads the snapshot.
+      const struct simSnapshot *lockSnapshot();
+      void unlockSnapshot();
+
+      // Membrane charge after each iteration, for plotting.  Valid up
+      // to the iteration of the last delivered frame.
+      int chargeAt( int iter );
  
    public slots:
       void loadWorld( int iter );
@@ -50,27 +95,59 @@ class XNernstSim : public QWidget, public NernstSim
       void unpauseSim();
       void resetSim();
       void quitSim();
+      void trackIon( int x, int y, double searchRadius );
+      void clearTrackedIons();
 
    signals:
       void calcEquilibrium();
-      void moveCompleted( int currentIter );
+      void moveCompleted( int currentIter );   // at most --refresh-rate times a second
       void updateStatus( QString msg );
       void updateVoltsStatus( int currentIter, int avg );
       void finished();
+      void frameReady();                       // internal, from the simulation thread
 
    protected:
  
+   private slots:
+      void deliverFrame();
+      void runFinished();
+
    private:
+      // Written by the GUI thread, polled by the simulation thread.
+      volatile int paused;
+      volatile int resetting;
+      volatile int quitting;
       int initialized;
-      int paused;
-      int resetting;
-      int quitting;
+
+      SimThread *thread;
+
+      QMutex snapMutex;
+      struct simSnapshot snap[ 2 ];
+      int front;              // snap[ front ] is the one the GUI reads
+      int lastDelivered;      // iteration of the last frame shown
+      uint64_t lastFrame;     // when the last frame was published (ns)
+      int *chargeHistory;
+      int historySz;
+
+      // Commands from the GUI, applied between iterations.
+      enum { MAX_PENDING_TRACKS = 16 };
+      QMutex cmdMutex;
+      struct { int x, y; double searchRadius; } pendingTracks[ MAX_PENDING_TRACKS ];
+      int nPendingTracks;
+      int pendingClear;
 
       void initNernstSim();
       int preIter();
       void Iter();
       void postIter();
       void completeNernstSim();
+      void runLoop();
+      void growHistory();
+      void stopThread();
+      int frameDue();
+      void publish( int iter );
+      void applyCommands();
+      void markIon( int x, int y, double searchRadius );
 };
 
-#endif /* SIM_H */
+#endif /* XSIM_H */